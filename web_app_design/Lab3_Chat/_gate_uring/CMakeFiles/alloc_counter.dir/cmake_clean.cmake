@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/alloc_counter.dir/server/test/AllocCounter.cpp.o"
+  "CMakeFiles/alloc_counter.dir/server/test/AllocCounter.cpp.o.d"
+  "liballoc_counter.pdb"
+  "liballoc_counter.so"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/alloc_counter.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
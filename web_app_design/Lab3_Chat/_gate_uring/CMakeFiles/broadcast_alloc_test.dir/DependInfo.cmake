@@ -0,0 +1,21 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/web_app_design/Lab3_Chat/server/test/BroadcastAllocTest.cpp" "CMakeFiles/broadcast_alloc_test.dir/server/test/BroadcastAllocTest.cpp.o" "gcc" "CMakeFiles/broadcast_alloc_test.dir/server/test/BroadcastAllocTest.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/web_app_design/Lab3_Chat/_gate_uring/CMakeFiles/chat_test_support.dir/DependInfo.cmake"
+  "/root/repo/web_app_design/Lab3_Chat/_gate_uring/CMakeFiles/chat_server_core.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
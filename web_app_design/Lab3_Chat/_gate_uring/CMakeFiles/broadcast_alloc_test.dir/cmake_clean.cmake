@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/broadcast_alloc_test.dir/server/test/BroadcastAllocTest.cpp.o"
+  "CMakeFiles/broadcast_alloc_test.dir/server/test/BroadcastAllocTest.cpp.o.d"
+  "broadcast_alloc_test"
+  "broadcast_alloc_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/broadcast_alloc_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/chat_latency_bench.dir/server/test/ChatLatencyBench.cpp.o"
+  "CMakeFiles/chat_latency_bench.dir/server/test/ChatLatencyBench.cpp.o.d"
+  "chat_latency_bench"
+  "chat_latency_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/chat_latency_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,21 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/web_app_design/Lab3_Chat/server/UringLoop.cpp" "CMakeFiles/chat_server.dir/server/UringLoop.cpp.o" "gcc" "CMakeFiles/chat_server.dir/server/UringLoop.cpp.o.d"
+  "/root/repo/web_app_design/Lab3_Chat/server/main.cpp" "CMakeFiles/chat_server.dir/server/main.cpp.o" "gcc" "CMakeFiles/chat_server.dir/server/main.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/web_app_design/Lab3_Chat/_gate_uring/CMakeFiles/chat_server_core.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
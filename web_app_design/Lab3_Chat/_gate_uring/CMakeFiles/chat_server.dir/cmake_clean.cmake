@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/chat_server.dir/server/UringLoop.cpp.o"
+  "CMakeFiles/chat_server.dir/server/UringLoop.cpp.o.d"
+  "CMakeFiles/chat_server.dir/server/main.cpp.o"
+  "CMakeFiles/chat_server.dir/server/main.cpp.o.d"
+  "chat_server"
+  "chat_server.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/chat_server.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
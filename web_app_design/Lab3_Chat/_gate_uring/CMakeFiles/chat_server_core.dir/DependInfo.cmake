@@ -0,0 +1,29 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/web_app_design/Lab3_Chat/common/Crc32c.cpp" "CMakeFiles/chat_server_core.dir/common/Crc32c.cpp.o" "gcc" "CMakeFiles/chat_server_core.dir/common/Crc32c.cpp.o.d"
+  "/root/repo/web_app_design/Lab3_Chat/common/Lz.cpp" "CMakeFiles/chat_server_core.dir/common/Lz.cpp.o" "gcc" "CMakeFiles/chat_server_core.dir/common/Lz.cpp.o.d"
+  "/root/repo/web_app_design/Lab3_Chat/server/BufferPool.cpp" "CMakeFiles/chat_server_core.dir/server/BufferPool.cpp.o" "gcc" "CMakeFiles/chat_server_core.dir/server/BufferPool.cpp.o.d"
+  "/root/repo/web_app_design/Lab3_Chat/server/EventLoop.cpp" "CMakeFiles/chat_server_core.dir/server/EventLoop.cpp.o" "gcc" "CMakeFiles/chat_server_core.dir/server/EventLoop.cpp.o.d"
+  "/root/repo/web_app_design/Lab3_Chat/server/FileStore.cpp" "CMakeFiles/chat_server_core.dir/server/FileStore.cpp.o" "gcc" "CMakeFiles/chat_server_core.dir/server/FileStore.cpp.o.d"
+  "/root/repo/web_app_design/Lab3_Chat/server/FlowControl.cpp" "CMakeFiles/chat_server_core.dir/server/FlowControl.cpp.o" "gcc" "CMakeFiles/chat_server_core.dir/server/FlowControl.cpp.o.d"
+  "/root/repo/web_app_design/Lab3_Chat/server/Frame.cpp" "CMakeFiles/chat_server_core.dir/server/Frame.cpp.o" "gcc" "CMakeFiles/chat_server_core.dir/server/Frame.cpp.o.d"
+  "/root/repo/web_app_design/Lab3_Chat/server/OutboundQueue.cpp" "CMakeFiles/chat_server_core.dir/server/OutboundQueue.cpp.o" "gcc" "CMakeFiles/chat_server_core.dir/server/OutboundQueue.cpp.o.d"
+  "/root/repo/web_app_design/Lab3_Chat/server/Presence.cpp" "CMakeFiles/chat_server_core.dir/server/Presence.cpp.o" "gcc" "CMakeFiles/chat_server_core.dir/server/Presence.cpp.o.d"
+  "/root/repo/web_app_design/Lab3_Chat/server/Roster.cpp" "CMakeFiles/chat_server_core.dir/server/Roster.cpp.o" "gcc" "CMakeFiles/chat_server_core.dir/server/Roster.cpp.o.d"
+  "/root/repo/web_app_design/Lab3_Chat/server/Sha256.cpp" "CMakeFiles/chat_server_core.dir/server/Sha256.cpp.o" "gcc" "CMakeFiles/chat_server_core.dir/server/Sha256.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,31 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/chat_server_core.dir/common/Crc32c.cpp.o"
+  "CMakeFiles/chat_server_core.dir/common/Crc32c.cpp.o.d"
+  "CMakeFiles/chat_server_core.dir/common/Lz.cpp.o"
+  "CMakeFiles/chat_server_core.dir/common/Lz.cpp.o.d"
+  "CMakeFiles/chat_server_core.dir/server/BufferPool.cpp.o"
+  "CMakeFiles/chat_server_core.dir/server/BufferPool.cpp.o.d"
+  "CMakeFiles/chat_server_core.dir/server/EventLoop.cpp.o"
+  "CMakeFiles/chat_server_core.dir/server/EventLoop.cpp.o.d"
+  "CMakeFiles/chat_server_core.dir/server/FileStore.cpp.o"
+  "CMakeFiles/chat_server_core.dir/server/FileStore.cpp.o.d"
+  "CMakeFiles/chat_server_core.dir/server/FlowControl.cpp.o"
+  "CMakeFiles/chat_server_core.dir/server/FlowControl.cpp.o.d"
+  "CMakeFiles/chat_server_core.dir/server/Frame.cpp.o"
+  "CMakeFiles/chat_server_core.dir/server/Frame.cpp.o.d"
+  "CMakeFiles/chat_server_core.dir/server/OutboundQueue.cpp.o"
+  "CMakeFiles/chat_server_core.dir/server/OutboundQueue.cpp.o.d"
+  "CMakeFiles/chat_server_core.dir/server/Presence.cpp.o"
+  "CMakeFiles/chat_server_core.dir/server/Presence.cpp.o.d"
+  "CMakeFiles/chat_server_core.dir/server/Roster.cpp.o"
+  "CMakeFiles/chat_server_core.dir/server/Roster.cpp.o.d"
+  "CMakeFiles/chat_server_core.dir/server/Sha256.cpp.o"
+  "CMakeFiles/chat_server_core.dir/server/Sha256.cpp.o.d"
+  "libchat_server_core.a"
+  "libchat_server_core.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/chat_server_core.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
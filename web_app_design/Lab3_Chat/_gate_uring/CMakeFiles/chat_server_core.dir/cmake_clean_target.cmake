@@ -0,0 +1,3 @@
+file(REMOVE_RECURSE
+  "libchat_server_core.a"
+)
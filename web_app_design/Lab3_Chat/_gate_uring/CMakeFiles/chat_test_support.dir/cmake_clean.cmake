@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/chat_test_support.dir/server/test/TestSupport.cpp.o"
+  "CMakeFiles/chat_test_support.dir/server/test/TestSupport.cpp.o.d"
+  "libchat_test_support.a"
+  "libchat_test_support.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/chat_test_support.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
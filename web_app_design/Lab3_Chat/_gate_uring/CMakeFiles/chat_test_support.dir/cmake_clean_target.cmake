@@ -0,0 +1,3 @@
+file(REMOVE_RECURSE
+  "libchat_test_support.a"
+)
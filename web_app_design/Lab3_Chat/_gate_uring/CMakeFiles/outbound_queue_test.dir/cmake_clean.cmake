@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/outbound_queue_test.dir/server/test/OutboundQueueTest.cpp.o"
+  "CMakeFiles/outbound_queue_test.dir/server/test/OutboundQueueTest.cpp.o.d"
+  "outbound_queue_test"
+  "outbound_queue_test.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/outbound_queue_test.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
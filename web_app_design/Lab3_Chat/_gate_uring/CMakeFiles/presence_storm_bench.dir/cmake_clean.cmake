@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/presence_storm_bench.dir/server/test/PresenceStormBench.cpp.o"
+  "CMakeFiles/presence_storm_bench.dir/server/test/PresenceStormBench.cpp.o.d"
+  "presence_storm_bench"
+  "presence_storm_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/presence_storm_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
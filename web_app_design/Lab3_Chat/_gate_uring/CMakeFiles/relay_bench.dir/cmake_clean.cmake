@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/relay_bench.dir/server/test/RelayBench.cpp.o"
+  "CMakeFiles/relay_bench.dir/server/test/RelayBench.cpp.o.d"
+  "relay_bench"
+  "relay_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/relay_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
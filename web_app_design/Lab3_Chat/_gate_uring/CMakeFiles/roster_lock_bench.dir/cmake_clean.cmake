@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/roster_lock_bench.dir/server/test/RosterLockBench.cpp.o"
+  "CMakeFiles/roster_lock_bench.dir/server/test/RosterLockBench.cpp.o.d"
+  "roster_lock_bench"
+  "roster_lock_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/roster_lock_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
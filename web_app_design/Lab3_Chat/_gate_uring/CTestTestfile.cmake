@@ -0,0 +1,10 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/web_app_design/Lab3_Chat
+# Build directory: /root/repo/web_app_design/Lab3_Chat/_gate_uring
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(outbound_queue_test "/root/repo/web_app_design/Lab3_Chat/_gate_uring/outbound_queue_test")
+set_tests_properties(outbound_queue_test PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/web_app_design/Lab3_Chat/CMakeLists.txt;92;add_test;/root/repo/web_app_design/Lab3_Chat/CMakeLists.txt;0;")
+add_test(broadcast_alloc_test "/root/repo/web_app_design/Lab3_Chat/_gate_uring/broadcast_alloc_test" "/root/repo/web_app_design/Lab3_Chat/_gate_uring/chat_server" "/root/repo/web_app_design/Lab3_Chat/_gate_uring/liballoc_counter.so")
+set_tests_properties(broadcast_alloc_test PROPERTIES  _BACKTRACE_TRIPLES "/root/repo/web_app_design/Lab3_Chat/CMakeLists.txt;100;add_test;/root/repo/web_app_design/Lab3_Chat/CMakeLists.txt;0;")
@@ -10,6 +10,49 @@
 #include <QHostAddress>
 #include <QFileInfo>
 #include <QDir>
+#include <QCryptographicHash>
+#include <cmath>
+#include "../common/Crc32c.h"
+
+// 套接字待发字节超过该值时暂停读文件, 等 bytesWritten 再继续, 界面不被大文件卡住
+static const qint64 OUTBOUND_WRITE_BUDGET = 256 * 1024;
+// 每轮最多处理的文件字节: 增量传输的复制指令很短, 只看套接字积压会一口气扫完整个文件
+static const qint64 OUTBOUND_READ_BUDGET = 4 * 1024 * 1024;
+
+// 文件块大小自适应: 协商后从 INITIAL_CHUNK_SIZE 开始, 每个测量窗口按 2 的幂调整一次,
+// 链路是瓶颈时让一块的发送时间约为 CHUNK_TARGET_MS, 聊天消息不会排在太多文件字节后面
+static const int INITIAL_CHUNK_SIZE = 64 * 1024;
+static const qint64 RATE_WINDOW_MS = 100;
+static const qint64 CHUNK_TARGET_MS = 2;
+
+// 文件块连续这么多块压不小时, 这一路传输不再尝试压缩
+static const int PACK_MISS_LIMIT = 4;
+
+// 接收表的键: 不同发送方可能选用相同的传输 ID
+static quint64 InboundKey(int senderId, quint32 transferId)
+{
+    return ((quint64)(quint32)senderId << 32) | transferId;
+}
+
+// 续传前重新计算已有部分的整体校验值时每次读取的长度
+static const qint64 HASH_READ_SIZE = 64 * 1024;
+
+// 增量发送时每次从文件预读的长度
+static const qint64 DELTA_READ_SIZE = 1024 * 1024;
+static const int DELTA_MIN_BLOCK = 2 * 1024;
+
+// 增量传输的块大小: 取旧版本长度的平方根并按 1KB 对齐, 使签名的总量与未命中时多发的字节大致平衡
+static int DeltaBlockSize(qint64 baseSize)
+{
+    qint64 size = ((qint64)std::sqrt((double)baseSize) + 1023) / 1024 * 1024;
+    return (int)qBound<qint64>(DELTA_MIN_BLOCK, size, FILE_DELTA_MAX_BLOCK);
+}
+
+// 弱校验的 16 位摘要, 用作命中前的快速筛选
+static int DeltaTag(quint32 weak)
+{
+    return (int)((weak ^ (weak >> 16)) & 0xFFFF);
+}
 
 // 初始化UI布局 [cite: 389]
 void MainWindow::InitUi()
@@ -118,6 +161,7 @@ void MainWindow::InitNetwork()
 
     connect(socket, &QTcpSocket::connected, this, &MainWindow::OnConnected);
     connect(socket, &QTcpSocket::readyRead, this, &MainWindow::OnReadyRead);
+    connect(socket, &QTcpSocket::bytesWritten, this, &MainWindow::PumpOutbound);
     connect(socket, &QTcpSocket::disconnected, this, [=]() {
         chatDisplay->append("System: 断开连接");
         sendBtn->setEnabled(false);
@@ -127,7 +171,8 @@ void MainWindow::InitNetwork()
         ipInput->setEnabled(true);
         portInput->setEnabled(true);
         nameInput->setEnabled(true);
-        userListWidget->clear();
+        SuspendTransfers();
+        ResetUserList();
         OnResetChatTarget();
     });
 }
@@ -137,9 +182,20 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
     setWindowTitle("Lab3 Ultimate Chat");
     resize(950, 650);
 
-    receivingFile = nullptr;
-    isReceivingFile = false;
+    outboundCursor = 0;
+    nextTransferId = 1;
+    maxChunkSize = FILE_CHUNK_SIZE;
+    chunkSize = FILE_CHUNK_SIZE;
+    chunkBuf.resize(maxChunkSize);
+    rateBytes = 0;
+    rateStarved = false;
     currentTargetName = "";
+    userListVersion = -1;
+    userListRequested = false;
+    sendProtocol = PROTOCOL_V1;
+    recvProtocol = PROTOCOL_V1;
+    myUserId = 0;
+    compression = false;
 
     InitUi();
     InitNetwork();
@@ -147,8 +203,11 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent)
 
 MainWindow::~MainWindow()
 {
-    if (receivingFile != nullptr) {
-        delete receivingFile;
+    for (const OutboundTransfer &transfer : outbound) {
+        delete transfer.file;
+    }
+    for (const InboundTransfer &transfer : inbound) {
+        delete transfer.file;
     }
 }
 
@@ -176,8 +235,7 @@ void MainWindow::OnResetChatTarget()
 void MainWindow::OnExitClicked()
 {
     if (socket->state() == QAbstractSocket::ConnectedState) {
-        MsgHeader h = {MSG_LOGOUT, 0, 0};
-        socket->write((char *)&h, sizeof(h));
+        WriteHeader(MSG_LOGOUT, 0);
         socket->disconnectFromHost();
     }
     close();
@@ -200,10 +258,20 @@ void MainWindow::OnConnected()
     portInput->setEnabled(false);
     nameInput->setEnabled(false);
 
-    std::string name = nameInput->text().toStdString();
-    MsgHeader h = {MSG_LOGIN, (int)name.size(), 0};
-    socket->write((char *)&h, sizeof(h));
-    socket->write(name.c_str(), name.size());
+    // 带上本端的文件块上限、支持的协议版本与可选功能, 服务端应答双方都能接受的值; 应答到达前按默认大小和 v1 发送
+    sendProtocol = PROTOCOL_V1;
+    recvProtocol = PROTOCOL_V1;
+    compression = false;
+    recvBuffer.clear();
+    std::string login = nameInput->text().toStdString() + "|" + std::to_string(MAX_FILE_CHUNK_SIZE) + "|" +
+                        std::to_string(PROTOCOL_V2) + "|" + std::to_string(FEATURE_COMPRESS | FEATURE_BATCH);
+    WriteHeader(MSG_LOGIN, (int)login.size());
+    socket->write(login.c_str(), login.size());
+
+    // 断线前未完成的传输重新发文件头, 等接收方 (群发时为服务端仓库) 告知已有多少字节
+    for (OutboundTransfer &transfer : outbound) {
+        AnnounceTransfer(transfer);
+    }
 }
 
 void MainWindow::OnSendClicked()
@@ -214,80 +282,593 @@ void MainWindow::OnSendClicked()
     }
 
     if (currentTargetName.isEmpty()) {
-        QString fullMsg = "[" + nameInput->text() + "]: " + text;
+        // v2 由服务端按发送方 ID 转成 "[名字]: " 给旧客户端
+        QString fullMsg = (sendProtocol == PROTOCOL_V2) ? text : "[" + nameInput->text() + "]: " + text;
         std::string content = fullMsg.toStdString();
-        MsgHeader h = {MSG_CHAT_TEXT, (int)content.size(), 0};
-        socket->write((char *)&h, sizeof(h));
-        socket->write(content.c_str(), content.size());
+        SendMessage(MSG_CHAT_TEXT, content.c_str(), (int)content.size());
         chatDisplay->append("我: " + text);
+    } else if (sendProtocol == PROTOCOL_V2) {
+        // v2 私聊按用户 ID 指定对方, 服务端不再回显
+        int targetId = userIds.value(currentTargetName, 0);
+        if (targetId == 0) {
+            chatDisplay->append("[系统]: 用户不存在");
+            return;
+        }
+        std::string textUtf8 = text.toStdString();
+        std::string content;
+        EncodeBody(PrivateChatToServer{(quint32)targetId, {textUtf8}}, content);
+        SendMessage(MSG_CHAT_PRIVATE, content.c_str(), (int)content.size());
+        chatDisplay->append("<font color=\"blue\">(私聊) 我 -> " + currentTargetName + ": " + text + "</font>");
     } else {
         QString payload = currentTargetName + "|" + text;
         std::string content = payload.toStdString();
-        MsgHeader h = {MSG_CHAT_PRIVATE, (int)content.size(), 0};
-        socket->write((char *)&h, sizeof(h));
-        socket->write(content.c_str(), content.size());
+        SendMessage(MSG_CHAT_PRIVATE, content.c_str(), (int)content.size());
     }
     msgInput->clear();
 }
 
-void MainWindow::HandleChatMsg(const QByteArray &body)
+// 按当前发送版本写包头: v1 为固定 12 字节, v2 为 varint (客户端发出的 senderId 总是 0)
+void MainWindow::WriteHeader(int type, int bodyLen)
+{
+    MsgHeader h = {type, bodyLen, 0};
+    if (sendProtocol == PROTOCOL_V2) {
+        char head[V2_HEADER_MAX];
+        socket->write(head, (qint64)EncodeHeaderV2(h, head));
+    } else {
+        socket->write((char *)&h, sizeof(h));
+    }
+}
+
+// 按流压缩后发出一条消息, 压不小 (或未协商压缩) 时原样发出
+void MainWindow::SendMessage(int type, const char *data, int len)
+{
+    packBuf.clear();
+    if (compression && deflater.Compress(data, len, packBuf)) {
+        WriteHeader(type | COMPRESSED_FLAG, (int)packBuf.size());
+        socket->write(packBuf.data(), packBuf.size());
+        return;
+    }
+    WriteHeader(type, len);
+    socket->write(data, len);
+}
+
+// 登录应答: 服务端同意的文件块上限 (MaxChunk), 同意 v2 时为 MaxChunk|2|UserId, 同意了某些功能时再加 |Features
+// 应答之后服务端发来的已是 v2; 本端先用 v1 告知切换, 再按 v2 发送
+void MainWindow::HandleLoginMsg(const MsgHeader &, const QByteArray &body)
+{
+    QList<QByteArray> parts = body.split('|');
+    maxChunkSize = qBound(FILE_CHUNK_SIZE, parts[0].toInt(), MAX_FILE_CHUNK_SIZE);
+    chunkSize = qMin(INITIAL_CHUNK_SIZE, maxChunkSize);
+    chunkBuf.resize(maxChunkSize);
+    if (parts.size() >= 3 && parts[1].toInt() == PROTOCOL_V2) {
+        recvProtocol = PROTOCOL_V2;
+        myUserId = parts[2].toInt();
+        QByteArray version = QByteArray::number(PROTOCOL_V2);
+        WriteHeader(MSG_PROTOCOL, version.size());
+        socket->write(version);
+        sendProtocol = PROTOCOL_V2;
+        int features = parts.size() >= 4 ? parts[3].toInt() : 0;
+        if (features & FEATURE_COMPRESS) {
+            compression = true;
+            deflater = LzEncoder();
+            inflater = LzDecoder();
+        }
+    }
+}
+
+// v2 的正文不带发送方, 按 senderId 查名字; senderId 为 0 的系统消息与 v1 一样原样显示
+void MainWindow::HandleChatMsg(const MsgHeader &header, const QByteArray &body)
 {
-    chatDisplay->append(QString::fromStdString(std::string(body.data(), body.size())));
+    QString msg = QString::fromStdString(std::string(body.data(), body.size()));
+    if (recvProtocol == PROTOCOL_V2 && header.senderId > 0) {
+        msg = "[" + userNames.value(header.senderId, "?") + "]: " + msg;
+    }
+    chatDisplay->append(msg);
 }
 
-void MainWindow::HandlePrivateChatMsg(const QByteArray &body)
+void MainWindow::HandlePrivateChatMsg(const MsgHeader &header, const QByteArray &body)
 {
     QString msg = QString::fromStdString(std::string(body.data(), body.size()));
+    if (recvProtocol == PROTOCOL_V2 && header.senderId > 0) {
+        msg = "(私聊) " + userNames.value(header.senderId, "?") + ": " + msg;
+    }
     chatDisplay->append("<font color=\"blue\">" + msg + "</font>");
 }
 
-void MainWindow::HandleUserListMsg(const QByteArray &body)
+void MainWindow::ResetUserList()
 {
-    QString listStr = QString::fromStdString(std::string(body.data(), body.size()));
-    QStringList names = listStr.split(',');
     userListWidget->clear();
-    userListWidget->addItems(names);
-    onlineCountLabel->setText("在线: " + QString::number(names.size()));
+    userItems.clear();
+    userNames.clear();
+    userIds.clear();
+    userListVersion = -1;
+    userListRequested = false;
+    onlineCountLabel->setText("在线: 0");
 }
 
-void MainWindow::HandleFileInfoMsg(const QByteArray &body)
+// 快照整体替换; 增量只增删对应的行, 版本不连续时向服务端请求快照
+// v1 为 Version|Name1,Name2..., v2 为 Version 之后每个用户一组 UserId, Name
+void MainWindow::HandleUserListMsg(const MsgHeader &header, const QByteArray &body)
 {
-    QString info = QString::fromStdString(std::string(body.data(), body.size()));
-    QStringList parts = info.split('|');
-    if (parts.size() >= 2) {
-        QString fileName = parts[0];
-        fileSizeExpected = parts[1].toLong();
-        QDir d;
-        if (!d.exists("received_files")) {
-            d.mkdir("received_files");
+    qint64 version;
+    QStringList names;
+    QList<int> ids;
+    if (recvProtocol == PROTOCOL_V2) {
+        WireReader in(body.constData(), body.size());
+        quint64 value;
+        if (!in.Varint(value)) {
+            return;
+        }
+        version = (qint64)value;
+        while (in.Left() > 0) {
+            UserEntryWire entry;
+            if (!ReadBody(in, entry)) {
+                return;
+            }
+            ids.append((int)entry.userId);
+            names.append(QString::fromUtf8(entry.name.data(), (int)entry.name.size()));
+        }
+    } else {
+        QString text = QString::fromStdString(std::string(body.data(), body.size()));
+        int sep = text.indexOf('|');
+        if (sep < 0) {
+            return;
+        }
+        version = text.left(sep).toLongLong();
+        QString payload = text.mid(sep + 1);
+        names = payload.isEmpty() ? QStringList() : payload.split(',');
+    }
+
+    if (header.type == MSG_USER_SNAPSHOT) {
+        if (version < userListVersion) {
+            return;
+        }
+        userListWidget->clear();
+        userItems.clear();
+        userNames.clear();
+        userIds.clear();
+        for (int i = 0; i < names.size(); ++i) {
+            QListWidgetItem *item = new QListWidgetItem(names[i], userListWidget);
+            userItems.insert(names[i], item);
+            if (i < ids.size()) {
+                userNames.insert(ids[i], names[i]);
+                userIds.insert(names[i], ids[i]);
+            }
+        }
+        userListVersion = version;
+        userListRequested = false;
+    } else {
+        if (userListVersion < 0 || version <= userListVersion) {
+            return; // 尚无快照, 或快照已包含这条增量
         }
-        if (receivingFile != nullptr) {
-            delete receivingFile;
+        if (version != userListVersion + 1) {
+            if (!userListRequested) {
+                userListRequested = true;
+                WriteHeader(MSG_USER_LIST_REQ, 0);
+            }
+            return;
         }
-        receivingFile = new QFile("received_files/" + fileName);
-        if (receivingFile->open(QIODevice::WriteOnly)) {
-            isReceivingFile = true;
-            totalBytesReceived = 0;
-            chatDisplay->append("System: 接收文件 " + fileName);
-            progressBar->setVisible(true);
-            progressBar->setValue(0);
+        for (int i = 0; i < names.size(); ++i) {
+            const QString &name = names[i];
+            int id = (i < ids.size()) ? ids[i] : 0;
+            if (header.type == MSG_USER_JOINED) {
+                if (!userItems.contains(name)) {
+                    userItems.insert(name, new QListWidgetItem(name, userListWidget));
+                }
+                if (id != 0) {
+                    userNames.insert(id, name);
+                    userIds.insert(name, id);
+                }
+                ResumeTransfersTo(name);
+            } else {
+                delete userItems.take(name); // QListWidgetItem 析构时自动移出列表
+                userNames.remove(id);
+                if (userIds.value(name) == id) {
+                    userIds.remove(name);
+                }
+                PauseTransfersTo(name);
+            }
         }
+        userListVersion = version;
     }
+    onlineCountLabel->setText("在线: " + QString::number(userListWidget->count()));
 }
 
-void MainWindow::HandleFileDataMsg(const QByteArray &body)
+// 文件信息: v1 为 TransferId|Name|Size|SenderName[|1], v2 为 TransferId, Size, Flags, Name (发送方见 senderId)
+// 同名的 .part 文件即上次中断时已校验的部分, 据此应答续传偏移;
+// 同名的完整文件视为旧版本, 先发它的分块签名, 发送方只发出改动过的部分 (服务端仓库发出的除外)
+void MainWindow::HandleFileInfoMsg(const MsgHeader &header, const QByteArray &body)
 {
-    if (isReceivingFile && receivingFile->isOpen()) {
-        receivingFile->write(body);
-        totalBytesReceived += body.size();
-        if (fileSizeExpected > 0) {
-            progressBar->setValue((totalBytesReceived * 100) / fileSizeExpected);
+    quint32 transferId;
+    QString fileName;
+    qint64 size;
+    QString senderName;
+    bool fromStore;
+    if (recvProtocol == PROTOCOL_V2) {
+        FileInfoToClient wire;
+        if (!DecodeBody(body.constData(), body.size(), wire)) {
+            return;
         }
-        if (totalBytesReceived >= fileSizeExpected) {
-            chatDisplay->append("System: 接收完成");
-            receivingFile->close();
-            isReceivingFile = false;
-            progressBar->setVisible(false);
+        transferId = (quint32)wire.transferId;
+        size = (qint64)wire.size;
+        fromStore = (wire.flags & 1) != 0;
+        fileName = QString::fromUtf8(wire.name.data(), (int)wire.name.size());
+        senderName = userNames.value(header.senderId);
+    } else {
+        QString info = QString::fromStdString(std::string(body.data(), body.size()));
+        QStringList parts = info.split('|');
+        if (parts.size() < 4) {
+            return;
+        }
+        transferId = parts[0].toUInt();
+        fileName = parts[1];
+        size = parts[2].toLongLong();
+        senderName = parts[3];
+        fromStore = parts.size() >= 5;
+    }
+    QDir d;
+    if (!d.exists("received_files")) {
+        d.mkdir("received_files");
+    }
+    // 发送方重连后会话号变了, 旧的一路若仍开着同一个 .part 先关掉
+    for (auto it = inbound.begin(); it != inbound.end();) {
+        if (it.value().name == fileName) {
+            delete it.value().file;
+            delete it.value().base;
+            it = inbound.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    InboundTransfer transfer;
+    transfer.file = new QFile("received_files/" + fileName + ".part");
+    transfer.name = fileName;
+    transfer.sender = senderName;
+    transfer.senderId = header.senderId;
+    transfer.size = size;
+    if (!transfer.file->open(QIODevice::ReadWrite)) {
+        delete transfer.file;
+        return;
+    }
+    if (transfer.file->size() > size) {
+        transfer.file->resize(0);
+    }
+    QByteArray buf;
+    while (!(buf = transfer.file->read(HASH_READ_SIZE)).isEmpty()) {
+        transfer.fileCrc = Crc32c(transfer.fileCrc, buf.constData(), buf.size());
+        transfer.received += buf.size();
+    }
+    QFileInfo baseInfo("received_files/" + fileName);
+    if (!fromStore && baseInfo.isFile()) {
+        int blockSize = DeltaBlockSize(baseInfo.size());
+        QFile *base = new QFile(baseInfo.filePath());
+        if (baseInfo.size() >= blockSize && base->open(QIODevice::ReadOnly)) {
+            transfer.base = base;
+            transfer.blockSize = blockSize;
+        } else {
+            delete base;
+        }
+    }
+    inbound.insert(InboundKey(header.senderId, transferId), transfer);
+    if (transfer.received > 0) {
+        chatDisplay->append("System: 续传文件 " + fileName + ", 已有 " + QString::number(transfer.received) + " 字节");
+    } else if (transfer.base != nullptr) {
+        chatDisplay->append("System: 接收文件 " + fileName + ", 已有旧版本, 只接收改动的部分");
+    } else {
+        chatDisplay->append("System: 接收文件 " + fileName);
+    }
+    if (transfer.base != nullptr) {
+        SendBlockSignatures(transfer, transferId);
+    }
+    SendFileResume(transfer, transferId);
+    UpdateProgress();
+}
+
+// 文件块; 压缩过的 (MSG_FILE_PACKED) 先解开, 解不开的按校验失败处理
+void MainWindow::HandleFileDataMsg(const MsgHeader &header, const QByteArray &body)
+{
+    if (body.size() < (int)sizeof(FileChunkHeader)) {
+        return;
+    }
+    FileChunkHeader chunk;
+    memcpy(&chunk, body.constData(), sizeof(chunk));
+    auto it = inbound.find(InboundKey(header.senderId, chunk.transferId));
+    if (it == inbound.end()) {
+        return;
+    }
+    const char *data = body.constData() + sizeof(chunk);
+    int len = body.size() - (int)sizeof(chunk);
+    if (header.type == MSG_FILE_PACKED) {
+        unpackBuf.clear();
+        if (!LzDecompressBlock(data, len, maxChunkSize, unpackBuf)) {
+            if (chunk.offset == it.value().received) {
+                RequestRewind(it.value(), chunk.transferId);
+            }
+            return;
+        }
+        data = unpackBuf.data();
+        len = (int)unpackBuf.size();
+    }
+    AcceptFileData(it.value(), chunk, data, len);
+}
+
+// 复制指令: 从旧版本取出对应的块, 与文件块一样校验后写入; 取不出或校验不符时请求重传
+void MainWindow::HandleFileCopyMsg(const MsgHeader &header, const QByteArray &body)
+{
+    if (body.size() < (int)sizeof(FileCopyHeader)) {
+        return;
+    }
+    FileCopyHeader copy;
+    memcpy(&copy, body.constData(), sizeof(copy));
+    auto it = inbound.find(InboundKey(header.senderId, copy.transferId));
+    if (it == inbound.end() || copy.offset != it.value().received) {
+        return; // 重复的指令, 或重传请求发出前已在路上的指令
+    }
+    InboundTransfer &transfer = it.value();
+    QByteArray data;
+    if (transfer.base != nullptr && transfer.base->seek((qint64)copy.blockIndex * transfer.blockSize)) {
+        data = transfer.base->read(transfer.blockSize);
+    }
+    if (data.size() != transfer.blockSize || transfer.blockSize == 0) {
+        RequestRewind(transfer, copy.transferId);
+        return;
+    }
+    FileChunkHeader chunk = {copy.transferId, copy.crc, copy.offset};
+    AcceptFileData(transfer, chunk, data.constData(), data.size());
+}
+
+void MainWindow::RequestRewind(InboundTransfer &transfer, quint32 transferId)
+{
+    if (!transfer.rewindRequested) {
+        transfer.rewindRequested = true;
+        SendFileResume(transfer, transferId);
+    }
+}
+
+// 只接受覆盖已写入位置且校验通过的块 (服务端仓库按整块发送, 续传时可能与已有部分重叠);
+// 校验失败时请求发送方从已写入的位置重发
+void MainWindow::AcceptFileData(InboundTransfer &transfer, const FileChunkHeader &chunk, const char *data, int len)
+{
+    if (chunk.offset > transfer.received || chunk.offset + len <= transfer.received) {
+        return; // 重复的块, 或重传请求发出前已在路上的块
+    }
+    if (Crc32c(0, data, len) != chunk.crc) {
+        RequestRewind(transfer, chunk.transferId);
+        return;
+    }
+    int skip = (int)(transfer.received - chunk.offset);
+    transfer.file->seek(transfer.received);
+    transfer.file->write(data + skip, len - skip);
+    transfer.fileCrc = Crc32c(transfer.fileCrc, data + skip, len - skip);
+    transfer.received += len - skip;
+    transfer.rewindRequested = false;
+    UpdateProgress();
+}
+
+// 发送方发完时带整个文件的校验值, 校验后向发送方确认完成;
+// 服务端代发 (发送方掉线) 时只有 TransferId, .part 留待续传
+void MainWindow::HandleFileEndMsg(const MsgHeader &header, const QByteArray &body)
+{
+    if (body.size() < TRANSFER_ID_LEN) {
+        return;
+    }
+    quint32 transferId;
+    memcpy(&transferId, body.constData(), TRANSFER_ID_LEN);
+    quint64 key = InboundKey(header.senderId, transferId);
+    auto it = inbound.find(key);
+    if (it == inbound.end()) {
+        return;
+    }
+    quint32 fileCrc = 0;
+    bool interrupted = body.size() < TRANSFER_ID_LEN + (int)sizeof(fileCrc);
+    if (!interrupted && it.value().received < it.value().size) {
+        // 有块校验失败, 重传还没到: 保持打开, 发送方会从已写入的位置续传
+        RequestRewind(it.value(), transferId);
+        return;
+    }
+    InboundTransfer transfer = it.value();
+    inbound.erase(it);
+    transfer.file->close();
+    delete transfer.base; // 旧版本随后被新文件替换
+    transfer.base = nullptr;
+    if (!interrupted) {
+        memcpy(&fileCrc, body.constData() + TRANSFER_ID_LEN, sizeof(fileCrc));
+        SendFileResume(transfer, transferId, true);
+    }
+    QString finalPath = "received_files/" + transfer.name;
+    if (interrupted) {
+        chatDisplay->append("System: 文件 " + transfer.name + " 传输中断, 已保留 " +
+                            QString::number(transfer.received) + " 字节, 发送方重连后续传");
+    } else if (fileCrc != transfer.fileCrc) {
+        transfer.file->remove();
+        chatDisplay->append("System: 文件 " + transfer.name + " 整体校验失败, 已丢弃");
+    } else {
+        QFile::remove(finalPath);
+        transfer.file->rename(finalPath);
+        chatDisplay->append("System: 接收完成 " + transfer.name);
+    }
+    delete transfer.file;
+    UpdateProgress();
+}
+
+// 续传应答 (v1 为 TransferId|Offset, v2 为 TransferId, Offset, Done): 从接收方已有的字节之后开始发
+// 完成确认 (v1 为 TransferId|Size|1): 接收方已校验整个文件, 群发时为服务端已入库
+void MainWindow::HandleFileResumeMsg(const MsgHeader &, const QByteArray &body)
+{
+    quint32 transferId;
+    qint64 offset;
+    bool done;
+    if (recvProtocol == PROTOCOL_V2) {
+        ResumeToClient wire;
+        if (!DecodeBody(body.constData(), body.size(), wire)) {
+            return;
+        }
+        transferId = (quint32)wire.transferId;
+        offset = (qint64)wire.offset;
+        done = wire.done != 0;
+    } else {
+        QStringList parts = QString::fromStdString(std::string(body.data(), body.size())).split('|');
+        if (parts.size() < 2) {
+            return;
+        }
+        transferId = parts[0].toUInt();
+        offset = parts[1].toLongLong();
+        done = parts.size() >= 3;
+    }
+    for (int i = 0; i < outbound.size(); ++i) {
+        OutboundTransfer &transfer = outbound[i];
+        if (transfer.id != transferId) {
+            continue;
+        }
+        if (done) {
+            if (!transfer.finished) {
+                chatDisplay->append("System: 服务器已有 " + transfer.name + ", 无需上传");
+            } else if (transfer.delta.reused > 0) {
+                chatDisplay->append("System: 发送完毕 " + transfer.name + ", 其中 " +
+                                    QString::number(transfer.delta.reused) + " 字节由对方从旧版本复制");
+            } else {
+                chatDisplay->append("System: 发送完毕 " + transfer.name);
+            }
+            RemoveTransfer(i);
+            UpdateProgress();
+            return;
+        }
+        if (transfer.finished) {
+            // 结束标记已发出, 服务端的路由随之撤销: 重发文件头, 按新的应答续传
+            transfer.finished = false;
+            AnnounceTransfer(transfer);
+            return;
+        }
+        if (transfer.active && transfer.delta.blockSize > 0) {
+            // 中途要求重传: 对方的旧版本可能已被改动, 余下部分整份发送
+            transfer.delta = DeltaState();
+        }
+        transfer.sent = qBound<qint64>(0, offset, transfer.size);
+        if (!transfer.active && transfer.sent > 0) {
+            chatDisplay->append("System: 文件 " + transfer.name + " 从 " + QString::number(transfer.sent) +
+                                " 字节处续传");
+        }
+        transfer.active = true;
+        PumpOutbound();
+        return;
+    }
+}
+
+// 旧版本的分块签名 (v1 为 TransferId|BlockSize|FirstIndex| + BlockSignature..., v2 的三个数为 varint),
+// 在续传应答之前到达
+void MainWindow::HandleFileSigsMsg(const MsgHeader &, const QByteArray &body)
+{
+    quint32 transferId;
+    int blockSize;
+    int first;
+    int entriesPos;
+    if (recvProtocol == PROTOCOL_V2) {
+        SigsToClient wire;
+        if (!DecodeBody(body.constData(), body.size(), wire) || wire.blockSize > (quint64)FILE_DELTA_MAX_BLOCK ||
+            wire.firstIndex > (quint64)INT32_MAX) {
+            return;
+        }
+        transferId = (quint32)wire.transferId;
+        blockSize = (int)wire.blockSize;
+        first = (int)wire.firstIndex;
+        entriesPos = body.size() - (int)wire.sigs.data.size();
+    } else {
+        int idPos = body.indexOf('|');
+        int sizePos = (idPos < 0) ? -1 : body.indexOf('|', idPos + 1);
+        int firstPos = (sizePos < 0) ? -1 : body.indexOf('|', sizePos + 1);
+        if (firstPos < 0) {
+            return;
+        }
+        transferId = body.left(idPos).toUInt();
+        blockSize = body.mid(idPos + 1, sizePos - idPos - 1).toInt();
+        first = body.mid(sizePos + 1, firstPos - sizePos - 1).toInt();
+        entriesPos = firstPos + 1;
+    }
+    if (blockSize <= 0 || blockSize > FILE_DELTA_MAX_BLOCK) {
+        return;
+    }
+    for (OutboundTransfer &transfer : outbound) {
+        if (transfer.id != transferId || transfer.target.isEmpty() || transfer.active) {
+            continue;
+        }
+        DeltaState &delta = transfer.delta;
+        if (first == 0) {
+            delta = DeltaState();
+            delta.blockSize = blockSize;
+            delta.tags.resize(1 << 16);
+        } else if (blockSize != delta.blockSize || first * (int)sizeof(BlockSignature::strong) != delta.strong.size()) {
+            return;
+        }
+        const char *entries = body.constData() + entriesPos;
+        int count = (body.size() - entriesPos) / (int)sizeof(BlockSignature);
+        for (int i = 0; i < count; ++i) {
+            BlockSignature sig;
+            memcpy(&sig, entries + i * sizeof(sig), sizeof(sig));
+            delta.weak.insert(sig.weak, first + i);
+            delta.tags.setBit(DeltaTag(sig.weak));
+            delta.strong.append((const char *)sig.strong, sizeof(sig.strong));
+        }
+        return;
+    }
+}
+
+// 进度条显示所有进行中传输的总体进度
+void MainWindow::UpdateProgress()
+{
+    qint64 done = 0;
+    qint64 total = 0;
+    for (const OutboundTransfer &transfer : outbound) {
+        done += transfer.sent;
+        total += transfer.size;
+    }
+    for (const InboundTransfer &transfer : inbound) {
+        done += transfer.received;
+        total += transfer.size;
+    }
+    if (outbound.isEmpty() && inbound.isEmpty()) {
+        progressBar->setVisible(false);
+        return;
+    }
+    progressBar->setVisible(true);
+    progressBar->setValue(total > 0 ? (int)((done * 100) / total) : 0);
+}
+
+// 断开连接: 发送暂停待重连; 接收中的文件关闭, .part 留待续传
+void MainWindow::SuspendTransfers()
+{
+    for (OutboundTransfer &transfer : outbound) {
+        transfer.active = false;
+        transfer.finished = false;
+    }
+    outboundCursor = 0;
+    maxChunkSize = FILE_CHUNK_SIZE; // 重连后重新协商
+    chunkSize = FILE_CHUNK_SIZE;
+    for (const InboundTransfer &transfer : inbound) {
+        delete transfer.file;
+        delete transfer.base;
+    }
+    inbound.clear();
+    progressBar->setVisible(false);
+}
+
+// 接收方下线: 后续的块会发往已不存在的连接, 先停下
+void MainWindow::PauseTransfersTo(const QString &name)
+{
+    for (OutboundTransfer &transfer : outbound) {
+        if (transfer.target == name) {
+            transfer.active = false;
+        }
+    }
+}
+
+// 接收方重新上线: 重发文件头, 由它的续传应答决定从哪里继续
+void MainWindow::ResumeTransfersTo(const QString &name)
+{
+    for (OutboundTransfer &transfer : outbound) {
+        if (transfer.target == name && !transfer.active) {
+            transfer.finished = false;
+            AnnounceTransfer(transfer);
         }
     }
 }
@@ -296,77 +877,466 @@ void MainWindow::OnReadyRead()
 {
     recvBuffer.append(socket->readAll());
     while (true) {
-        if (recvBuffer.size() < (int)sizeof(MsgHeader)) {
+        // 每个包都按当前的接收版本解析, 登录应答之后的字节可能已在同一次读取中
+        MsgHeader header;
+        int headLen = sizeof(MsgHeader);
+        if (recvProtocol == PROTOCOL_V2) {
+            headLen = DecodeHeaderV2(recvBuffer.constData(), recvBuffer.size(), header);
+            if (headLen < 0) {
+                socket->abort();
+                return;
+            }
+            if (headLen == 0) {
+                break;
+            }
+        } else if (recvBuffer.size() < headLen) {
             break;
+        } else {
+            memcpy(&header, recvBuffer.data(), sizeof(MsgHeader));
         }
-        MsgHeader header;
-        memcpy(&header, recvBuffer.data(), sizeof(MsgHeader));
-        int totalLen = sizeof(MsgHeader) + header.bodyLen;
+        int totalLen = headLen + header.bodyLen;
         if (recvBuffer.size() < totalLen) {
             break;
         }
 
-        QByteArray body = recvBuffer.mid(sizeof(MsgHeader), header.bodyLen);
+        QByteArray body = recvBuffer.mid(headLen, header.bodyLen);
+        if (header.type & COMPRESSED_FLAG) {
+            const char *data;
+            size_t len;
+            if (!compression || !inflater.Decompress(body.constData(), body.size(), MAX_FILE_CHUNK_SIZE, data, len)) {
+                socket->abort();
+                return;
+            }
+            body = QByteArray(data, (int)len);
+            header.type &= ~COMPRESSED_FLAG;
+        }
 
-        if (header.type == MSG_CHAT_TEXT) {
-            HandleChatMsg(body);
-        } else if (header.type == MSG_CHAT_PRIVATE) {
-            HandlePrivateChatMsg(body);
-        } else if (header.type == MSG_USER_LIST) {
-            HandleUserListMsg(body);
-        } else if (header.type == MSG_FILE_INFO) {
-            HandleFileInfoMsg(body);
-        } else if (header.type == MSG_FILE_DATA) {
-            HandleFileDataMsg(body);
+        if (header.type == MSG_BUNDLE) {
+            if (!HandleBundleMsg(body)) {
+                socket->abort();
+                return;
+            }
+        } else {
+            DispatchMessage(header, body);
         }
         recvBuffer.remove(0, totalLen);
     }
 }
 
+// 服务端合批的消息: 依次取出各个 v2 子帧分发; 分片共享的广播批次里可能有自己发出的群聊, 按 senderId 跳过
+// 子帧不完整或又是批次时返回 false
+bool MainWindow::HandleBundleMsg(const QByteArray &body)
+{
+    int offset = 0;
+    while (offset < body.size()) {
+        MsgHeader header;
+        int headLen = DecodeHeaderV2(body.constData() + offset, body.size() - offset, header);
+        if (headLen <= 0 || header.bodyLen > body.size() - offset - headLen || header.type == MSG_BUNDLE ||
+            (header.type & COMPRESSED_FLAG)) {
+            return false;
+        }
+        if (header.type != MSG_CHAT_TEXT || header.senderId != myUserId) {
+            DispatchMessage(header, body.mid(offset + headLen, header.bodyLen));
+        }
+        offset += headLen + header.bodyLen;
+    }
+    return true;
+}
+
+// 按类型查编译期生成的分发表, 未知类型忽略
+void MainWindow::DispatchMessage(const MsgHeader &header, const QByteArray &body)
+{
+    using Handlers = DispatchTable<void (MainWindow::*)(const MsgHeader &, const QByteArray &),
+                                   On<MSG_LOGIN, &MainWindow::HandleLoginMsg>,
+                                   On<MSG_CHAT_TEXT, &MainWindow::HandleChatMsg>,
+                                   On<MSG_CHAT_PRIVATE, &MainWindow::HandlePrivateChatMsg>,
+                                   On<MSG_USER_SNAPSHOT, &MainWindow::HandleUserListMsg>,
+                                   On<MSG_USER_JOINED, &MainWindow::HandleUserListMsg>,
+                                   On<MSG_USER_LEFT, &MainWindow::HandleUserListMsg>,
+                                   On<MSG_FILE_INFO, &MainWindow::HandleFileInfoMsg>,
+                                   On<MSG_FILE_DATA, &MainWindow::HandleFileDataMsg>,
+                                   On<MSG_FILE_PACKED, &MainWindow::HandleFileDataMsg>,
+                                   On<MSG_FILE_COPY, &MainWindow::HandleFileCopyMsg>,
+                                   On<MSG_FILE_END, &MainWindow::HandleFileEndMsg>,
+                                   On<MSG_FILE_RESUME, &MainWindow::HandleFileResumeMsg>,
+                                   On<MSG_FILE_SIGS, &MainWindow::HandleFileSigsMsg>>;
+    Handlers::Dispatch(header.type, this, header, body);
+}
+
+// 选中文件后只登记一路传输, 实际数据由 PumpOutbound 与其他传输轮流发出
 void MainWindow::OnSelectFileClicked()
 {
     QString filePath = QFileDialog::getOpenFileName(this, "文件");
     if (filePath.isEmpty()) {
         return;
     }
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
+    QFile *file = new QFile(filePath);
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
         return;
     }
 
     QFileInfo fi(filePath);
-    std::string info = currentTargetName.toStdString() + "|" + 
-                       fi.fileName().toStdString() + "|" + 
-                       std::to_string(file.size());
-    
-    MsgHeader h = {MSG_FILE_INFO, (int)info.size(), 0};
-    socket->write((char *)&h, sizeof(h));
-    socket->write(info.c_str(), info.size());
-
+    OutboundTransfer transfer;
+    transfer.id = nextTransferId++;
+    transfer.file = file;
+    transfer.name = fi.fileName();
+    transfer.target = currentTargetName;
+    transfer.size = file->size();
+    QByteArray head = file->peek(16);
+    transfer.packable = !LooksCompressed(head.constData(), head.size());
+    if (transfer.target.isEmpty()) {
+        // 群发按内容寻址: 先读一遍算出摘要, 顺带算好整体校验值
+        QCryptographicHash sha(QCryptographicHash::Sha256);
+        QByteArray buf;
+        while (!(buf = file->read(HASH_READ_SIZE)).isEmpty()) {
+            sha.addData(buf);
+            transfer.fileCrc = Crc32c(transfer.fileCrc, buf.constData(), buf.size());
+            transfer.hashed += buf.size();
+            QCoreApplication::processEvents();
+        }
+        transfer.sha256 = QString::fromLatin1(sha.result().toHex());
+    }
+    AnnounceTransfer(transfer);
     if (currentTargetName.isEmpty()) {
-        chatDisplay->append("System: 群发文件 " + fi.fileName());
+        chatDisplay->append("System: 群发文件 " + transfer.name);
     } else {
         chatDisplay->append("System: 私发文件 -> " + currentTargetName);
     }
-    
-    progressBar->setVisible(true);
-    progressBar->setValue(0);
+    outbound.append(transfer);
+    PumpOutbound();
+}
 
-    char buf[4096];
-    qint64 total = 0;
-    while (!file.atEnd()) {
-        int len = file.read(buf, sizeof(buf));
-        if (len > 0) {
-            MsgHeader ch = {MSG_FILE_DATA, len, 0};
-            socket->write((char *)&ch, sizeof(ch));
-            socket->write(buf, len);
-            socket->flush();
-            total += len;
-            progressBar->setValue((total * 100) / file.size());
-            QCoreApplication::processEvents();
+// 发文件头; 接收方若有旧版本会在续传应答前重新发来分块签名, 上一次的签名作废
+void MainWindow::AnnounceTransfer(OutboundTransfer &transfer)
+{
+    transfer.delta = DeltaState();
+    std::string info;
+    if (sendProtocol == PROTOCOL_V2) {
+        // 对方不在列表里时先不发, 它上线后 ResumeTransfersTo 会重新发文件头
+        int targetId = transfer.target.isEmpty() ? 0 : userIds.value(transfer.target, 0);
+        if (!transfer.target.isEmpty() && targetId == 0) {
+            return;
+        }
+        std::string name = transfer.name.toStdString();
+        std::string digest;
+        if (transfer.target.isEmpty()) {
+            digest = QByteArray::fromHex(transfer.sha256.toLatin1()).toStdString();
+        }
+        EncodeBody(FileInfoToServer{(quint32)targetId, transfer.id, (quint64)transfer.size, name, {digest}}, info);
+    } else {
+        info = transfer.target.toStdString() + "|" +
+               std::to_string(transfer.id) + "|" +
+               transfer.name.toStdString() + "|" +
+               std::to_string(transfer.size);
+        if (transfer.target.isEmpty()) {
+            info += "|" + transfer.sha256.toStdString();
         }
     }
-    file.close();
-    chatDisplay->append("System: 发送完毕");
-    progressBar->setVisible(false);
-}
\ No newline at end of file
+    SendMessage(MSG_FILE_INFO, info.c_str(), (int)info.size());
+}
+
+// 协商了压缩时文件块逐块压缩 (服务端原样转发, 不依赖之前的块); 压不动的块原样发,
+// 连续 PACK_MISS_LIMIT 块压不动就不再尝试, 不把 CPU 花在已压缩的内容上
+void MainWindow::SendFileChunk(OutboundTransfer &transfer, const char *data, int len)
+{
+    FileChunkHeader chunk = {transfer.id, Crc32c(0, data, len), transfer.sent};
+    if (compression && transfer.packable) {
+        packBuf.clear();
+        if (LzCompressBlock(data, len, packBuf)) {
+            transfer.packMisses = 0;
+            WriteHeader(MSG_FILE_PACKED, (int)(sizeof(chunk) + packBuf.size()));
+            socket->write((const char *)&chunk, sizeof(chunk));
+            socket->write(packBuf.data(), packBuf.size());
+            return;
+        }
+        transfer.packable = ++transfer.packMisses < PACK_MISS_LIMIT;
+    }
+    WriteHeader(MSG_FILE_DATA, (int)sizeof(chunk) + len);
+    socket->write((const char *)&chunk, sizeof(chunk));
+    socket->write(data, len);
+}
+
+void MainWindow::SendFileResume(const InboundTransfer &transfer, quint32 transferId, bool done)
+{
+    std::string payload;
+    if (sendProtocol == PROTOCOL_V2) {
+        EncodeBody(ResumeToServer{(quint32)transfer.senderId, transferId, (quint64)transfer.received, done ? 1u : 0u},
+                   payload);
+    } else {
+        payload = transfer.sender.toStdString() + "|" + std::to_string(transferId) + "|" +
+                  std::to_string(transfer.received) + (done ? "|1" : "");
+    }
+    SendMessage(MSG_FILE_RESUME, payload.c_str(), (int)payload.size());
+}
+
+// 旧版本按块签名, 分成若干条发给发送方, 每条带上起始块号
+void MainWindow::SendBlockSignatures(const InboundTransfer &transfer, quint32 transferId)
+{
+    std::string prefix = transfer.sender.toStdString() + "|" + std::to_string(transferId) + "|" +
+                         std::to_string(transfer.blockSize) + "|";
+    std::string payload;
+    int first = 0;
+    int index = 0;
+    auto flush = [&]() {
+        std::string msg;
+        if (sendProtocol == PROTOCOL_V2) {
+            EncodeBody(SigsToServer{(quint32)transfer.senderId, transferId, (quint32)transfer.blockSize,
+                                    (quint32)first, {payload}}, msg);
+        } else {
+            msg = prefix + std::to_string(first) + "|" + payload;
+        }
+        SendMessage(MSG_FILE_SIGS, msg.data(), (int)msg.size());
+        payload.clear();
+        first = index;
+    };
+    transfer.base->seek(0);
+    QByteArray block;
+    while ((block = transfer.base->read(transfer.blockSize)).size() == transfer.blockSize) {
+        BlockSignature sig;
+        sig.weak = RollingChecksum::Of(block.constData(), block.size());
+        QByteArray md5 = QCryptographicHash::hash(block, QCryptographicHash::Md5);
+        memcpy(sig.strong, md5.constData(), sizeof(sig.strong));
+        payload.append((const char *)&sig, sizeof(sig));
+        if (++index - first == FILE_SIGS_PER_MSG) {
+            flush();
+        }
+    }
+    if (index > first) {
+        flush();
+    }
+}
+
+// 整体校验值按文件顺序累计; 续传跳过的前缀在这里补算, 重传已算过的块不再重复计入
+bool MainWindow::HashFileUpTo(OutboundTransfer &transfer, qint64 pos)
+{
+    if (transfer.hashed >= pos) {
+        return true;
+    }
+    transfer.file->seek(transfer.hashed);
+    while (transfer.hashed < pos) {
+        QByteArray buf = transfer.file->read(qMin(HASH_READ_SIZE, pos - transfer.hashed));
+        if (buf.isEmpty()) {
+            return false;
+        }
+        transfer.fileCrc = Crc32c(transfer.fileCrc, buf.constData(), buf.size());
+        transfer.hashed += buf.size();
+    }
+    return true;
+}
+
+// 发送结束标记, 等对方确认完成后再移出列表; 文件在发送期间被改短时放弃这路传输
+void MainWindow::FinishTransfer(int index)
+{
+    OutboundTransfer &transfer = outbound[index];
+    if (HashFileUpTo(transfer, transfer.size)) {
+        char end[TRANSFER_ID_LEN + sizeof(quint32)];
+        memcpy(end, &transfer.id, TRANSFER_ID_LEN);
+        memcpy(end + TRANSFER_ID_LEN, &transfer.fileCrc, sizeof(quint32));
+        WriteHeader(MSG_FILE_END, (int)sizeof(end));
+        socket->write(end, sizeof(end));
+        transfer.active = false;
+        transfer.finished = true;
+        return;
+    }
+    WriteHeader(MSG_FILE_END, TRANSFER_ID_LEN);
+    socket->write((const char *)&transfer.id, TRANSFER_ID_LEN);
+    chatDisplay->append("System: 读取 " + transfer.name + " 失败, 发送取消");
+    RemoveTransfer(index);
+}
+
+void MainWindow::RemoveTransfer(int index)
+{
+    delete outbound[index].file;
+    outbound.removeAt(index);
+    if (outboundCursor > index) {
+        --outboundCursor;
+    }
+}
+
+// 从游标开始找下一路可以发送的传输, 没有时返回 -1
+int MainWindow::NextActiveTransfer()
+{
+    for (int step = 0; step < outbound.size(); ++step) {
+        int index = (outboundCursor + step) % outbound.size();
+        if (outbound[index].active) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+// 保证缓冲区覆盖 [sent, end): 丢掉 sent 之前的字节, 不够时一次多读一些
+bool MainWindow::FillDeltaBuffer(OutboundTransfer &transfer, qint64 end)
+{
+    DeltaState &delta = transfer.delta;
+    qint64 bufEnd = delta.bufStart + delta.buf.size();
+    if (delta.bufStart <= transfer.sent && bufEnd >= end) {
+        return true;
+    }
+    if (transfer.sent >= delta.bufStart && transfer.sent <= bufEnd) {
+        delta.buf.remove(0, (int)(transfer.sent - delta.bufStart));
+    } else {
+        delta.buf.clear();
+    }
+    delta.bufStart = transfer.sent;
+    bufEnd = delta.bufStart + delta.buf.size();
+    qint64 want = qMin(transfer.size, qMax(end, bufEnd + DELTA_READ_SIZE));
+    if (want > bufEnd && transfer.file->seek(bufEnd)) {
+        delta.buf.append(transfer.file->read(want - bufEnd));
+    }
+    return delta.bufStart + delta.buf.size() >= end;
+}
+
+// 把 [sent, end) 开头的至多一块作为普通文件块发出
+bool MainWindow::SendDeltaLiteral(OutboundTransfer &transfer, qint64 end)
+{
+    qint64 len = qMin<qint64>(end - transfer.sent, chunkSize);
+    if (!FillDeltaBuffer(transfer, transfer.sent + len)) {
+        return false;
+    }
+    const char *data = transfer.delta.buf.constData() + (transfer.sent - transfer.delta.bufStart);
+    if (transfer.hashed == transfer.sent) {
+        transfer.fileCrc = Crc32c(transfer.fileCrc, data, len);
+        transfer.hashed += len;
+    }
+    SendFileChunk(transfer, data, (int)len);
+    transfer.sent += len;
+    return true;
+}
+
+// 增量发送的一步, 每次发出一条消息: 窗口与旧版本某块相同时让接收方复制该块,
+// 否则窗口逐字节后移, 移过的字节攒满一块或遇到下一个相同的块时作为普通块发出
+bool MainWindow::SendDeltaStep(OutboundTransfer &transfer)
+{
+    DeltaState &delta = transfer.delta;
+    const int block = delta.blockSize;
+    if (delta.scan < transfer.sent) {
+        delta.scan = transfer.sent;
+        delta.rollingValid = false;
+    }
+    while (true) {
+        if (delta.scan + block > transfer.size) {
+            return SendDeltaLiteral(transfer, transfer.size); // 剩下不足一块
+        }
+        // 多读一个字节, 窗口后移时要用
+        if (!FillDeltaBuffer(transfer, qMin(delta.scan + block + 1, transfer.size))) {
+            return false;
+        }
+        const char *window = delta.buf.constData() + (delta.scan - delta.bufStart);
+        if (!delta.rollingValid) {
+            delta.rolling.Reset(window, block);
+            delta.rollingValid = true;
+        }
+        quint32 weak = delta.rolling.Value();
+        int index = -1;
+        if (delta.tags.testBit(DeltaTag(weak))) {
+            QByteArray md5;
+            for (auto it = delta.weak.constFind(weak); it != delta.weak.constEnd() && it.key() == weak; ++it) {
+                if (md5.isEmpty()) {
+                    md5 = QCryptographicHash::hash(QByteArray::fromRawData(window, block), QCryptographicHash::Md5);
+                }
+                if (memcmp(delta.strong.constData() + it.value() * md5.size(), md5.constData(), md5.size()) == 0) {
+                    index = it.value();
+                    break;
+                }
+            }
+        }
+        if (index >= 0) {
+            if (delta.scan > transfer.sent) {
+                return SendDeltaLiteral(transfer, delta.scan);
+            }
+            FileCopyHeader copy = {transfer.id, Crc32c(0, window, block), transfer.sent, (quint32)index, 0};
+            if (transfer.hashed == transfer.sent) {
+                transfer.fileCrc = Crc32c(transfer.fileCrc, window, block);
+                transfer.hashed += block;
+            }
+            WriteHeader(MSG_FILE_COPY, (int)sizeof(copy));
+            socket->write((const char *)&copy, sizeof(copy));
+            transfer.sent += block;
+            delta.reused += block;
+            delta.scan = transfer.sent;
+            delta.rollingValid = false;
+            return true;
+        }
+        if (delta.scan - transfer.sent >= chunkSize || delta.scan + block == transfer.size) {
+            return SendDeltaLiteral(transfer, transfer.size);
+        }
+        delta.rolling.Roll((uchar)window[0], (uchar)window[block]);
+        ++delta.scan;
+    }
+}
+
+// 每个测量窗口结束时调整块大小: 套接字曾被发空说明每块的固定开销是瓶颈, 加大;
+// 否则按实测吞吐把一块的发送时间拉向 CHUNK_TARGET_MS
+void MainWindow::AdaptChunkSize()
+{
+    if (!rateTimer.isValid() || rateBytes == 0) {
+        rateTimer.start(); // 刚开始发送或没有在发送: 空闲时间不计入吞吐
+        rateBytes = 0;
+        rateStarved = false;
+        return;
+    }
+    qint64 elapsed = rateTimer.elapsed();
+    if (elapsed < RATE_WINDOW_MS) {
+        return;
+    }
+    qint64 target = rateBytes * CHUNK_TARGET_MS / elapsed;
+    if (rateStarved || chunkSize * 2 <= target) {
+        chunkSize = qMin(chunkSize * 2, maxChunkSize);
+    } else if (chunkSize > target * 2) {
+        chunkSize = qMax(chunkSize / 2, FILE_CHUNK_SIZE);
+    }
+    rateBytes = 0;
+    rateStarved = false;
+    rateTimer.start();
+}
+
+// 各路传输轮流发一块, 套接字积压到上限就停下, 由 bytesWritten 信号再次驱动
+// 积压上限至少能放下两块, 否则大块之间套接字会发空
+void MainWindow::PumpOutbound()
+{
+    char *buf = chunkBuf.data();
+    qint64 budget = qMax<qint64>(OUTBOUND_WRITE_BUDGET, 2 * (qint64)chunkSize);
+    if (socket->bytesToWrite() == 0 && NextActiveTransfer() >= 0) {
+        rateStarved = true;
+    }
+    qint64 processed = 0;
+    while (socket->bytesToWrite() < budget && processed < OUTBOUND_READ_BUDGET) {
+        int index = NextActiveTransfer();
+        if (index < 0) {
+            break;
+        }
+        OutboundTransfer &transfer = outbound[index];
+        if (transfer.delta.blockSize > 0) {
+            qint64 before = transfer.sent;
+            if (transfer.sent >= transfer.size || !HashFileUpTo(transfer, transfer.sent) || !SendDeltaStep(transfer)) {
+                FinishTransfer(index);
+                continue;
+            }
+            processed += transfer.sent - before;
+            outboundCursor = index + 1;
+            continue;
+        }
+        qint64 len = 0;
+        if (transfer.sent < transfer.size && HashFileUpTo(transfer, transfer.sent) &&
+            transfer.file->seek(transfer.sent)) {
+            len = transfer.file->read(buf, qMin<qint64>(chunkSize, transfer.size - transfer.sent));
+        }
+        if (len <= 0) {
+            FinishTransfer(index);
+            continue;
+        }
+        if (transfer.hashed == transfer.sent) {
+            transfer.fileCrc = Crc32c(transfer.fileCrc, buf, len);
+            transfer.hashed += len;
+        }
+        SendFileChunk(transfer, buf, (int)len);
+        transfer.sent += len;
+        processed += len;
+        outboundCursor = index + 1;
+    }
+    rateBytes += processed;
+    AdaptChunkSize();
+    UpdateProgress();
+}
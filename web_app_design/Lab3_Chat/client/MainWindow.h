@@ -20,7 +20,14 @@
 #include <QFile>
 #include <QFileDialog>
 #include <QCloseEvent>
+#include <QElapsedTimer>
+#include <QBitArray>
+#include <QHash>
+#include <QList>
+#include <QMultiHash>
+#include "../common/Lz.h"
 #include "../common/Protocol.h"
+#include "../common/RollingChecksum.h"
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -40,16 +47,90 @@ private slots:
     void OnExitClicked();
     void OnUserListClicked(QListWidgetItem *item);
     void OnResetChatTarget();
+    void PumpOutbound();
 
 private:
     void InitUi();
     void InitNetwork();
-    void HandleLoginMsg(const QByteArray &body);
-    void HandleChatMsg(const QByteArray &body);
-    void HandlePrivateChatMsg(const QByteArray &body);
-    void HandleUserListMsg(const QByteArray &body);
-    void HandleFileInfoMsg(const QByteArray &body);
-    void HandleFileDataMsg(const QByteArray &body);
+    void WriteHeader(int type, int bodyLen);
+    void SendMessage(int type, const char *data, int len);
+    void DispatchMessage(const MsgHeader &header, const QByteArray &body);
+    bool HandleBundleMsg(const QByteArray &body);
+    void HandleLoginMsg(const MsgHeader &, const QByteArray &body);
+    void HandleChatMsg(const MsgHeader &header, const QByteArray &body);
+    void HandlePrivateChatMsg(const MsgHeader &header, const QByteArray &body);
+    void HandleUserListMsg(const MsgHeader &header, const QByteArray &body);
+    void ResetUserList();
+    void HandleFileInfoMsg(const MsgHeader &header, const QByteArray &body);
+    void HandleFileDataMsg(const MsgHeader &header, const QByteArray &body);
+    void HandleFileCopyMsg(const MsgHeader &header, const QByteArray &body);
+    void HandleFileEndMsg(const MsgHeader &header, const QByteArray &body);
+    void HandleFileResumeMsg(const MsgHeader &, const QByteArray &body);
+    void HandleFileSigsMsg(const MsgHeader &, const QByteArray &body);
+
+    // 增量发送: 接收方旧版本的分块签名, 以及在本地文件上滑动的窗口
+    struct DeltaState {
+        int blockSize = 0;              // 为 0 表示整份发送
+        QMultiHash<quint32, int> weak;  // 弱校验 -> 块号
+        QBitArray tags;                 // 弱校验的 16 位摘要, 绝大多数不匹配的位置不用查哈希表
+        QByteArray strong;              // 各块的 MD5 依次相连
+        QByteArray buf;                 // 文件中从 bufStart 开始的一段, 覆盖 [sent, 窗口末尾)
+        qint64 bufStart = 0;
+        qint64 scan = -1;               // 窗口起点, 不小于 sent
+        bool rollingValid = false;
+        RollingChecksum rolling;
+        qint64 reused = 0;              // 由接收方从旧版本复制的字节数
+    };
+    // 一路正在发送的文件; 在断线或对方下线时暂停, 重新发文件头后从对方应答的偏移继续
+    struct OutboundTransfer {
+        quint32 id = 0;
+        QFile *file = nullptr;
+        QString name;
+        QString target;         // 空为群发, 先上传到服务端仓库
+        QString sha256;         // 群发时的内容摘要, 服务端据此去重
+        qint64 size = 0;
+        qint64 sent = 0;        // 下一块的偏移
+        qint64 hashed = 0;      // 已计入 fileCrc 的字节数
+        quint32 fileCrc = 0;
+        bool active = false;    // 收到续传应答后才开始发
+        bool finished = false;  // 已发结束标记, 等对方确认完成
+        bool packable = true;   // 文件块尝试压缩; 已压缩格式的文件, 或连续几块压不动时关掉
+        int packMisses = 0;
+        DeltaState delta;
+    };
+    // 一路正在接收的文件, 数据写入 received_files/<name>.part, 整体校验通过后改名
+    // 已有同名文件时把它作为旧版本 (base), 发送方未改动的块从这里复制
+    struct InboundTransfer {
+        QFile *file = nullptr;
+        QFile *base = nullptr;
+        int blockSize = 0;
+        QString name;
+        QString sender;
+        int senderId = 0;       // v2 中续传应答与签名按用户 ID 指定发送方
+        qint64 size = 0;
+        qint64 received = 0;    // 已校验并写盘的字节数, 即续传偏移
+        quint32 fileCrc = 0;
+        bool rewindRequested = false;
+    };
+
+    void AnnounceTransfer(OutboundTransfer &transfer);
+    void SendFileChunk(OutboundTransfer &transfer, const char *data, int len);
+    void SendFileResume(const InboundTransfer &transfer, quint32 transferId, bool done = false);
+    void SendBlockSignatures(const InboundTransfer &transfer, quint32 transferId);
+    void RequestRewind(InboundTransfer &transfer, quint32 transferId);
+    void AcceptFileData(InboundTransfer &transfer, const FileChunkHeader &chunk, const char *data, int len);
+    bool HashFileUpTo(OutboundTransfer &transfer, qint64 pos);
+    bool FillDeltaBuffer(OutboundTransfer &transfer, qint64 end);
+    bool SendDeltaLiteral(OutboundTransfer &transfer, qint64 end);
+    bool SendDeltaStep(OutboundTransfer &transfer);
+    void FinishTransfer(int index);
+    void RemoveTransfer(int index);
+    int NextActiveTransfer();
+    void PauseTransfersTo(const QString &name);
+    void ResumeTransfersTo(const QString &name);
+    void SuspendTransfers();
+    void UpdateProgress();
+    void AdaptChunkSize();
 
     QWidget *centralWidget;
     
@@ -75,13 +156,41 @@ private:
     // 逻辑变量 (小驼峰) 
     QTcpSocket *socket;
     QByteArray recvBuffer;
+
+    // 协议版本: 登录应答同意 v2 后先按 v2 解析收到的消息, 发出 MSG_PROTOCOL 后再按 v2 发送
+    int sendProtocol;
+    int recvProtocol;
+    int myUserId;
+    // 登录时协商的压缩: 控制与聊天消息每个方向一个压缩流, 文件块逐块压缩为 MSG_FILE_PACKED
+    bool compression;
+    LzEncoder deflater;
+    LzDecoder inflater;
+    std::string packBuf;   // 发出的压缩结果
+    std::string unpackBuf; // 解开的文件块
     
     QString currentTargetName;
 
-    QFile *receivingFile;
-    long totalBytesReceived;
-    long fileSizeExpected;
-    bool isReceivingFile;
+    // 用户列表: 收到快照后按版本号逐条应用增量, -1 表示尚无快照
+    qint64 userListVersion;
+    bool userListRequested;
+    QHash<QString, QListWidgetItem *> userItems;
+    // v2 用数字 ID 表示用户: 显示发送方、指定私聊和文件的接收方时按列表互查
+    QHash<int, QString> userNames;
+    QHash<QString, int> userIds;
+
+    // 多路文件传输: 发送端轮流发各路的块, 接收端按 (发送方会话, 传输 ID) 区分
+    QList<OutboundTransfer> outbound;
+    int outboundCursor;
+    quint32 nextTransferId;
+    QHash<quint64, InboundTransfer> inbound;
+
+    // 文件块大小: 上限在登录时与服务端协商, 发送中按实测吞吐与套接字积压调整
+    int maxChunkSize;
+    int chunkSize;
+    QByteArray chunkBuf;      // 读文件的缓冲区, 按协商的上限分配一次, 各路传输共用
+    QElapsedTimer rateTimer;  // 当前测量窗口
+    qint64 rateBytes;         // 窗口内交给套接字的文件字节
+    bool rateStarved;         // 窗口内套接字曾被发空, 瓶颈在本端
 };
 
 #endif
\ No newline at end of file
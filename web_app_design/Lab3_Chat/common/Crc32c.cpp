@@ -0,0 +1,83 @@
+/*
+ * Description: CRC32C 实现: 启动时检测一次 CPU, 之后直接走选中的版本
+ * Author: 夏凡
+ * Create: 2025-12-16
+ */
+
+#include "Crc32c.h"
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_HAS_SSE42
+#endif
+
+namespace {
+
+const uint32_t CRC32C_POLY = 0x82F63B78; // 反射形式的 Castagnoli 多项式
+
+struct Crc32cTable {
+    uint32_t entry[256];
+
+    Crc32cTable()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+            }
+            entry[i] = crc;
+        }
+    }
+};
+
+uint32_t UpdateSoftware(uint32_t crc, const uint8_t *p, size_t len)
+{
+    static const Crc32cTable table;
+    while (len-- > 0) {
+        crc = table.entry[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CRC32C_HAS_SSE42
+// 只对本函数启用 SSE4.2, 其余代码仍可在老 CPU 上运行
+__attribute__((target("sse4.2")))
+uint32_t UpdateSse42(uint32_t crc, const uint8_t *p, size_t len)
+{
+    uint64_t crc64 = crc;
+    while (len >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += sizeof(word);
+        len -= sizeof(word);
+    }
+    crc = (uint32_t)crc64;
+    while (len-- > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+using UpdateFunc = uint32_t (*)(uint32_t crc, const uint8_t *p, size_t len);
+
+UpdateFunc SelectUpdate()
+{
+#ifdef CRC32C_HAS_SSE42
+    if (__builtin_cpu_supports("sse4.2")) {
+        return UpdateSse42;
+    }
+#endif
+    return UpdateSoftware;
+}
+
+const UpdateFunc g_crc32cUpdate = SelectUpdate();
+
+} // namespace
+
+uint32_t Crc32c(uint32_t crc, const void *data, size_t len)
+{
+    return ~g_crc32cUpdate(~crc, (const uint8_t *)data, len);
+}
@@ -0,0 +1,17 @@
+/*
+ * Description: CRC32C (Castagnoli) 校验, CPU 支持 SSE4.2 时使用 crc32 指令
+ * Author: 夏凡
+ * Create: 2025-12-16
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 在 crc 的基础上继续计算 data 的校验值; 首次调用传 0
+// 分段计算与一次算完结果相同: Crc32c(Crc32c(0, a), b) == Crc32c(0, a + b)
+uint32_t Crc32c(uint32_t crc, const void *data, size_t len);
+
+#endif
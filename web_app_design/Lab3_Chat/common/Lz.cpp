@@ -0,0 +1,280 @@
+/*
+ * Description: LZ77 压缩实现
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#include "Lz.h"
+#include <algorithm>
+#include <cstring>
+#include "Protocol.h"
+
+const size_t MIN_MATCH = 4;
+const size_t MAX_DISTANCE = 65535;    // 回溯距离占 2 字节
+const size_t MIN_INPUT = 16;          // 更短的消息压缩省不下什么
+const size_t PROBE_BYTES = 4 * 1024;  // 读完这么多输入时检查一次压缩率, 压不动就放弃
+const int STREAM_HASH_BITS = 12;      // 每个连接每个方向一张表, 保持小一些
+const int BLOCK_HASH_BITS = 14;
+
+static uint32_t Read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t Hash(uint32_t sequence, int bits)
+{
+    return (sequence * 2654435761u) >> (32 - bits);
+}
+
+static void PutLength(std::string &out, size_t len)
+{
+    while (len >= 255) {
+        out += (char)255;
+        len -= 255;
+    }
+    out += (char)len;
+}
+
+static void PutSequence(std::string &out, const uint8_t *literals, size_t litLen, size_t distance, size_t matchLen)
+{
+    size_t extra = matchLen - MIN_MATCH;
+    out += (char)(((litLen < 15 ? litLen : 15) << 4) | (matchLen == 0 ? 0 : (extra < 15 ? extra : 15)));
+    if (litLen >= 15) {
+        PutLength(out, litLen - 15);
+    }
+    out.append((const char *)literals, litLen);
+    if (matchLen == 0) {
+        return;
+    }
+    out += (char)(distance & 0xff);
+    out += (char)(distance >> 8);
+    if (extra >= 15) {
+        PutLength(out, extra - 15);
+    }
+}
+
+// 压缩 buf 中 [start, end), 匹配可以回溯到 start 之前不超过 maxDistance 的位置 (历史窗口)
+// 在字面量较长时加大步长, 不可压缩的数据很快扫过
+static bool EncodeRange(const uint8_t *buf, size_t start, size_t end, uint32_t *table, int hashBits,
+                        size_t maxDistance, std::string &out)
+{
+    size_t len = end - start;
+    if (len < MIN_INPUT) {
+        return false;
+    }
+    size_t outStart = out.size();
+    AppendVarint(out, len);
+    size_t ip = start;
+    size_t anchor = start;
+    bool probed = false;
+    while (ip + MIN_MATCH <= end) {
+        if (!probed && ip - start >= PROBE_BYTES) {
+            probed = true;
+            size_t produced = out.size() - outStart + (ip - anchor);
+            if (produced > (ip - start) - (ip - start) / 16) {
+                out.resize(outStart);
+                return false;
+            }
+        }
+        uint32_t sequence = Read32(buf + ip);
+        uint32_t &slot = table[Hash(sequence, hashBits)];
+        size_t candidate = slot;
+        slot = (uint32_t)(ip + 1);
+        // 表项可能来自被撤回的消息, 只信任确实在当前位置之前且内容相同的
+        if (candidate != 0 && candidate - 1 < ip && ip - (candidate - 1) <= maxDistance &&
+            Read32(buf + candidate - 1) == sequence) {
+            size_t match = candidate - 1;
+            size_t matchLen = MIN_MATCH;
+            while (ip + matchLen < end && buf[match + matchLen] == buf[ip + matchLen]) {
+                ++matchLen;
+            }
+            PutSequence(out, buf + anchor, ip - anchor, ip - match, matchLen);
+            ip += matchLen;
+            anchor = ip;
+            continue;
+        }
+        ip += 1 + ((ip - anchor) >> 5);
+    }
+    PutSequence(out, buf + anchor, end - anchor, 0, 0);
+    size_t produced = out.size() - outStart;
+    if (produced + 4 > len || produced > len - len / 16) {
+        out.resize(outStart);
+        return false;
+    }
+    return true;
+}
+
+static bool GetLength(const uint8_t *src, size_t &ip, size_t srcLen, size_t &len)
+{
+    uint8_t byte;
+    do {
+        if (ip >= srcLen) {
+            return false;
+        }
+        byte = src[ip++];
+        len += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// 把 src 解到 dst 的 [start, start + rawLen), 匹配可以引用 start 之前的历史
+static bool DecodeRange(const uint8_t *src, size_t srcLen, char *dst, size_t start, size_t rawLen)
+{
+    size_t ip = 0;
+    size_t op = start;
+    size_t end = start + rawLen;
+    while (ip < srcLen) {
+        uint8_t token = src[ip++];
+        size_t litLen = token >> 4;
+        if (litLen == 15 && !GetLength(src, ip, srcLen, litLen)) {
+            return false;
+        }
+        if (litLen > srcLen - ip || litLen > end - op) {
+            return false;
+        }
+        memcpy(dst + op, src + ip, litLen);
+        ip += litLen;
+        op += litLen;
+        if (ip == srcLen) {
+            break; // 最后一个序列
+        }
+        if (srcLen - ip < 2) {
+            return false;
+        }
+        size_t distance = src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        size_t matchLen = (token & 15);
+        if (matchLen == 15 && !GetLength(src, ip, srcLen, matchLen)) {
+            return false;
+        }
+        matchLen += MIN_MATCH;
+        if (distance == 0 || distance > op || matchLen > end - op) {
+            return false;
+        }
+        const char *from = dst + op - distance;
+        if (distance >= matchLen) {
+            memcpy(dst + op, from, matchLen);
+        } else {
+            for (size_t i = 0; i < matchLen; ++i) {
+                dst[op + i] = from[i]; // 与输出重叠: 逐字节复制, 重复前面的短串
+            }
+        }
+        op += matchLen;
+    }
+    return op == end;
+}
+
+static bool ReadRawLen(const char *src, size_t len, size_t maxLen, size_t &rawLen, size_t &headLen)
+{
+    uint64_t value;
+    int n = GetVarint(src, len, value);
+    if (n <= 0 || value > maxLen) {
+        return false;
+    }
+    rawLen = (size_t)value;
+    headLen = (size_t)n;
+    return true;
+}
+
+bool LooksCompressed(const void *data, size_t len)
+{
+    static const struct {
+        size_t offset;
+        const char *magic;
+        size_t len;
+    } SIGNATURES[] = {
+        {0, "\xFF\xD8\xFF", 3},             // JPEG
+        {0, "\x89PNG", 4},
+        {0, "GIF8", 4},
+        {0, "PK\x03\x04", 4},               // ZIP, 以及 docx/xlsx/pptx/jar/apk
+        {0, "\x1F\x8B", 2},                 // gzip
+        {0, "BZh", 3},
+        {0, "\xFD" "7zXZ", 5},
+        {0, "7z\xBC\xAF\x27\x1C", 6},
+        {0, "Rar!", 4},
+        {0, "\x28\xB5\x2F\xFD", 4},         // zstd
+        {0, "ID3", 3},                      // MP3
+        {0, "OggS", 4},
+        {0, "\x1A\x45\xDF\xA3", 4},         // Matroska/WebM
+        {4, "ftyp", 4},                     // MP4/MOV/HEIC
+        {8, "WEBP", 4},
+    };
+    const char *bytes = static_cast<const char *>(data);
+    for (const auto &sig : SIGNATURES) {
+        if (len >= sig.offset + sig.len && memcmp(bytes + sig.offset, sig.magic, sig.len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LzCompressBlock(const char *data, size_t len, std::string &out)
+{
+    static thread_local std::vector<uint32_t> table(1u << BLOCK_HASH_BITS);
+    std::fill(table.begin(), table.end(), 0);
+    return EncodeRange((const uint8_t *)data, 0, len, table.data(), BLOCK_HASH_BITS, MAX_DISTANCE, out);
+}
+
+bool LzDecompressBlock(const char *data, size_t len, size_t maxLen, std::string &out)
+{
+    size_t rawLen;
+    size_t headLen;
+    if (!ReadRawLen(data, len, maxLen, rawLen, headLen)) {
+        return false;
+    }
+    out.resize(rawLen);
+    return DecodeRange((const uint8_t *)data + headLen, len - headLen, &out[0], 0, rawLen);
+}
+
+LzEncoder::LzEncoder() : table(1u << STREAM_HASH_BITS)
+{
+}
+
+// 历史超过两个窗口时只留最后一个窗口, 表项随之平移, 移出窗口的清空
+bool LzEncoder::Compress(const char *data, size_t len, std::string &out)
+{
+    size_t start = history.size();
+    history.insert(history.end(), (const uint8_t *)data, (const uint8_t *)data + len);
+    if (!EncodeRange(history.data(), start, start + len, table.data(), STREAM_HASH_BITS, LZ_WINDOW, out)) {
+        history.resize(start);
+        return false;
+    }
+    if (history.size() > 2 * LZ_WINDOW) {
+        size_t shift = history.size() - LZ_WINDOW;
+        memmove(history.data(), history.data() + shift, LZ_WINDOW);
+        history.resize(LZ_WINDOW);
+        if (history.capacity() > 4 * LZ_WINDOW) {
+            history.shrink_to_fit(); // 偶尔的大消息不让缓冲区一直占着
+        }
+        for (uint32_t &slot : table) {
+            slot = slot > shift ? (uint32_t)(slot - shift) : 0;
+        }
+    }
+    return true;
+}
+
+bool LzDecoder::Decompress(const char *src, size_t len, size_t maxLen, const char *&data, size_t &rawLen)
+{
+    size_t headLen;
+    if (!ReadRawLen(src, len, maxLen, rawLen, headLen)) {
+        return false;
+    }
+    if (history.size() > 2 * LZ_WINDOW) {
+        size_t shift = history.size() - LZ_WINDOW;
+        memmove(history.data(), history.data() + shift, LZ_WINDOW);
+        history.resize(LZ_WINDOW);
+        if (history.capacity() > 4 * LZ_WINDOW) {
+            history.shrink_to_fit();
+        }
+    }
+    size_t start = history.size();
+    history.resize(start + rawLen);
+    if (!DecodeRange((const uint8_t *)src + headLen, len - headLen, history.data(), start, rawLen)) {
+        history.resize(start);
+        return false;
+    }
+    data = history.data() + start;
+    return true;
+}
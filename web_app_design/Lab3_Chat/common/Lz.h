@@ -0,0 +1,53 @@
+/*
+ * Description: LZ77 压缩 (格式与 LZ4 的块格式相近): 连接上的流式压缩在消息之间共享历史窗口,
+ *              文件块按单块压缩, 不依赖之前的数据, 服务端可以原样转发
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#ifndef LZ_H
+#define LZ_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 流式压缩的历史窗口: 每条消息可以引用同一方向上此前这么多字节内的内容
+const size_t LZ_WINDOW = 32 * 1024;
+
+// 压缩结果为 varint 原长 + 若干序列, 每个序列为:
+// 标记字节 (高 4 位字面量长度, 低 4 位匹配长度 - 4, 15 表示后面还有 255 累加的扩展字节),
+// 字面量, 2 字节小端的回溯距离, 匹配长度的扩展字节; 最后一个序列只有字面量
+
+// 开头是否为常见的已压缩格式 (JPEG、PNG、ZIP/docx、gzip 等), 这类数据不值得再压
+bool LooksCompressed(const void *data, size_t len);
+
+// 单块压缩, 结果追加到 out; 压不小 (或前几 KB 就看出压不动) 时返回 false, out 不变
+bool LzCompressBlock(const char *data, size_t len, std::string &out);
+// 单块解压到 out; 数据损坏或原长超过 maxLen 时返回 false
+bool LzDecompressBlock(const char *data, size_t len, size_t maxLen, std::string &out);
+
+// 一个方向上的流式压缩: 只有压缩后发出的消息进入历史, 与对端的 LzDecoder 保持一致
+class LzEncoder {
+public:
+    LzEncoder();
+
+    // 压缩结果追加到 out; 返回 false 时这条消息应原样发送, 历史不变
+    bool Compress(const char *data, size_t len, std::string &out);
+
+private:
+    std::vector<uint8_t> history; // 窗口内的历史, 之后是正在压缩的消息
+    std::vector<uint32_t> table;  // 4 字节序列的哈希 -> history 下标 + 1, 0 为空
+};
+
+class LzDecoder {
+public:
+    // 解压一条消息, data/rawLen 指向内部缓冲区, 下一次调用前有效
+    bool Decompress(const char *src, size_t len, size_t maxLen, const char *&data, size_t &rawLen);
+
+private:
+    std::vector<char> history;
+};
+
+#endif
@@ -7,29 +7,442 @@
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 
 // 默认端口和缓冲区配置
 const int DEFAULT_PORT = 8888;
-const int FILE_CHUNK_SIZE = 4096;
+const int FILE_CHUNK_SIZE = 4096;               // 未协商时 (旧客户端) 的文件块大小
+const int MAX_FILE_CHUNK_SIZE = 1024 * 1024;    // 登录时可协商的文件块大小上限
+const int TRANSFER_ID_LEN = 4;   // 文件块包体开头的传输 ID (uint32, 本机字节序)
+const int FILE_SIGS_PER_MSG = 480;           // 每条 MSG_FILE_SIGS 最多带的块签名数, 保持在服务端单包上限内
+const int FILE_DELTA_MAX_BLOCK = 64 * 1024;  // 增量传输的块大小上限
+const int PROTOCOL_V1 = 1;  // 固定 12 字节包头, 路由信息为 '|' 分隔的文本
+const int PROTOCOL_V2 = 2;  // varint 包头, 用户以数字 ID 表示, 包体为二进制字段 (见文件末尾)
 
 // 消息类型枚举
 enum MsgType {
-    MSG_LOGIN = 1,       // 登录
+    MSG_LOGIN = 1,       // 登录 (Name|MaxChunk|Version|Features, 不带 |MaxChunk 时按 FILE_CHUNK_SIZE, 不带 |Version 为 v1,
+                         // Features 为支持的 FEATURE_* 位掩码, 只在 v2 下有效);
+                         // 带了 MaxChunk 的登录成功后服务端回同类型消息, 包体为协商后的文件块上限,
+                         // 同意使用 v2 时为 MaxChunk|2|UserId, 此后服务端发出的消息都是 v2 格式; 同意了某些功能时再加 |Features
     MSG_CHAT_TEXT,       // 文本消息 (群聊/系统)
     MSG_CHAT_PRIVATE,    // 私聊消息
-    MSG_FILE_INFO,       // 文件头 (格式: Target|Name|Size)
-    MSG_FILE_DATA,       // 文件内容
-    MSG_FILE_END,        // 文件结束
+    MSG_FILE_INFO,       // 文件头 (发往服务端: Target|TransferId|Name|Size, 群发时再加 |Sha256; 转给接收方: TransferId|Name|Size|SenderName,
+                         // 由服务端仓库发出时再加 |1, 接收方不做增量传输)
+    MSG_FILE_DATA,       // 文件内容 (FileChunkHeader + 数据)
+    MSG_FILE_END,        // 文件结束 (TransferId + 整个文件的 CRC32C); 发送方掉线时服务端代发, 只有 TransferId
     MSG_LOGOUT,          // 退出
-    MSG_USER_LIST        // 用户列表
+    MSG_USER_LIST,       // 用户列表 (旧版全量, 服务端已不再发送)
+    MSG_USER_JOINED,     // 用户上线增量 (格式: Version|Name1,Name2...)
+    MSG_USER_LEFT,       // 用户下线增量 (格式同上)
+    MSG_USER_SNAPSHOT,   // 用户列表全量快照 (格式: Version|Name1,Name2...)
+    MSG_USER_LIST_REQ,   // 客户端发现版本不连续时请求快照 (无包体)
+    MSG_FILE_RESUME,     // 接收方应答文件头或请求重传 (发往服务端: SenderName|TransferId|Offset; 转给发送方: TransferId|Offset),
+                         // 末尾加 |1 表示已校验完成; 群发时由服务端仓库应答
+    MSG_FILE_SIGS,       // 接收方已有同名旧版本时, 在续传应答之前发出它的分块签名
+                         // (发往服务端: SenderName|TransferId|BlockSize|FirstIndex| + BlockSignature 数组; 转给发送方时去掉名字)
+    MSG_FILE_COPY,       // 一对一传输中代替文件块: 让接收方从旧版本复制一块 (FileCopyHeader)
+    MSG_PROTOCOL,        // 客户端收到同意 v2 的登录应答后以 v1 格式发出 (包体为版本号), 此后客户端发出的消息都是 v2 格式
+    MSG_FILE_PACKED,     // 协商了压缩时代替 MSG_FILE_DATA: FileChunkHeader + 块数据的 LzCompressBlock 结果 (crc 按原数据),
+                         // 每块单独压缩, 服务端不解压即可转发; 对方不支持压缩时服务端解开后按 MSG_FILE_DATA 发出
+    MSG_BUNDLE           // 协商了 FEATURE_BATCH 时服务端把发往同一客户端的多条小消息合成一帧: 包体为依次相连的完整 v2 帧
+                         // (不嵌套, 也不带 COMPRESSED_FLAG; 整个批次可以再压缩); 群聊广播的批次由同一服务端线程上的
+                         // 客户端共享, 其中可能有自己发出的群聊, 接收方跳过 senderId 为自己的 MSG_CHAT_TEXT 子帧
 };
 
+const int MSG_TYPE_END = MSG_BUNDLE + 1; // 消息类型的取值范围 [0, MSG_TYPE_END), 分发表按此大小生成
+
+// 登录时协商的可选功能
+const int FEATURE_COMPRESS = 1; // 压缩 (见 COMPRESSED_FLAG 与 MSG_FILE_PACKED)
+const int FEATURE_BATCH = 2;    // 服务端发出 MSG_BUNDLE
+
 // 固定包头 (12字节)
+// 服务端转发的文件消息中 senderId 为发送方会话号, 接收方用 (senderId, TransferId) 区分各路传输
 struct MsgHeader {
     int32_t type;
     int32_t bodyLen;
     int32_t senderId;
 };
 
-#endif
\ No newline at end of file
+// MSG_FILE_DATA 包体开头: 接收方只接受 offset 恰为已写入字节数且校验通过的块,
+// 其余丢弃, 必要时用 MSG_FILE_RESUME 让发送方从该偏移重发
+struct FileChunkHeader {
+    uint32_t transferId; // 必须在最前, 服务端只按它转发
+    uint32_t crc;        // 本块数据的 CRC32C
+    int64_t offset;      // 本块在文件中的偏移
+};
+
+// MSG_FILE_SIGS 中旧版本一块 (长度为 BlockSize, 末尾不足一块的部分不签名) 的签名
+struct BlockSignature {
+    uint32_t weak;       // RollingChecksum, 发送方逐字节滑动比较
+    uint8_t strong[16];  // MD5, 弱校验相同时再确认
+};
+
+// MSG_FILE_COPY 包体: 与 MSG_FILE_DATA 一样按 offset 顺序接受, 数据取自旧版本第 blockIndex 块
+struct FileCopyHeader {
+    uint32_t transferId; // 必须在最前, 服务端只按它转发
+    uint32_t crc;        // 该块数据的 CRC32C, 接收方复制后核对 (旧版本在此期间被改动时请求重传)
+    int64_t offset;      // 写到新文件中的偏移
+    uint32_t blockIndex;
+    uint32_t reserved;
+};
+
+// ---- v2 格式 ----
+// 包头: type、bodyLen、senderId 依次为 varint (每字节低 7 位, 高位为 1 表示后面还有字节), 短消息只占 3 字节;
+// senderId 为 0 表示没有发送方 (系统消息), 否则为发送方的用户 ID (即服务端的会话号, 登录应答中告知本人)
+// 包体中 '|' 分隔的文本换成依次排列的字段: 整数为 varint, 字符串为 varint 长度 + 字节
+//   MSG_CHAT_TEXT     正文; 服务端发出时按 senderId 显示发送方, senderId 为 0 的正文已含前缀
+//   MSG_CHAT_PRIVATE  发往服务端: TargetId, 正文; 转给接收方: 正文 (senderId 为发送方), 不再回显给发送方
+//   MSG_USER_SNAPSHOT / MSG_USER_JOINED / MSG_USER_LEFT  Version, 之后每个用户为 UserId, Name
+//   MSG_FILE_INFO     发往服务端: TargetId (0 为群发), TransferId, Size, Name, 群发时再加 32 字节 SHA-256;
+//                     转给接收方: TransferId, Size, Flags (1 为仓库发出), Name
+//   MSG_FILE_RESUME   发往服务端: SenderId, TransferId, Offset, Done; 转给发送方: TransferId, Offset, Done
+//   MSG_FILE_SIGS     发往服务端: SenderId, TransferId, BlockSize, FirstIndex, BlockSignature 数组; 转给发送方时去掉 SenderId
+// 文件块、复制指令与结束标记的包体与 v1 相同
+// 协商了压缩后, type 带 COMPRESSED_FLAG 的消息包体为原包体经 LzEncoder 压缩的结果 (每个方向一个流, 共享历史窗口);
+// 文件块不走流式压缩, 见 MSG_FILE_PACKED
+
+const int COMPRESSED_FLAG = 0x40;
+
+const size_t V2_HEADER_MAX = 15; // 三个 32 位 varint
+const size_t SHA256_LEN = 32;
+
+// 返回写入的字节数 (64 位整数最多 10 字节)
+inline size_t PutVarint(uint64_t value, char *out)
+{
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (char)value;
+    return n;
+}
+
+// 返回读取的字节数; 0 表示数据还不完整, -1 表示格式错误 (超过 10 字节)
+inline int GetVarint(const char *data, size_t len, uint64_t &value)
+{
+    value = 0;
+    for (size_t i = 0; i < len && i < 10; ++i) {
+        uint8_t byte = (uint8_t)data[i];
+        value |= (uint64_t)(byte & 0x7f) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            return (int)(i + 1);
+        }
+    }
+    return len >= 10 ? -1 : 0;
+}
+
+inline size_t EncodeHeaderV2(const MsgHeader &header, char *out)
+{
+    size_t n = PutVarint((uint32_t)header.type, out);
+    n += PutVarint((uint32_t)header.bodyLen, out + n);
+    n += PutVarint(header.senderId > 0 ? (uint32_t)header.senderId : 0, out + n);
+    return n;
+}
+
+// 返回包头长度; 0 表示还不完整, -1 表示格式错误
+inline int DecodeHeaderV2(const char *data, size_t len, MsgHeader &header)
+{
+    uint64_t fields[3];
+    size_t pos = 0;
+    for (uint64_t &field : fields) {
+        int n = GetVarint(data + pos, len - pos, field);
+        if (n <= 0) {
+            return n;
+        }
+        if (field > INT32_MAX) {
+            return -1;
+        }
+        pos += n;
+    }
+    header.type = (int32_t)fields[0];
+    header.bodyLen = (int32_t)fields[1];
+    header.senderId = (int32_t)fields[2];
+    return (int)pos;
+}
+
+// 逐个读取 v2 包体中的字段, 任何一个读取失败后都返回 false
+class WireReader {
+public:
+    WireReader(const char *data, size_t len) : pos(data), end(data + len)
+    {
+    }
+
+    bool Varint(uint64_t &value)
+    {
+        int n = GetVarint(pos, end - pos, value);
+        if (n <= 0) {
+            return false;
+        }
+        pos += n;
+        return true;
+    }
+    bool Bytes(const char *&data, size_t &len)
+    {
+        uint64_t n;
+        if (!Varint(n) || n > (uint64_t)(end - pos)) {
+            return false;
+        }
+        data = pos;
+        len = (size_t)n;
+        pos += n;
+        return true;
+    }
+    bool Raw(size_t len, const char *&data)
+    {
+        if (len > (size_t)(end - pos)) {
+            return false;
+        }
+        data = pos;
+        pos += len;
+        return true;
+    }
+    const char *Rest() const
+    {
+        return pos;
+    }
+    size_t Left() const
+    {
+        return end - pos;
+    }
+
+private:
+    const char *pos;
+    const char *end;
+};
+
+inline void AppendVarint(std::string &out, uint64_t value)
+{
+    char buf[10];
+    out.append(buf, PutVarint(value, buf));
+}
+
+inline void AppendBytes(std::string &out, const char *data, size_t len)
+{
+    AppendVarint(out, len);
+    out.append(data, len);
+}
+
+// ---- v2 包体的字段表 ----
+// 每种包体是一个结构体, 由 Fields() 按线上顺序列出成员; 编码与解码按成员类型在编译期展开:
+// 整数为 varint, std::string_view 为 varint 长度 + 字节, WireTail 为包体剩下的全部字节 (只能是最后一个字段)
+// 解码出的 string_view 与 WireTail 指向原包体, 包体释放前有效
+
+struct WireTail {
+    std::string_view data;
+};
+
+template <typename Int, typename = std::enable_if_t<std::is_integral_v<Int>>>
+inline bool ReadField(WireReader &in, Int &value)
+{
+    uint64_t raw;
+    if (!in.Varint(raw)) {
+        return false;
+    }
+    value = (Int)raw;
+    return true;
+}
+
+inline bool ReadField(WireReader &in, std::string_view &value)
+{
+    const char *data;
+    size_t len;
+    if (!in.Bytes(data, len)) {
+        return false;
+    }
+    value = std::string_view(data, len);
+    return true;
+}
+
+inline bool ReadField(WireReader &in, WireTail &value)
+{
+    const char *data;
+    size_t len = in.Left();
+    in.Raw(len, data);
+    value.data = std::string_view(data, len);
+    return true;
+}
+
+template <typename Int, typename = std::enable_if_t<std::is_integral_v<Int>>>
+inline void WriteField(std::string &out, Int value)
+{
+    AppendVarint(out, (uint64_t)value);
+}
+
+inline void WriteField(std::string &out, std::string_view value)
+{
+    AppendBytes(out, value.data(), value.size());
+}
+
+inline void WriteField(std::string &out, const WireTail &value)
+{
+    out.append(value.data.data(), value.data.size());
+}
+
+// 从 in 的当前位置依次读出 Body 的各字段 (用户列表这类重复的条目逐条读)
+template <typename Body>
+bool ReadBody(WireReader &in, Body &body)
+{
+    return std::apply([&](auto... members) { return (ReadField(in, body.*members) && ...); }, Body::Fields());
+}
+
+template <typename Body>
+bool DecodeBody(const char *data, size_t len, Body &body)
+{
+    WireReader in(data, len);
+    return ReadBody(in, body);
+}
+
+// 编码结果追加到 out
+template <typename Body>
+void EncodeBody(const Body &body, std::string &out)
+{
+    std::apply([&](auto... members) { (WriteField(out, body.*members), ...); }, Body::Fields());
+}
+
+// 私聊, 发往服务端 (转给接收方时只有正文)
+struct PrivateChatToServer {
+    uint64_t targetId = 0;
+    WireTail text;
+    static constexpr auto Fields()
+    {
+        return std::make_tuple(&PrivateChatToServer::targetId, &PrivateChatToServer::text);
+    }
+};
+
+// 用户列表中的一个用户, 跟在 varint 的 Version 之后重复
+struct UserEntryWire {
+    uint64_t userId = 0;
+    std::string_view name;
+    static constexpr auto Fields()
+    {
+        return std::make_tuple(&UserEntryWire::userId, &UserEntryWire::name);
+    }
+};
+
+// 文件头, 发往服务端; targetId 为 0 (群发) 时 digest 为 SHA256_LEN 字节的摘要
+struct FileInfoToServer {
+    uint64_t targetId = 0;
+    uint64_t transferId = 0;
+    uint64_t size = 0;
+    std::string_view name;
+    WireTail digest;
+    static constexpr auto Fields()
+    {
+        return std::make_tuple(&FileInfoToServer::targetId, &FileInfoToServer::transferId, &FileInfoToServer::size,
+                               &FileInfoToServer::name, &FileInfoToServer::digest);
+    }
+};
+
+// 文件头, 转给接收方; flags 为 1 表示仓库发出
+struct FileInfoToClient {
+    uint64_t transferId = 0;
+    uint64_t size = 0;
+    uint64_t flags = 0;
+    std::string_view name;
+    static constexpr auto Fields()
+    {
+        return std::make_tuple(&FileInfoToClient::transferId, &FileInfoToClient::size, &FileInfoToClient::flags,
+                               &FileInfoToClient::name);
+    }
+};
+
+struct ResumeToServer {
+    uint64_t senderId = 0;
+    uint64_t transferId = 0;
+    uint64_t offset = 0;
+    uint64_t done = 0;
+    static constexpr auto Fields()
+    {
+        return std::make_tuple(&ResumeToServer::senderId, &ResumeToServer::transferId, &ResumeToServer::offset,
+                               &ResumeToServer::done);
+    }
+};
+
+struct ResumeToClient {
+    uint64_t transferId = 0;
+    uint64_t offset = 0;
+    uint64_t done = 0;
+    static constexpr auto Fields()
+    {
+        return std::make_tuple(&ResumeToClient::transferId, &ResumeToClient::offset, &ResumeToClient::done);
+    }
+};
+
+// sigs 为 BlockSignature 数组
+struct SigsToServer {
+    uint64_t senderId = 0;
+    uint64_t transferId = 0;
+    uint64_t blockSize = 0;
+    uint64_t firstIndex = 0;
+    WireTail sigs;
+    static constexpr auto Fields()
+    {
+        return std::make_tuple(&SigsToServer::senderId, &SigsToServer::transferId, &SigsToServer::blockSize,
+                               &SigsToServer::firstIndex, &SigsToServer::sigs);
+    }
+};
+
+struct SigsToClient {
+    uint64_t transferId = 0;
+    uint64_t blockSize = 0;
+    uint64_t firstIndex = 0;
+    WireTail sigs;
+    static constexpr auto Fields()
+    {
+        return std::make_tuple(&SigsToClient::transferId, &SigsToClient::blockSize, &SigsToClient::firstIndex,
+                               &SigsToClient::sigs);
+    }
+};
+
+// ---- 按消息类型分发 ----
+// 分发表在编译期生成: 每个 On<类型, 处理函数> 占表中一项, 查表后直接调用, 不再逐个比较类型;
+// 处理函数的类型都是 Fn (普通函数指针或成员函数指针, 后者调用时第一个参数为对象指针)
+
+template <int Type, auto Handler>
+struct On {
+    static_assert(Type > 0 && Type < MSG_TYPE_END, "message type out of range");
+    static constexpr int TYPE = Type;
+    static constexpr auto HANDLER = Handler;
+};
+
+template <typename Fn, typename... Entries>
+constexpr std::array<Fn, MSG_TYPE_END> MakeDispatchArray()
+{
+    std::array<Fn, MSG_TYPE_END> table = {};
+    ((table[Entries::TYPE] = Entries::HANDLER), ...);
+    return table;
+}
+
+template <typename Fn, typename... Entries>
+class DispatchTable {
+public:
+    static constexpr bool Handles(int type)
+    {
+        return type >= 0 && type < MSG_TYPE_END && TABLE[type] != nullptr;
+    }
+
+    // 没有登记的类型返回 false
+    template <typename... Args>
+    static bool Dispatch(int type, Args &&...args)
+    {
+        if (!Handles(type)) {
+            return false;
+        }
+        std::invoke(TABLE[type], std::forward<Args>(args)...);
+        return true;
+    }
+
+private:
+    static constexpr std::array<Fn, MSG_TYPE_END> TABLE = MakeDispatchArray<Fn, Entries...>();
+};
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Description: rsync 的弱校验, 窗口向后滑动一个字节只需常数时间更新
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#ifndef ROLLING_CHECKSUM_H
+#define ROLLING_CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+// a 为窗口内字节之和, b 为按距窗口末尾的距离加权之和, 各取低 16 位
+class RollingChecksum {
+public:
+    void Reset(const void *data, size_t len)
+    {
+        const uint8_t *bytes = (const uint8_t *)data;
+        a = 0;
+        b = 0;
+        window = (uint32_t)len;
+        for (size_t i = 0; i < len; ++i) {
+            a += bytes[i];
+            b += (uint32_t)(len - i) * bytes[i];
+        }
+    }
+
+    // 移出窗口首字节 out, 移入窗口之后的字节 in
+    void Roll(uint8_t out, uint8_t in)
+    {
+        a += in - out;
+        b += a - window * out;
+    }
+
+    uint32_t Value() const
+    {
+        return (a & 0xFFFF) | (b << 16);
+    }
+
+    static uint32_t Of(const void *data, size_t len)
+    {
+        RollingChecksum sum;
+        sum.Reset(data, len);
+        return sum.Value();
+    }
+
+private:
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t window = 0;
+};
+
+#endif
@@ -0,0 +1,234 @@
+/*
+ * Description: 缓冲区池实现
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#include "BufferPool.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+// 每块前面的 16 字节: 所属级别, 分配它的线程, 空闲时兼作链表指针
+struct PoolBlock {
+    uint32_t sizeClass;
+    uint32_t owner;
+    PoolBlock *next;
+};
+static_assert(sizeof(PoolBlock) == 16, "PoolBlock must keep payload 16-byte aligned");
+
+// 4KB 以上的级别多留 64 字节, 2 的幂大小的文件块加上包头和块头正好放得下
+const size_t CLASS_SIZES[] = {
+    64, 128, 256, 512, 1024, 2048,
+    4096 + 64, 8192 + 64, 16384 + 64, 32768 + 64, 65536 + 64, 262144 + 64, 1048576 + 64
+};
+const uint32_t CLASS_COUNT = sizeof(CLASS_SIZES) / sizeof(CLASS_SIZES[0]);
+const uint32_t LARGE_CLASS = CLASS_COUNT;  // 直接 malloc / free
+const size_t SLAB_BYTES = 256 * 1024;      // 不超过 SLAB_MAX_SIZE 的块成批从 slab 切出, slab 不归还系统
+const size_t SLAB_MAX_SIZE = 32768 + 64;
+const size_t CACHE_BYTES = 256 * 1024;     // 每个线程每级缓存的字节上限 (至少 2 块)
+const size_t GLOBAL_RETAIN_BYTES = 4 * 1024 * 1024; // 单独 malloc 的级别在全局链表中最多留存的字节
+
+// 全局空闲链表: 入链用 CAS 把一串块接在表头, 取用时用 exchange 整条摘走,
+// 没有单块出链, 因此不存在 ABA 问题
+struct GlobalList {
+    std::atomic<PoolBlock *> head{nullptr};
+    std::atomic<uint32_t> count{0}; // 近似值, 只用于限制大块的留存
+};
+
+static GlobalList g_lists[CLASS_COUNT];
+
+static void PushGlobal(uint32_t cls, PoolBlock *first, PoolBlock *last, uint32_t n)
+{
+    GlobalList &list = g_lists[cls];
+    list.count.fetch_add(n, std::memory_order_relaxed);
+    PoolBlock *old = list.head.load(std::memory_order_relaxed);
+    do {
+        last->next = old;
+    } while (!list.head.compare_exchange_weak(old, first, std::memory_order_release, std::memory_order_relaxed));
+}
+
+// 交回全局链表 (单独 malloc 的级别超出留存上限时直接释放)
+static void ReturnGlobal(uint32_t cls, PoolBlock *first, PoolBlock *last, uint32_t n)
+{
+    if (CLASS_SIZES[cls] > SLAB_MAX_SIZE &&
+        g_lists[cls].count.load(std::memory_order_relaxed) * CLASS_SIZES[cls] >= GLOBAL_RETAIN_BYTES) {
+        while (n-- > 0) {
+            PoolBlock *next = first->next;
+            std::free(first);
+            first = next;
+        }
+        return;
+    }
+    PushGlobal(cls, first, last, n);
+}
+
+static std::atomic<uint32_t> g_nextOwner{1};
+
+// 线程退出时 ThreadCache 先于其他线程局部/静态对象析构, 之后的释放直接进全局链表
+static thread_local bool t_cacheGone = false;
+
+struct ThreadCache {
+    PoolBlock *heads[CLASS_COUNT] = {};
+    uint32_t counts[CLASS_COUNT] = {};
+    uint32_t owner = g_nextOwner.fetch_add(1, std::memory_order_relaxed);
+
+    // 线程退出时把缓存交回全局
+    ~ThreadCache()
+    {
+        t_cacheGone = true;
+        for (uint32_t cls = 0; cls < CLASS_COUNT; ++cls) {
+            Spill(cls, counts[cls]);
+        }
+    }
+
+    // 把表头的 n 块交回全局链表
+    void Spill(uint32_t cls, uint32_t n)
+    {
+        if (n == 0) {
+            return;
+        }
+        PoolBlock *first = heads[cls];
+        PoolBlock *last = first;
+        for (uint32_t i = 1; i < n; ++i) {
+            last = last->next;
+        }
+        heads[cls] = last->next;
+        counts[cls] -= n;
+        ReturnGlobal(cls, first, last, n);
+    }
+
+    void Refill(uint32_t cls);
+};
+
+static thread_local ThreadCache t_cache;
+
+static uint32_t CacheLimit(uint32_t cls)
+{
+    size_t limit = CACHE_BYTES / CLASS_SIZES[cls];
+    return (uint32_t)(limit < 2 ? 2 : limit);
+}
+
+static uint32_t ClassOf(size_t bytes)
+{
+    uint32_t cls = 0;
+    while (cls < CLASS_COUNT && CLASS_SIZES[cls] < bytes) {
+        ++cls;
+    }
+    return cls;
+}
+
+static PoolBlock *NewBlocks(size_t size, size_t count)
+{
+    size_t stride = sizeof(PoolBlock) + size;
+    char *mem = static_cast<char *>(std::malloc(stride * count));
+    if (mem == nullptr) {
+        throw std::bad_alloc();
+    }
+    for (size_t i = 0; i < count; ++i) {
+        PoolBlock *block = reinterpret_cast<PoolBlock *>(mem + i * stride);
+        block->next = (i + 1 < count) ? reinterpret_cast<PoolBlock *>(mem + (i + 1) * stride) : nullptr;
+    }
+    return reinterpret_cast<PoolBlock *>(mem);
+}
+
+void PoolReserve(size_t slabs)
+{
+    for (uint32_t cls = 0; cls < CLASS_COUNT && CLASS_SIZES[cls] <= SLAB_MAX_SIZE; ++cls) {
+        uint32_t n = (uint32_t)(SLAB_BYTES / (sizeof(PoolBlock) + CLASS_SIZES[cls]));
+        for (size_t i = 0; i < slabs; ++i) {
+            PoolBlock *first = NewBlocks(CLASS_SIZES[cls], n);
+            PoolBlock *last = first;
+            while (last->next != nullptr) {
+                last = last->next;
+            }
+            PushGlobal(cls, first, last, n);
+        }
+    }
+}
+
+// 本线程缓存用完: 先整条取走全局链表, 超出缓存上限的部分再交回; 全局也空时切一个新 slab
+void ThreadCache::Refill(uint32_t cls)
+{
+    GlobalList &list = g_lists[cls];
+    PoolBlock *taken = list.head.exchange(nullptr, std::memory_order_acquire);
+    uint32_t n = 0;
+    if (taken != nullptr) {
+        PoolBlock *last = taken;
+        for (n = 1; last->next != nullptr; ++n) {
+            last = last->next;
+        }
+        list.count.fetch_sub(n, std::memory_order_relaxed); // 入链前已先加, 不会减成负数
+        last->next = heads[cls];
+    } else {
+        size_t size = CLASS_SIZES[cls];
+        n = (size <= SLAB_MAX_SIZE) ? (uint32_t)(SLAB_BYTES / (sizeof(PoolBlock) + size)) : 1;
+        taken = NewBlocks(size, n);
+        PoolBlock *last = taken;
+        while (last->next != nullptr) {
+            last = last->next;
+        }
+        last->next = heads[cls];
+    }
+    heads[cls] = taken;
+    counts[cls] += n;
+    uint32_t limit = CacheLimit(cls);
+    if (counts[cls] > limit) {
+        Spill(cls, counts[cls] - limit);
+    }
+}
+
+void *PoolAlloc(size_t bytes)
+{
+    uint32_t cls = ClassOf(bytes);
+    PoolBlock *block;
+    if (cls == LARGE_CLASS || t_cacheGone) {
+        cls = LARGE_CLASS;
+        block = static_cast<PoolBlock *>(std::malloc(sizeof(PoolBlock) + bytes));
+        if (block == nullptr) {
+            throw std::bad_alloc();
+        }
+    } else {
+        ThreadCache &cache = t_cache;
+        if (cache.heads[cls] == nullptr) {
+            cache.Refill(cls);
+        }
+        block = cache.heads[cls];
+        cache.heads[cls] = block->next;
+        --cache.counts[cls];
+        block->owner = cache.owner;
+    }
+    block->sizeClass = cls;
+    return block + 1;
+}
+
+// 别的线程分配的块直接交回全局: 跨分片的帧由接收方分片释放, 若留在它的缓存里,
+// 分配方分片补充时全局链表是空的, 只能再切新 slab, 稳定状态下也会不时 malloc;
+// 本线程分配的块进缓存, 超过上限时把一半交回全局
+void PoolFree(void *ptr)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+    PoolBlock *block = static_cast<PoolBlock *>(ptr) - 1;
+    uint32_t cls = block->sizeClass;
+    if (cls == LARGE_CLASS) {
+        std::free(block);
+        return;
+    }
+    if (t_cacheGone) {
+        PushGlobal(cls, block, block, 1);
+        return;
+    }
+    ThreadCache &cache = t_cache;
+    if (block->owner != cache.owner) {
+        ReturnGlobal(cls, block, block, 1);
+        return;
+    }
+    block->next = cache.heads[cls];
+    cache.heads[cls] = block;
+    uint32_t limit = CacheLimit(cls);
+    if (++cache.counts[cls] > limit) {
+        cache.Spill(cls, cache.counts[cls] - limit / 2);
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * Description: 按大小分级的缓冲区池: 每个线程各有一份缓存, 线程之间经无锁的全局空闲链表周转,
+ *              小块从 slab 中成批切出; 帧、邮箱节点、发送队列等稳定状态下的分配都走这里, 不经过 malloc
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstddef>
+#include <new>
+
+// 启动时调用: 每个从 slab 切块的级别预先切好 slabs 个 slab 放进全局链表,
+// 流量上来后队列深度创新高时先从这里取, 不必在稳定状态下再 malloc
+void PoolReserve(size_t slabs);
+// 返回的地址 16 字节对齐; 超过最大一级的请求直接交给 malloc
+void *PoolAlloc(size_t bytes);
+// 可在任意线程释放: 本线程分配的块进入本线程的缓存, 别的线程分配的块交回全局链表
+void PoolFree(void *ptr);
+
+// 供标准容器使用的分配器
+template <typename T>
+struct PoolAllocator {
+    using value_type = T;
+
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &)
+    {
+    }
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(PoolAlloc(n * sizeof(T)));
+    }
+    void deallocate(T *ptr, size_t)
+    {
+        PoolFree(ptr);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &)
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &)
+{
+    return false;
+}
+
+#endif
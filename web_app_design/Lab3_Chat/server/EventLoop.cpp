@@ -0,0 +1,178 @@
+/*
+ * Description: epoll 事件循环实现
+ * Author: 夏凡
+ * Create: 2025-12-09
+ */
+
+#include "EventLoop.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstdio>
+
+const int MAX_EVENTS = 256;
+
+bool SetNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) {
+        return false;
+    }
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+EventLoop::EventLoop() : epollFd(-1), wakeupFd(-1), wakeupPending(false), timerFd(-1)
+{
+}
+
+EventLoop::~EventLoop()
+{
+    if (timerFd != -1) {
+        close(timerFd);
+    }
+    if (wakeupFd != -1) {
+        close(wakeupFd);
+    }
+    if (epollFd != -1) {
+        close(epollFd);
+    }
+}
+
+bool EventLoop::Init()
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd == -1) {
+        perror("epoll_create1 failed");
+        return false;
+    }
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeupFd == -1) {
+        perror("eventfd failed");
+        return false;
+    }
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerFd == -1) {
+        perror("timerfd_create failed");
+        return false;
+    }
+    return AddFd(wakeupFd, EPOLLIN | EPOLLET, [this](uint32_t) { DrainWakeup(); }) &&
+           AddFd(timerFd, EPOLLIN | EPOLLET, [this](uint32_t) { RunTimers(); });
+}
+
+bool EventLoop::AddFd(int fd, uint32_t events, Handler handler)
+{
+    if (fd >= (int)handlers.size()) {
+        handlers.resize(fd + 1);
+    }
+    handlers[fd] = std::move(handler);
+
+    epoll_event ev;
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        handlers[fd] = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void EventLoop::RemoveFd(int fd)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    if (fd < (int)handlers.size()) {
+        handlers[fd] = nullptr;
+    }
+}
+
+void EventLoop::RunInLoop(Task task)
+{
+    pendingTasks.Push(std::move(task));
+    if (wakeupPending.exchange(true)) {
+        return;
+    }
+    uint64_t one = 1;
+    ssize_t n = write(wakeupFd, &one, sizeof(one));
+    (void)n;
+}
+
+void EventLoop::RunNextRound(Task task)
+{
+    nextRound.push_back(std::move(task));
+}
+
+void EventLoop::RunAfter(uint32_t micros, Task task)
+{
+    if (timers.Add(micros, std::move(task))) {
+        ArmTimer();
+    }
+}
+
+// timerfd 按绝对时刻设置, 重设会替换之前的到期时刻
+void EventLoop::ArmTimer()
+{
+    uint64_t deadline = timers.Armed();
+    itimerspec spec = {};
+    spec.it_value.tv_sec = (time_t)(deadline / 1000000);
+    spec.it_value.tv_nsec = (long)(deadline % 1000000) * 1000;
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void EventLoop::RunTimers()
+{
+    uint64_t expirations;
+    while (read(timerFd, &expirations, sizeof(expirations)) > 0) {
+    }
+    if (timers.RunDue()) {
+        ArmTimer();
+    }
+}
+
+void EventLoop::DrainWakeup()
+{
+    uint64_t value;
+    while (read(wakeupFd, &value, sizeof(value)) > 0) {
+    }
+}
+
+void EventLoop::RunPendingTasks()
+{
+    // 先清标志再取任务: 清标志之后投递的任务一定会再次唤醒
+    wakeupPending.store(false);
+    Task task;
+    while (pendingTasks.Pop(task)) {
+        task();
+    }
+}
+
+void EventLoop::Loop()
+{
+    epoll_event events[MAX_EVENTS];
+    std::vector<Task> due;
+    while (true) {
+        int n = epoll_wait(epollFd, events, MAX_EVENTS, nextRound.empty() ? -1 : 0);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait failed");
+            break;
+        }
+        due.swap(nextRound);
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            // 回调中可能移除其他 fd, 每次都重新检查
+            if (fd < (int)handlers.size() && handlers[fd]) {
+                Handler handler = handlers[fd];
+                handler(events[i].events);
+            }
+        }
+        RunPendingTasks();
+        for (Task &task : due) {
+            task();
+        }
+        due.clear();
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ * Description: 基于 epoll (边沿触发) 的事件循环，一个线程驱动一个 EventLoop
+ * Author: 夏凡
+ * Create: 2025-12-09
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "InlineTask.h"
+#include "Mailbox.h"
+#include "TimerQueue.h"
+
+class EventLoop {
+public:
+    using Task = InlineTask;
+    using Handler = std::function<void(uint32_t events)>;
+
+    EventLoop();
+    ~EventLoop();
+
+    bool Init();
+    void Loop();
+
+    // fd 必须已设为非阻塞; 回调在本循环线程内执行
+    bool AddFd(int fd, uint32_t events, Handler handler);
+    void RemoveFd(int fd);
+
+    // 线程安全(无锁): 投递任务到循环线程, 本轮事件处理完后执行
+    void RunInLoop(Task task);
+    // 仅限循环线程: 下一轮 epoll_wait (此时不阻塞) 返回的事件处理完后执行,
+    // 用于把一次做不完的工作让给其他连接
+    void RunNextRound(Task task);
+    // 仅限循环线程: 约 micros 微秒后执行 (不早于), 用于短暂推迟刷新, 攒一批消息一起发
+    void RunAfter(uint32_t micros, Task task);
+
+private:
+    void DrainWakeup();
+    void RunPendingTasks();
+    void ArmTimer();
+    void RunTimers();
+
+    int epollFd;
+    int wakeupFd;
+    std::vector<Handler> handlers; // 下标即 fd
+
+    Mailbox<Task> pendingTasks;
+    std::atomic<bool> wakeupPending; // 已写 eventfd 且尚未处理, 避免重复唤醒
+    std::vector<Task> nextRound;
+
+    int timerFd;
+    TimerQueue timers;
+};
+
+// 将 fd 设为非阻塞
+bool SetNonBlocking(int fd);
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * Description: 文件仓库实现
+ * Author: 夏凡
+ * Create: 2025-12-16
+ */
+
+#include "FileStore.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include "../common/Crc32c.h"
+
+FileStore g_fileStore;
+
+StoreBlob::~StoreBlob()
+{
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+StoreUpload::~StoreUpload()
+{
+    if (fd != -1) {
+        close(fd);
+    }
+    if (store != nullptr) {
+        store->Release(hash);
+    }
+}
+
+// 更新摘要与校验值; 每满一块记下该块的 CRC32C
+void StoreUpload::Account(const char *data, size_t len)
+{
+    sha.Update(data, len);
+    fileCrc = Crc32c(fileCrc, data, len);
+    while (len > 0) {
+        size_t room = STORE_CHUNK_SIZE - (size_t)(written % STORE_CHUNK_SIZE);
+        size_t take = std::min(room, len);
+        chunkCrc = Crc32c(chunkCrc, data, take);
+        written += take;
+        data += take;
+        len -= take;
+        if (take == room) {
+            chunkCrcs.push_back(chunkCrc);
+            chunkCrc = 0;
+        }
+    }
+}
+
+bool StoreUpload::Append(const char *data, size_t len)
+{
+    if (written + (int64_t)len > size) {
+        return false;
+    }
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, data + done, len - done, written + done);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    Account(data, len);
+    return true;
+}
+
+bool FileStore::Open(const std::string &path)
+{
+    dir = path;
+    if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+        perror("mkdir store");
+        return false;
+    }
+    return true;
+}
+
+bool FileStore::ValidHash(const std::string &hash)
+{
+    if (hash.size() != 64) {
+        return false;
+    }
+    for (char c : hash) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string FileStore::Path(const std::string &hash, const char *suffix) const
+{
+    return dir + "/" + hash + suffix;
+}
+
+std::shared_ptr<const StoreBlob> FileStore::Find(const std::string &hash, int64_t size)
+{
+    if (!ValidHash(hash)) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<const StoreBlob> blob = blobs[hash].lock();
+    if (!blob) {
+        blob = Load(hash, size);
+        blobs[hash] = blob;
+    }
+    return (blob && blob->size == size) ? blob : nullptr;
+}
+
+// 打开内容文件并读入索引, 二者不一致时视为不存在
+std::shared_ptr<const StoreBlob> FileStore::Load(const std::string &hash, int64_t size)
+{
+    std::shared_ptr<StoreBlob> blob = std::make_shared<StoreBlob>();
+    blob->hash = hash;
+    blob->fd = open(Path(hash, "").c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (blob->fd == -1 || fstat(blob->fd, &st) == -1 || st.st_size != size) {
+        return nullptr;
+    }
+    blob->size = size;
+
+    size_t chunks = (size_t)((size + STORE_CHUNK_SIZE - 1) / STORE_CHUNK_SIZE);
+    std::vector<uint32_t> index(chunks + 1);
+    FILE *file = fopen(Path(hash, ".idx").c_str(), "rb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+    size_t got = fread(index.data(), sizeof(uint32_t), index.size(), file);
+    fclose(file);
+    if (got != index.size()) {
+        return nullptr;
+    }
+    blob->fileCrc = index[0];
+    blob->chunkCrcs.assign(index.begin() + 1, index.end());
+    return blob;
+}
+
+std::shared_ptr<StoreUpload> FileStore::BeginUpload(const std::string &hash, int64_t size)
+{
+    if (!ValidHash(hash) || size < 0) {
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!uploading.insert(hash).second) {
+            return nullptr;
+        }
+    }
+    std::shared_ptr<StoreUpload> upload = std::make_shared<StoreUpload>();
+    upload->store = this; // 从这里起析构时释放上传权
+    upload->hash = hash;
+    upload->size = size;
+    upload->fd = open(Path(hash, ".part").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (upload->fd == -1) {
+        return nullptr;
+    }
+
+    // 上次中断留下的部分重新计入摘要, 从其末尾续传
+    struct stat st;
+    if (fstat(upload->fd, &st) == -1 || st.st_size > size) {
+        if (ftruncate(upload->fd, 0) == -1) {
+            return nullptr;
+        }
+        st.st_size = 0;
+    }
+    std::vector<char> buf(STORE_CHUNK_SIZE);
+    while (upload->written < st.st_size) {
+        ssize_t n = pread(upload->fd, buf.data(), buf.size(), upload->written);
+        if (n <= 0) {
+            break;
+        }
+        upload->Account(buf.data(), n);
+    }
+    if (ftruncate(upload->fd, upload->written) == -1) {
+        return nullptr;
+    }
+    return upload;
+}
+
+std::shared_ptr<const StoreBlob> FileStore::Commit(const std::shared_ptr<StoreUpload> &upload)
+{
+    if (upload->written != upload->size) {
+        return nullptr;
+    }
+    if (upload->sha.HexDigest() != upload->hash) {
+        unlink(Path(upload->hash, ".part").c_str());
+        return nullptr;
+    }
+    if (upload->written % STORE_CHUNK_SIZE != 0) {
+        upload->chunkCrcs.push_back(upload->chunkCrc);
+    }
+
+    // 先写索引再改名: 中途崩溃只会留下没有内容文件的索引, 下次上传时覆盖
+    std::vector<uint32_t> index;
+    index.reserve(upload->chunkCrcs.size() + 1);
+    index.push_back(upload->fileCrc);
+    index.insert(index.end(), upload->chunkCrcs.begin(), upload->chunkCrcs.end());
+    FILE *file = fopen(Path(upload->hash, ".idx").c_str(), "wb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+    bool written = fwrite(index.data(), sizeof(uint32_t), index.size(), file) == index.size();
+    written = (fclose(file) == 0) && written;
+    if (!written || rename(Path(upload->hash, ".part").c_str(), Path(upload->hash, "").c_str()) == -1) {
+        return nullptr;
+    }
+    return Find(upload->hash, upload->size);
+}
+
+void FileStore::Release(const std::string &hash)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uploading.erase(hash);
+}
@@ -0,0 +1,100 @@
+/*
+ * Description: 内容寻址的文件仓库: 群发文件先完整上传到服务端, 按 SHA-256 存放,
+ *              再按每个接收方自己的速度用 sendfile 发出; 相同内容只存一份
+ * Author: 夏凡
+ * Create: 2025-12-16
+ */
+
+#ifndef FILE_STORE_H
+#define FILE_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "Sha256.h"
+
+// 仓库目录中的文件:
+//   <hash>       文件内容
+//   <hash>.idx   整体 CRC32C, 之后每 STORE_CHUNK_SIZE 字节一个 CRC32C, 发送时直接填入块头
+//   <hash>.part  上传中的内容, 发送方断线后按已有长度续传
+const size_t STORE_CHUNK_SIZE = 64 * 1024;
+
+// 一个已入库的文件, 打开后只读共享
+struct StoreBlob {
+    int fd = -1;
+    std::string hash;
+    int64_t size = 0;
+    uint32_t fileCrc = 0;
+    std::vector<uint32_t> chunkCrcs;
+
+    ~StoreBlob();
+};
+
+class FileStore;
+
+// 一次上传: 只接受顺序追加, 同时计算摘要与各块校验值
+class StoreUpload {
+public:
+    ~StoreUpload();
+
+    int64_t Written() const
+    {
+        return written;
+    }
+    int64_t Size() const
+    {
+        return size;
+    }
+    // 追加到 .part 末尾, 写盘失败返回 false
+    bool Append(const char *data, size_t len);
+
+private:
+    friend class FileStore;
+    void Account(const char *data, size_t len);
+
+    FileStore *store = nullptr;
+    std::string hash;
+    int fd = -1;
+    int64_t size = 0;
+    int64_t written = 0;
+    Sha256 sha;
+    uint32_t fileCrc = 0;
+    uint32_t chunkCrc = 0; // 当前未满一块的校验值
+    std::vector<uint32_t> chunkCrcs;
+};
+
+class FileStore {
+public:
+    // 目录不存在时创建
+    bool Open(const std::string &dir);
+
+    // 已入库且长度相符时返回, 否则为空 (线程安全)
+    std::shared_ptr<const StoreBlob> Find(const std::string &hash, int64_t size);
+    // 开始或继续上传; 同一内容正在由别人上传时返回空 (线程安全)
+    std::shared_ptr<StoreUpload> BeginUpload(const std::string &hash, int64_t size);
+    // 上传完毕: 长度与摘要都相符才入库; 不足时保留 .part 等续传, 摘要不符时删除
+    std::shared_ptr<const StoreBlob> Commit(const std::shared_ptr<StoreUpload> &upload);
+
+    // 只接受 64 位小写十六进制, 防止拼出仓库目录之外的路径
+    static bool ValidHash(const std::string &hash);
+
+private:
+    friend class StoreUpload;
+    std::string Path(const std::string &hash, const char *suffix) const;
+    std::shared_ptr<const StoreBlob> Load(const std::string &hash, int64_t size);
+    void Release(const std::string &hash);
+
+    std::string dir;
+    std::mutex mutex;
+    std::unordered_set<std::string> uploading;
+    std::unordered_map<std::string, std::weak_ptr<const StoreBlob>> blobs; // 已打开的文件, 共享同一个 fd
+};
+
+extern FileStore g_fileStore;
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Description: 文件转发流量控制实现
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#include "FlowControl.h"
+
+RelayBudget g_relayBudget;
+
+void RelayBudget::Add(size_t bytes)
+{
+    used.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+// 越过恢复线时唤醒所有因预算暂停的上传方 (等待者只在预算不可用时登记, 之后必然有一次越线)
+void RelayBudget::Sub(size_t bytes)
+{
+    size_t resumeLine = limit - limit / 4;
+    size_t before = used.fetch_sub(bytes, std::memory_order_relaxed);
+    if (before <= resumeLine || before - bytes > resumeLine) {
+        return;
+    }
+    std::vector<std::weak_ptr<UploadCredit>> woken;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        woken.swap(waiters);
+    }
+    for (auto &weak : woken) {
+        std::shared_ptr<UploadCredit> credit = weak.lock();
+        if (credit) {
+            credit->budgetWaiting.store(false, std::memory_order_relaxed);
+            credit->TryResume();
+        }
+    }
+}
+
+void RelayBudget::Wait(const std::shared_ptr<UploadCredit> &credit)
+{
+    if (credit->budgetWaiting.exchange(true, std::memory_order_relaxed)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    waiters.push_back(credit);
+}
+
+CreditTicket::CreditTicket(const std::shared_ptr<UploadCredit> &owner, size_t len) : credit(owner), bytes(len)
+{
+    credit->inflight.fetch_add(bytes, std::memory_order_relaxed);
+    g_relayBudget.Add(bytes);
+}
+
+CreditTicket::~CreditTicket()
+{
+    credit->Release(bytes);
+}
+
+UploadCredit::UploadCredit(size_t bytes, std::function<void()> resume) : window(bytes), onResume(std::move(resume))
+{
+}
+
+std::shared_ptr<CreditTicket> UploadCredit::Take(size_t bytes)
+{
+    return std::make_shared<CreditTicket>(shared_from_this(), bytes);
+}
+
+bool UploadCredit::ShouldPause()
+{
+    if (inflight.load(std::memory_order_relaxed) < window.load(std::memory_order_relaxed) &&
+        !g_relayBudget.Exhausted()) {
+        return false;
+    }
+    paused.store(true, std::memory_order_release);
+    // 判断与置位之间可能已有额度归还, 再检查一次, 避免错过唤醒
+    TryResume();
+    return Paused();
+}
+
+void UploadCredit::Release(size_t bytes)
+{
+    inflight.fetch_sub(bytes, std::memory_order_relaxed);
+    g_relayBudget.Sub(bytes);
+    TryResume();
+}
+
+// 自己的在途字节降到窗口一半以下、且全局预算可用时恢复; 只有把 paused 清掉的那个线程调用 onResume
+void UploadCredit::TryResume()
+{
+    if (!Paused() || inflight.load(std::memory_order_relaxed) > window.load(std::memory_order_relaxed) / 2) {
+        return;
+    }
+    if (!g_relayBudget.Available()) {
+        g_relayBudget.Wait(shared_from_this());
+        if (!g_relayBudget.Available()) {
+            return;
+        }
+    }
+    if (paused.exchange(false, std::memory_order_acq_rel)) {
+        onResume();
+    }
+}
@@ -0,0 +1,103 @@
+/*
+ * Description: 一对一文件转发的流量控制: 每个上传连接有一个在途字节窗口, 全进程另有一个总预算,
+ *              接收方发出一个转发包后归还它占用的额度, 额度用尽时服务器暂停读取上传方的 socket
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#ifndef FLOW_CONTROL_H
+#define FLOW_CONTROL_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class UploadCredit;
+
+// 全进程转发中的字节总预算, 超出后所有上传方都暂停, 降到 3/4 以下再恢复
+class RelayBudget {
+public:
+    void SetLimit(size_t bytes)
+    {
+        limit = bytes;
+    }
+    bool Exhausted() const
+    {
+        return used.load(std::memory_order_relaxed) >= limit;
+    }
+    bool Available() const
+    {
+        return used.load(std::memory_order_relaxed) <= limit - limit / 4;
+    }
+    size_t Used() const
+    {
+        return used.load(std::memory_order_relaxed);
+    }
+
+    void Add(size_t bytes);
+    void Sub(size_t bytes);
+    // 预算恢复时调用 credit 的 TryResume; 已登记的不重复登记
+    void Wait(const std::shared_ptr<UploadCredit> &credit);
+
+private:
+    std::atomic<size_t> used{0};
+    size_t limit = 256 * 1024 * 1024;
+    std::mutex mutex;
+    std::vector<std::weak_ptr<UploadCredit>> waiters;
+};
+
+// 全局配置, 启动时由命令行设置
+extern RelayBudget g_relayBudget;
+
+// 一个转发包占用的额度: 随包进入接收方的发送队列, 包发出 (或被丢弃) 后析构时归还
+class CreditTicket {
+public:
+    CreditTicket(const std::shared_ptr<UploadCredit> &credit, size_t bytes);
+    ~CreditTicket();
+
+    CreditTicket(const CreditTicket &) = delete;
+    CreditTicket &operator=(const CreditTicket &) = delete;
+
+private:
+    std::shared_ptr<UploadCredit> credit;
+    size_t bytes;
+};
+
+// 一个上传连接的额度, 在上传方分片扣减, 在接收方分片归还
+// 在途字节达到窗口时暂停, 降到一半以下 (且全局预算可用) 时恢复
+class UploadCredit : public std::enable_shared_from_this<UploadCredit> {
+public:
+    // onResume 可能在任意分片线程调用, 由它把恢复读取投递回上传方分片
+    UploadCredit(size_t window, std::function<void()> onResume);
+
+    // 上传方分片: 为一个即将转发的包扣减额度
+    std::shared_ptr<CreditTicket> Take(size_t bytes);
+    // 上传方分片: 额度用尽时转为暂停并返回 true, 之后额度恢复会调用一次 onResume
+    bool ShouldPause();
+    bool Paused() const
+    {
+        return paused.load(std::memory_order_acquire);
+    }
+    void SetWindow(size_t bytes)
+    {
+        window.store(bytes, std::memory_order_relaxed);
+    }
+
+    void TryResume();
+
+private:
+    friend class CreditTicket;
+    friend class RelayBudget;
+    void Release(size_t bytes);
+
+    std::atomic<size_t> inflight{0};
+    std::atomic<bool> paused{false};
+    std::atomic<bool> budgetWaiting{false}; // 已登记在 RelayBudget 的等待列表中
+    std::atomic<size_t> window;
+    std::function<void()> onResume;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Description: 消息帧的分配与释放
+ * Author: 夏凡
+ * Create: 2025-12-12
+ */
+
+#include "Frame.h"
+#include <cstring>
+#include <new>
+#include "../common/Protocol.h"
+#include "BufferPool.h"
+
+// 帧常在一个分片分配、在另一个分片随最后一个引用释放, 由缓冲区池的全局链表周转
+static FrameBlock *AllocFrameBlock(size_t total)
+{
+    FrameBlock *block = new (PoolAlloc(sizeof(FrameBlock) + total)) FrameBlock();
+    block->refs.store(1, std::memory_order_relaxed);
+    block->size = (uint32_t)total;
+    return block;
+}
+
+FrameRef MakeFrame(int type, size_t len, int32_t senderId, char *&body)
+{
+    FrameBlock *block = AllocFrameBlock(sizeof(MsgHeader) + len);
+    MsgHeader header;
+    header.type = type;
+    header.bodyLen = (int32_t)len;
+    header.senderId = senderId;
+    memcpy(block->Data(), &header, sizeof(header));
+    body = block->Data() + sizeof(header);
+    return FrameRef(block);
+}
+
+FrameRef MakeFrame(int type, const char *body, size_t len, int32_t senderId)
+{
+    char *dest;
+    FrameRef frame = MakeFrame(type, len, senderId, dest);
+    if (len > 0) {
+        memcpy(dest, body, len);
+    }
+    return frame;
+}
+
+static size_t PartsSize(std::initializer_list<std::string_view> parts)
+{
+    size_t len = 0;
+    for (std::string_view part : parts) {
+        len += part.size();
+    }
+    return len;
+}
+
+static void CopyParts(char *dest, std::initializer_list<std::string_view> parts)
+{
+    for (std::string_view part : parts) {
+        if (!part.empty()) {
+            memcpy(dest, part.data(), part.size());
+            dest += part.size();
+        }
+    }
+}
+
+FrameRef MakeFrame(int type, std::initializer_list<std::string_view> parts, int32_t senderId, size_t tailLen)
+{
+    size_t len = PartsSize(parts);
+    FrameBlock *block = AllocFrameBlock(sizeof(MsgHeader) + len);
+    MsgHeader header;
+    header.type = type;
+    header.bodyLen = (int32_t)(len + tailLen);
+    header.senderId = senderId;
+    memcpy(block->Data(), &header, sizeof(header));
+    CopyParts(block->Data() + sizeof(header), parts);
+    return FrameRef(block);
+}
+
+FrameRef MakeHeader(int type, size_t bodyLen, int32_t senderId)
+{
+    return MakeFrame(type, std::initializer_list<std::string_view>(), senderId, bodyLen);
+}
+
+FrameRef MakeRawFrame(const char *data, size_t len)
+{
+    FrameBlock *block = AllocFrameBlock(len);
+    if (len > 0) {
+        memcpy(block->Data(), data, len);
+    }
+    return FrameRef(block);
+}
+
+FrameRef MakeRawFrame(std::initializer_list<std::string_view> parts)
+{
+    FrameBlock *block = AllocFrameBlock(PartsSize(parts));
+    CopyParts(block->Data(), parts);
+    return FrameRef(block);
+}
+
+void ReleaseFrameBlock(FrameBlock *block)
+{
+    block->~FrameBlock();
+    PoolFree(block);
+}
@@ -0,0 +1,132 @@
+/*
+ * Description: 只编码一次、由多个接收方共享的消息帧 (包头与包体连续存放, 原子引用计数)
+ * Author: 夏凡
+ * Create: 2025-12-12
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "BufferPool.h"
+
+// 帧内存块: 控制字段之后紧跟 size 字节的 包头+包体
+struct FrameBlock {
+    std::atomic<int> refs;
+    uint32_t size;
+
+    char *Data()
+    {
+        return reinterpret_cast<char *>(this + 1);
+    }
+};
+
+void ReleaseFrameBlock(FrameBlock *block);
+
+// 帧的共享引用, 拷贝只增加计数, 内容创建后不再修改
+// 也可以只引用帧中的一段 (见 Slice), 用于把收到的包体的一部分原样转发
+class FrameRef {
+public:
+    FrameRef() : block(nullptr), offset(0), size(0)
+    {
+    }
+    // 接管 block 上已有的一个引用
+    explicit FrameRef(FrameBlock *b) : block(b), offset(0), size(b->size)
+    {
+    }
+    FrameRef(const FrameRef &other) : block(other.block), offset(other.offset), size(other.size)
+    {
+        if (block != nullptr) {
+            block->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    FrameRef(FrameRef &&other) noexcept : block(other.block), offset(other.offset), size(other.size)
+    {
+        other.block = nullptr;
+    }
+    FrameRef &operator=(FrameRef other) noexcept
+    {
+        std::swap(block, other.block);
+        offset = other.offset;
+        size = other.size;
+        return *this;
+    }
+    ~FrameRef()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        if (block != nullptr && block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            ReleaseFrameBlock(block);
+        }
+        block = nullptr;
+    }
+
+    const char *Data() const
+    {
+        return block->Data() + offset;
+    }
+    size_t Size() const
+    {
+        return size;
+    }
+    // 包头中的消息类型 (对整帧有意义)
+    int Type() const
+    {
+        int32_t type;
+        memcpy(&type, Data(), sizeof(type));
+        return type;
+    }
+    // 引用本段中 [from, from + len) 的字节, 与原帧共享内存
+    FrameRef Slice(size_t from, size_t len) const
+    {
+        FrameRef part(*this);
+        part.offset += (uint32_t)from;
+        part.size = (uint32_t)len;
+        return part;
+    }
+    explicit operator bool() const
+    {
+        return block != nullptr;
+    }
+
+private:
+    FrameBlock *block;
+    uint32_t offset;
+    uint32_t size;
+};
+
+// 一次提交给内核的一批帧 (io_uring 后端), 数组本身也从缓冲区池分配
+using FrameBatch = std::vector<FrameRef, PoolAllocator<FrameRef>>;
+
+// 编码一帧: 一次分配, 写入 MsgHeader 与包体
+FrameRef MakeFrame(int type, const char *body, size_t len, int32_t senderId = -1);
+// 只写 MsgHeader, body 指向包体位置: 调用方在帧共享出去之前填入 (如直接从 socket 读入)
+FrameRef MakeFrame(int type, size_t len, int32_t senderId, char *&body);
+// 包体按段拼接, 每段只拷贝一次; tailLen 是不在本帧中的包体字节数,
+// 由调用方作为紧随其后的分段发送 (如引用收到的帧中的一段), 包头的长度已计入
+FrameRef MakeFrame(int type, std::initializer_list<std::string_view> parts, int32_t senderId = -1,
+                   size_t tailLen = 0);
+// 只有包头的帧, 包体的 bodyLen 字节全部由调用方作为后续分段发送
+FrameRef MakeHeader(int type, size_t bodyLen, int32_t senderId);
+
+inline FrameRef MakeFrame(int type, const std::string &body, int32_t senderId = -1)
+{
+    return MakeFrame(type, body.data(), body.size(), senderId);
+}
+
+// 不加包头, 原样保存 len 字节 (用于拼接在其他字节之后发送)
+FrameRef MakeRawFrame(const char *data, size_t len);
+FrameRef MakeRawFrame(std::initializer_list<std::string_view> parts);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * Description: 事件循环的任务: 小闭包直接存放在任务对象内, 大闭包放进缓冲区池,
+ *              跨分片投递任务不经过 malloc (std::function 只能内联两个指针大小且可平凡复制的闭包)
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#ifndef INLINE_TASK_H
+#define INLINE_TASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "BufferPool.h"
+
+class InlineTask {
+public:
+    static const size_t INLINE_SIZE = 48;
+
+    InlineTask() = default;
+    InlineTask(std::nullptr_t)
+    {
+    }
+    template <typename F, typename = typename std::enable_if<
+                              !std::is_same<typename std::decay<F>::type, InlineTask>::value>::type>
+    InlineTask(F &&fn)
+    {
+        using Fn = typename std::decay<F>::type;
+        using Store = typename std::conditional<FitsInline<Fn>(), LocalStore<Fn>, PooledStore<Fn>>::type;
+        Store::Init(storage, std::forward<F>(fn));
+        ops = &Store::OPS;
+    }
+    InlineTask(const InlineTask &other) : ops(other.ops)
+    {
+        if (ops != nullptr) {
+            ops->copy(storage, other.storage);
+        }
+    }
+    InlineTask(InlineTask &&other) noexcept : ops(other.ops)
+    {
+        if (ops != nullptr) {
+            ops->move(storage, other.storage);
+            other.ops = nullptr;
+        }
+    }
+    InlineTask &operator=(const InlineTask &other)
+    {
+        if (this != &other) {
+            InlineTask copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+    InlineTask &operator=(InlineTask &&other) noexcept
+    {
+        if (this != &other) {
+            Reset();
+            ops = other.ops;
+            if (ops != nullptr) {
+                ops->move(storage, other.storage);
+                other.ops = nullptr;
+            }
+        }
+        return *this;
+    }
+    ~InlineTask()
+    {
+        Reset();
+    }
+
+    void operator()()
+    {
+        ops->invoke(storage);
+    }
+    explicit operator bool() const
+    {
+        return ops != nullptr;
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void *self);
+        void (*copy)(void *dst, const void *src);
+        void (*move)(void *dst, void *src); // 移动后 src 不再持有闭包
+        void (*destroy)(void *self);
+    };
+
+    template <typename Fn>
+    static constexpr bool FitsInline()
+    {
+        return sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template <typename Fn>
+    struct LocalStore {
+        static Fn *Get(void *self)
+        {
+            return static_cast<Fn *>(self);
+        }
+        template <typename F>
+        static void Init(void *self, F &&fn)
+        {
+            new (self) Fn(std::forward<F>(fn));
+        }
+        static void Invoke(void *self)
+        {
+            (*Get(self))();
+        }
+        static void Copy(void *dst, const void *src)
+        {
+            new (dst) Fn(*static_cast<const Fn *>(src));
+        }
+        static void Move(void *dst, void *src)
+        {
+            new (dst) Fn(std::move(*Get(src)));
+            Get(src)->~Fn();
+        }
+        static void Destroy(void *self)
+        {
+            Get(self)->~Fn();
+        }
+        static constexpr Ops OPS = {Invoke, Copy, Move, Destroy};
+    };
+
+    template <typename Fn>
+    struct PooledStore {
+        static Fn *&Get(void *self)
+        {
+            return *static_cast<Fn **>(self);
+        }
+        template <typename F>
+        static void Init(void *self, F &&fn)
+        {
+            Get(self) = new (PoolAlloc(sizeof(Fn))) Fn(std::forward<F>(fn));
+        }
+        static void Invoke(void *self)
+        {
+            (*Get(self))();
+        }
+        static void Copy(void *dst, const void *src)
+        {
+            Init(dst, **static_cast<Fn *const *>(src));
+        }
+        static void Move(void *dst, void *src)
+        {
+            Get(dst) = Get(src);
+        }
+        static void Destroy(void *self)
+        {
+            Get(self)->~Fn();
+            PoolFree(Get(self));
+        }
+        static constexpr Ops OPS = {Invoke, Copy, Move, Destroy};
+    };
+
+    void Reset()
+    {
+        if (ops != nullptr) {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) char storage[INLINE_SIZE];
+    const Ops *ops = nullptr;
+};
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * Description: 无锁多生产者单消费者队列，用于向分片线程投递跨线程任务
+ * Author: 夏凡
+ * Create: 2025-12-10
+ */
+
+#ifndef MAILBOX_H
+#define MAILBOX_H
+
+#include <atomic>
+#include <utility>
+#include "BufferPool.h"
+
+// Vyukov MPSC 队列: Push 可在任意线程调用, Pop 只能由唯一的消费者线程调用
+template <typename T>
+class Mailbox {
+public:
+    Mailbox()
+    {
+        Node *stub = new Node();
+        head.store(stub, std::memory_order_relaxed);
+        tail = stub;
+    }
+
+    ~Mailbox()
+    {
+        T discard;
+        while (Pop(discard)) {
+        }
+        delete tail;
+    }
+
+    Mailbox(const Mailbox &) = delete;
+    Mailbox &operator=(const Mailbox &) = delete;
+
+    void Push(T value)
+    {
+        Node *node = new Node();
+        node->value = std::move(value);
+        Node *prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // 队列为空(或生产者尚未完成链接)时返回 false
+    bool Pop(T &out)
+    {
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            return false;
+        }
+        out = std::move(next->value);
+        delete tail;
+        tail = next; // next 成为新的哨兵节点
+        return true;
+    }
+
+private:
+    // 节点由生产者线程分配、消费者线程释放, 走缓冲区池的线程缓存与全局链表
+    struct Node {
+        std::atomic<Node *> next{nullptr};
+        T value;
+
+        static void *operator new(size_t size)
+        {
+            return PoolAlloc(size);
+        }
+        static void operator delete(void *ptr)
+        {
+            PoolFree(ptr);
+        }
+    };
+
+    std::atomic<Node *> head; // 生产者端
+    Node *tail;               // 消费者端 (哨兵)
+};
+
+#endif
@@ -0,0 +1,557 @@
+/*
+ * Description: 发送队列实现
+ * Author: 夏凡
+ * Create: 2025-12-13
+ */
+
+#include "OutboundQueue.h"
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "../common/Protocol.h"
+#include "FileStore.h"
+#include "FlowControl.h"
+
+const size_t MAX_IOV = 64;
+const size_t ZEROCOPY_THRESHOLD = 8 * 1024; // 小于该长度时拷贝反而更快
+const size_t CONFLATE_HARD_LIMIT = 4;       // CONFLATE 策略下的积压上限 (高水位的倍数)
+const int SPLICE_PIPE_SIZE = 1024 * 1024;   // 慢接收方积压在管道里, 而不是用户态
+const size_t BULK_QUANTUM = 64 * 1024;      // 差额轮转中每路传输每轮的字节额度
+const size_t BULK_COMMIT_BYTES = 64 * 1024; // 排在新到聊天消息之前的文件字节上限
+const size_t V2_INLINE_BODY = 256;          // 换 v2 包头时, 不超过该长度的包体随新包头拷贝一次, 更长的按分段引用原帧
+const size_t BATCH_ITEM_MAX = 1024;         // 不超过该长度的控制消息才合批 (用户列表快照之类的大消息单独发)
+const size_t BATCH_MAX_BYTES = 16 * 1024;   // 一个 MSG_BUNDLE 的包体上限
+const size_t SCRATCH_RESERVE = 2 * BATCH_MAX_BYTES; // 合批与压缩的临时缓冲区一开始就留够, 批次变大时不再扩容
+
+QueueLimits g_queueLimits;
+
+SplicePipe::~SplicePipe()
+{
+    if (readFd != -1) {
+        close(readFd);
+    }
+    if (writeFd != -1) {
+        close(writeFd);
+    }
+}
+
+std::shared_ptr<SplicePipe> SplicePipe::Create()
+{
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1) {
+        return nullptr;
+    }
+    std::shared_ptr<SplicePipe> pipe = std::make_shared<SplicePipe>();
+    pipe->readFd = fds[0];
+    pipe->writeFd = fds[1];
+    // 超过 /proc/sys/fs/pipe-max-size 时失败, 保持默认 64KB 即可
+    fcntl(pipe->writeFd, F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    return pipe;
+}
+
+// 按策略判断能否再放入 size 字节
+bool OutboundQueue::Admit(size_t size, bool droppable)
+{
+    const QueueLimits &limits = g_queueLimits;
+    // 转发中的文件块不算积压: 接收方收得慢时上传方会先停下, 否则大文件转发期间发给接收方的聊天消息会被判为超限
+    size_t backlog = bytes - std::min(bytes, creditBytes);
+    overflow = false;
+    if (limits.policy == SLOW_DISCONNECT) {
+        overflow = backlog + size > limits.highWatermark;
+        return !overflow;
+    }
+    if (limits.policy == SLOW_DROP && droppable) {
+        if (congested && backlog <= limits.lowWatermark) {
+            congested = false;
+        } else if (!congested && backlog >= limits.highWatermark) {
+            congested = true;
+        }
+        return !congested;
+    }
+    overflow = backlog + size > limits.highWatermark * CONFLATE_HARD_LIMIT;
+    return !overflow;
+}
+
+// 文件消息所属的传输 (发送方会话号, 传输 ID); 其他消息返回 false
+// 同一传输中压缩与未压缩的块 (MSG_FILE_PACKED / MSG_FILE_DATA) 可能交替出现, 必须进同一路才不会乱序
+// frame 的包头总是 v1 格式, 文件头的包体则按接收方的版本 protocol 编码
+static bool BulkFlow(const FrameRef &frame, int protocol, uint64_t &flow)
+{
+    MsgHeader header;
+    if (frame.Size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, frame.Data(), sizeof(header));
+    const char *body = frame.Data() + sizeof(header);
+    size_t len = frame.Size() - sizeof(header);
+    uint32_t transferId = 0;
+    if (header.type == MSG_FILE_DATA || header.type == MSG_FILE_PACKED || header.type == MSG_FILE_COPY ||
+        header.type == MSG_FILE_END) {
+        if (len < (size_t)TRANSFER_ID_LEN) {
+            return false;
+        }
+        memcpy(&transferId, body, TRANSFER_ID_LEN);
+    } else if (header.type == MSG_FILE_INFO && protocol == PROTOCOL_V2) {
+        uint64_t value;
+        if (GetVarint(body, len, value) <= 0) {
+            return false;
+        }
+        transferId = (uint32_t)value;
+    } else if (header.type == MSG_FILE_INFO) {
+        // 文本包体以十进制的传输 ID 开头
+        for (size_t i = 0; i < len && body[i] >= '0' && body[i] <= '9'; ++i) {
+            transferId = transferId * 10 + (uint32_t)(body[i] - '0');
+        }
+    } else {
+        return false;
+    }
+    flow = ((uint64_t)(uint32_t)header.senderId << 32) | transferId;
+    return true;
+}
+
+// 把 frame 开头的 v1 包头换成 v2 包头; 原帧可能还被其他 v1 接收方的队列共享, 所以不改原帧
+void OutboundQueue::ToWireV2(Item &item)
+{
+    MsgHeader header;
+    memcpy(&header, item.frame.Data(), sizeof(header));
+    char head[V2_HEADER_MAX];
+    size_t headLen = EncodeHeaderV2(header, head);
+    size_t bodyLen = item.frame.Size() - sizeof(header);
+    if (bodyLen > V2_INLINE_BODY && !item.rest) {
+        item.rest = item.frame.Slice(sizeof(header), bodyLen);
+        item.frame = MakeRawFrame(head, headLen);
+        return;
+    }
+    item.frame = MakeRawFrame({std::string_view(head, headLen),
+                               std::string_view(item.frame.Data() + sizeof(header), bodyLen)});
+}
+
+// 按流压缩一条控制消息的包体, 压不小的原样发出; 压缩后的帧仍是 v1 包头, type 带上 COMPRESSED_FLAG
+void OutboundQueue::Deflate(Item &item)
+{
+    if (item.pipe || item.blob) {
+        return;
+    }
+    static thread_local std::string body;
+    static thread_local std::string packed;
+    if (packed.capacity() < SCRATCH_RESERVE) {
+        body.reserve(SCRATCH_RESERVE);
+        packed.reserve(SCRATCH_RESERVE);
+    }
+    const char *data = item.frame.Data() + sizeof(MsgHeader);
+    size_t len = item.frame.Size() - sizeof(MsgHeader);
+    if (item.rest) {
+        body.assign(data, len);
+        body.append(item.rest.Data(), item.rest.Size());
+        data = body.data();
+        len = body.size();
+    }
+    packed.clear();
+    if (!deflater->Compress(data, len, packed)) {
+        return;
+    }
+    MsgHeader header;
+    memcpy(&header, item.frame.Data(), sizeof(header));
+    item.frame = MakeFrame(header.type | COMPRESSED_FLAG, packed.data(), packed.size(), header.senderId);
+    item.rest.Reset();
+}
+
+// 控制消息排入 ready 时定下线上格式: 先压缩, 再换包头; 返回编码后的字节数
+void OutboundQueue::Finish(Item &item)
+{
+    size_t before = item.Size();
+    if (item.compress) {
+        Deflate(item);
+    }
+    if (item.protocol == PROTOCOL_V2) {
+        ToWireV2(item);
+    }
+    bytes = bytes - before + item.Size();
+}
+
+// 把控制队列开头与 first 相邻的小消息一起合成一个 MSG_BUNDLE: 包体为各条消息的 v2 帧依次相连, 之后整帧再压缩、换包头
+// 只有一条时保持原样
+void OutboundQueue::Gather(Item &first)
+{
+    if (control.empty() || !control.front().batch) {
+        return;
+    }
+    static thread_local std::string body;
+    body.reserve(SCRATCH_RESERVE);
+    body.clear();
+    size_t before = 0;
+    auto append = [&before](const Item &item) {
+        MsgHeader header;
+        memcpy(&header, item.frame.Data(), sizeof(header));
+        char head[V2_HEADER_MAX];
+        body.append(head, EncodeHeaderV2(header, head));
+        body.append(item.frame.Data() + sizeof(header), item.frame.Size() - sizeof(header));
+        if (item.rest) {
+            body.append(item.rest.Data(), item.rest.Size());
+        }
+        before += item.Size();
+    };
+    append(first);
+    while (!control.empty() && control.front().batch && body.size() < BATCH_MAX_BYTES) {
+        append(control.front());
+        control.pop_front();
+    }
+    first.frame = MakeFrame(MSG_BUNDLE, body.data(), body.size());
+    first.rest.Reset();
+    first.type = MSG_BUNDLE;
+    bytes = bytes - before + first.Size();
+}
+
+// 文件消息进入所属传输的队列, 入队时就换好包头; 其余原样进入控制队列, 排定顺序时再编码; 返回入队的字节数
+size_t OutboundQueue::Enqueue(Item &&item)
+{
+    uint64_t key;
+    bool bulk = BulkFlow(item.frame, protocol, key);
+    item.type = item.frame.Type();
+    item.protocol = protocol;
+    if (!bulk) {
+        item.compress = deflater != nullptr;
+        // 已经是批次的帧 (分片共享的广播批次) 不再嵌套
+        item.batch = batching && item.type != MSG_BUNDLE && !item.pipe && !item.blob && !item.ticket &&
+                     item.Size() <= BATCH_ITEM_MAX;
+        size_t size = item.Size();
+        control.push_back(std::move(item));
+        return size;
+    }
+    if (protocol == PROTOCOL_V2) {
+        ToWireV2(item);
+    }
+    size_t size = item.Size();
+    if (item.ticket) {
+        creditBytes += size; // 带额度的都是文件消息, 此后大小不再改变
+    }
+    Flow &flow = flows[key];
+    if (flow.items.empty()) {
+        flowOrder.push_back(key);
+    }
+    flow.items.push_back(std::move(item));
+    return size;
+}
+
+// 差额轮转 (DRR): 轮到的传输每次加 BULK_QUANTUM 字节额度, 额度够发队首消息才发, 大块与小块的传输按字节公平
+OutboundQueue::Item OutboundQueue::PopBulk()
+{
+    while (true) {
+        uint64_t key = flowOrder.front();
+        Flow &flow = flows[key];
+        size_t size = flow.items.front().Size();
+        if (size <= flow.deficit) {
+            Item item = std::move(flow.items.front());
+            flow.items.pop_front();
+            flow.deficit -= size;
+            if (flow.items.empty()) {
+                flows.erase(key);
+                flowOrder.pop_front();
+            }
+            return item;
+        }
+        flow.deficit += BULK_QUANTUM;
+        flowOrder.pop_front();
+        flowOrder.push_back(key);
+    }
+}
+
+// 排定发送顺序: 控制消息全部先排, 文件消息只在 ready 中不足 BULK_COMMIT_BYTES 时补充,
+// 新到的聊天消息最多排在这么多文件字节 (加上一条文件消息) 之后
+void OutboundQueue::Schedule()
+{
+    while (!control.empty()) {
+        Item item = std::move(control.front());
+        control.pop_front();
+        if (item.batch) {
+            Gather(item);
+        }
+        Finish(item);
+        readyBytes += item.Size();
+        ready.push_back(std::move(item));
+    }
+    while (readyBytes < BULK_COMMIT_BYTES && !flowOrder.empty()) {
+        Item item = PopBulk();
+        readyBytes += item.Size();
+        ready.push_back(std::move(item));
+    }
+}
+
+OutboundQueue::PushResult OutboundQueue::Push(const FrameRef &frame, const std::shared_ptr<CreditTicket> &ticket)
+{
+    // 新的用户列表快照覆盖控制队列里尚未排定的旧快照
+    // (增量不能合并: 丢掉任何一条, 客户端都会因版本不连续重新请求快照)
+    if (g_queueLimits.policy == SLOW_CONFLATE && frame.Type() == MSG_USER_SNAPSHOT) {
+        for (size_t i = control.size(); i-- > 0;) {
+            Item &item = control[i];
+            if (item.type == MSG_USER_SNAPSHOT) {
+                bytes -= item.Size();
+                item.frame = frame;
+                bytes += item.Size();
+                return PUSH_QUEUED;
+            }
+        }
+    }
+    if (!ticket && !Admit(frame.Size(), true)) {
+        return overflow ? PUSH_OVERFLOW : PUSH_DROPPED;
+    }
+    Item item;
+    item.frame = frame;
+    item.ticket = ticket;
+    bytes += Enqueue(std::move(item));
+    return PUSH_QUEUED;
+}
+
+OutboundQueue::PushResult OutboundQueue::PushParts(const FrameRef &head, const FrameRef &payload)
+{
+    Item item;
+    item.frame = head;
+    if (payload.Size() > 0) {
+        item.rest = payload;
+    }
+    if (!Admit(item.Size(), true)) {
+        return overflow ? PUSH_OVERFLOW : PUSH_DROPPED;
+    }
+    bytes += Enqueue(std::move(item));
+    return PUSH_QUEUED;
+}
+
+OutboundQueue::PushResult OutboundQueue::PushRelay(const FrameRef &header, const std::shared_ptr<SplicePipe> &pipe,
+                                                   size_t pipeBytes, const FrameRef &tail,
+                                                   const std::shared_ptr<CreditTicket> &ticket)
+{
+    Item item;
+    item.frame = header;
+    if (pipeBytes > 0) {
+        item.pipe = pipe;
+        item.tailBytes = pipeBytes;
+    }
+    if (tail && tail.Size() > 0) {
+        item.rest = tail;
+    }
+    item.ticket = ticket;
+    bytes += Enqueue(std::move(item));
+    return PUSH_QUEUED;
+}
+
+OutboundQueue::PushResult OutboundQueue::PushFile(const FrameRef &header, const std::shared_ptr<const StoreBlob> &blob,
+                                                  off_t offset, size_t len)
+{
+    size_t size = header.Size() + len;
+    if (!Admit(size, false)) {
+        return PUSH_OVERFLOW;
+    }
+    Item item;
+    item.frame = header;
+    item.blob = blob;
+    item.blobOffset = offset;
+    item.tailBytes = len;
+    bytes += Enqueue(std::move(item));
+    return PUSH_QUEUED;
+}
+
+void OutboundQueue::PopReady()
+{
+    if (ready.front().ticket) {
+        creditBytes -= ready.front().Size();
+    }
+    ready.pop_front();
+    headOffset = 0;
+}
+
+// 已发出 sent 字节 (只含各项 frame 与 rest 部分), 推进队首
+void OutboundQueue::Consume(size_t sent, bool zeroCopy)
+{
+    uint32_t id = zeroCopy ? zcNextId++ : 0;
+    bytes -= sent;
+    readyBytes -= sent;
+    while (sent > 0) {
+        Item &head = ready.front();
+        bool inFrame = headOffset < head.frame.Size();
+        size_t partEnd = inFrame ? head.frame.Size() : head.Size();
+        if (zeroCopy) {
+            zcInflight.emplace_back(id, inFrame ? head.frame : head.rest);
+        }
+        size_t remain = partEnd - headOffset;
+        if (sent < remain) {
+            headOffset += sent;
+            return;
+        }
+        sent -= remain;
+        headOffset = partEnd;
+        if (headOffset == head.Size()) {
+            PopReady();
+        } else if (head.tailBytes > 0) {
+            return; // 接下来发管道或文件里的字节
+        }
+    }
+}
+
+// 队首项的 frame 部分已发完, 把它在管道或文件里的字节移到 socket
+OutboundQueue::FlushResult OutboundQueue::SendTail(int fd)
+{
+    Item &head = ready.front();
+    size_t tailEnd = head.frame.Size() + head.tailBytes;
+    while (headOffset < tailEnd) {
+        ssize_t n;
+        if (head.pipe) {
+            n = splice(head.pipe->readFd, nullptr, fd, nullptr, tailEnd - headOffset,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        } else {
+            off_t offset = head.blobOffset + (off_t)(headOffset - head.frame.Size());
+            n = sendfile(fd, head.blob->fd, &offset, tailEnd - headOffset);
+        }
+        if (n > 0) {
+            headOffset += n;
+            bytes -= n;
+            readyBytes -= n;
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return FLUSH_AGAIN;
+        }
+        return FLUSH_ERROR;
+    }
+    if (headOffset == head.Size()) {
+        PopReady();
+    }
+    return FLUSH_DONE;
+}
+
+OutboundQueue::FlushResult OutboundQueue::Flush(int fd, bool zeroCopy)
+{
+    while (true) {
+        Schedule();
+        if (ready.empty()) {
+            return FLUSH_DONE;
+        }
+        const Item &head = ready.front();
+        if (head.tailBytes > 0 && headOffset >= head.frame.Size() &&
+            headOffset < head.frame.Size() + head.tailBytes) {
+            FlushResult result = SendTail(fd);
+            if (result != FLUSH_DONE) {
+                return result;
+            }
+            continue;
+        }
+
+        // 收集连续的 frame / rest 部分; 遇到管道或文件里的字节就停下, 下一轮 splice / sendfile
+        iovec iov[MAX_IOV];
+        size_t count = 0;
+        size_t batchBytes = 0;
+        size_t skip = headOffset;
+        for (auto it = ready.begin(); it != ready.end() && count < MAX_IOV; ++it) {
+            if (skip < it->frame.Size()) {
+                iov[count].iov_base = (void *)(it->frame.Data() + skip);
+                iov[count].iov_len = it->frame.Size() - skip;
+                batchBytes += iov[count].iov_len;
+                ++count;
+                skip = 0;
+            } else {
+                skip -= it->frame.Size();
+            }
+            if (skip < it->tailBytes) {
+                break;
+            }
+            skip -= it->tailBytes;
+            if (it->rest && count < MAX_IOV) {
+                iov[count].iov_base = (void *)(it->rest.Data() + skip);
+                iov[count].iov_len = it->rest.Size() - skip;
+                batchBytes += iov[count].iov_len;
+                ++count;
+                skip = 0;
+            } else if (it->rest) {
+                break;
+            }
+        }
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+
+        bool useZeroCopy = zeroCopy && batchBytes >= ZEROCOPY_THRESHOLD;
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL | (useZeroCopy ? MSG_ZEROCOPY : 0));
+        if (n == -1 && useZeroCopy && errno == ENOBUFS) {
+            // 超出 optmem 限额: 本次退回普通拷贝发送
+            useZeroCopy = false;
+            n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        }
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return FLUSH_AGAIN;
+            }
+            return FLUSH_ERROR;
+        }
+        Consume(n, useZeroCopy);
+        if ((size_t)n < batchBytes) {
+            return FLUSH_AGAIN;
+        }
+    }
+}
+
+void OutboundQueue::TakeBatch(FrameBatch &batch, size_t maxFrames)
+{
+    size_t batchBytes = 0;
+    while (batch.size() + 2 <= maxFrames && batchBytes < BULK_COMMIT_BYTES) {
+        if (ready.empty()) {
+            Schedule();
+            if (ready.empty()) {
+                return;
+            }
+        }
+        Item &head = ready.front();
+        size_t size = head.Size();
+        bytes -= size;
+        readyBytes -= size;
+        batchBytes += size;
+        if (head.ticket) {
+            creditBytes -= size;
+        }
+        batch.push_back(std::move(head.frame));
+        if (head.rest) {
+            batch.push_back(std::move(head.rest));
+        }
+        ready.pop_front();
+    }
+}
+
+void OutboundQueue::ReapZeroCopy(int fd)
+{
+    while (!zcInflight.empty()) {
+        char control[128];
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE) == -1) {
+            return;
+        }
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level != SOL_IP || cm->cmsg_type != IP_RECVERR) {
+                continue;
+            }
+            sock_extended_err *serr = (sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0) {
+                continue;
+            }
+            // 通知为闭区间 [ee_info, ee_data], 序号单调递增
+            uint32_t last = serr->ee_data;
+            while (!zcInflight.empty() && (int32_t)(zcInflight.front().first - last) <= 0) {
+                zcInflight.pop_front();
+            }
+        }
+    }
+}
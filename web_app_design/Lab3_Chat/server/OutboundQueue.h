@@ -0,0 +1,172 @@
+/*
+ * Description: 每个连接的有界发送队列: sendmsg 批量发送、高/低水位与慢消费者策略,
+ *              聊天与控制消息优先于文件消息, 各路文件传输按字节轮转; 转发字节用 splice, 仓库文件用 sendfile
+ * Author: 夏凡
+ * Create: 2025-12-13
+ */
+
+#ifndef OUTBOUND_QUEUE_H
+#define OUTBOUND_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "../common/Lz.h"
+#include "../common/Protocol.h"
+#include "BufferPool.h"
+#include "Frame.h"
+
+// 接收方跟不上时的处理方式
+enum SlowConsumerPolicy {
+    SLOW_DROP,       // 超过高水位后丢弃新帧, 降到低水位以下恢复
+    SLOW_CONFLATE,   // 排队中的用户列表快照只保留最新一帧; 积压到高水位 4 倍时断开
+    SLOW_DISCONNECT  // 超过高水位直接断开
+};
+
+struct QueueLimits {
+    size_t highWatermark = 1024 * 1024;
+    size_t lowWatermark = 256 * 1024;
+    SlowConsumerPolicy policy = SLOW_CONFLATE;
+};
+
+// 全局配置, 启动时由命令行设置
+extern QueueLimits g_queueLimits;
+
+// splice 转发用的管道: 发送方把包体从 socket 移入管道, 接收方的队列再从管道移到自己的 socket
+// 字节按入管道的顺序出管道, 所以同一管道的转发项必须按顺序进入同一个接收队列
+struct SplicePipe {
+    int readFd = -1;
+    int writeFd = -1;
+
+    ~SplicePipe();
+    static std::shared_ptr<SplicePipe> Create();
+};
+
+struct StoreBlob;
+class CreditTicket;
+
+class OutboundQueue {
+public:
+    enum PushResult {
+        PUSH_QUEUED,
+        PUSH_DROPPED,
+        PUSH_OVERFLOW   // 按策略应断开该连接
+    };
+    enum FlushResult {
+        FLUSH_DONE,     // 队列已清空
+        FLUSH_AGAIN,    // 内核缓冲区已满, 等可写事件
+        FLUSH_ERROR
+    };
+
+    // 带 ticket 的是一对一转发的包: 发出后归还上传方的额度; 在途字节已由额度限制, 不受慢消费者策略影响
+    PushResult Push(const FrameRef &frame, const std::shared_ptr<CreditTicket> &ticket = nullptr);
+    // 分段的一条消息: head (包头与包体开头) 之后紧接着发 payload, 两段各占一个 iovec, payload 不拷贝
+    PushResult PushParts(const FrameRef &head, const FrameRef &payload);
+    // 转发一个包: header 之后从 pipe 发出 pipeBytes 字节, 再发 tail (可为空)
+    PushResult PushRelay(const FrameRef &header, const std::shared_ptr<SplicePipe> &pipe, size_t pipeBytes,
+                         const FrameRef &tail, const std::shared_ptr<CreditTicket> &ticket);
+    // 发送仓库文件的一段: header 之后用 sendfile 发出 blob 中 [offset, offset + len)
+    // 调用方按队列水位控制节奏, 因此同样不受 DROP 策略影响
+    PushResult PushFile(const FrameRef &header, const std::shared_ptr<const StoreBlob> &blob, off_t offset,
+                        size_t len);
+
+    // 一次 sendmsg 带出多帧, 遇到管道项或文件项改用 splice / sendfile, 直到队列清空或内核缓冲区满
+    FlushResult Flush(int fd, bool zeroCopy);
+    // 按同样的优先级取出最多 maxFrames 段交给 io_uring, 文件消息攒到 BULK_COMMIT_BYTES 为止
+    // (调用时队首不能有已发出一半的帧, 队列中不能有管道项或文件项)
+    void TakeBatch(FrameBatch &batch, size_t maxFrames);
+    // 读取 MSG_ZEROCOPY 完成通知, 释放内核不再引用的帧
+    void ReapZeroCopy(int fd);
+
+    // 入队的帧一律是 v1 包头; 设为 PROTOCOL_V2 后, 之后入队的帧发出前把包头换成 varint 编码
+    void SetProtocol(int version)
+    {
+        protocol = version;
+    }
+    // 之后入队的聊天与控制消息在排定发送顺序时按流压缩 (只在 v2 下调用)
+    void EnableCompression()
+    {
+        deflater.reset(new LzEncoder());
+    }
+    // 之后入队的小消息在排定发送顺序时与相邻的合成 MSG_BUNDLE (只在 v2 下调用)
+    void EnableBatching()
+    {
+        batching = true;
+    }
+
+    bool Empty() const
+    {
+        return ready.empty() && control.empty() && flowOrder.empty();
+    }
+    size_t Bytes() const
+    {
+        return bytes;
+    }
+
+private:
+    // 队列随消息进出反复申请、释放分段, 分段从缓冲区池取
+    template <typename T>
+    using PoolDeque = std::deque<T, PoolAllocator<T>>;
+
+    // 队列中的一条消息: frame 的字节, 之后从管道 (pipe) 或仓库文件 (blob 的 blobOffset 处) 发出 tailBytes 字节,
+    // 最后是 rest (管道满时未进管道的包体, 或分段消息引用的包体, 可为空); 三部分必须连续发出
+    struct Item {
+        FrameRef frame;
+        std::shared_ptr<SplicePipe> pipe;
+        std::shared_ptr<const StoreBlob> blob;
+        off_t blobOffset = 0;
+        size_t tailBytes = 0;
+        FrameRef rest;
+        std::shared_ptr<CreditTicket> ticket; // 出队时析构, 归还上传方的额度
+        int type = 0; // 入队时从 v1 包头取出, 换成 v2 包头后 frame 里不再有这个字段
+        int protocol = PROTOCOL_V1; // 入队时连接的协议版本与是否压缩, 登录应答之类的入队后才切换的不受影响
+        bool compress = false;
+        bool batch = false; // 可以与相邻的小消息合成一帧
+
+        size_t Size() const
+        {
+            return frame.Size() + tailBytes + (rest ? rest.Size() : 0);
+        }
+    };
+    // 一路文件传输 (发送方会话号, 传输 ID) 的待发消息, 同一传输内保持顺序
+    struct Flow {
+        PoolDeque<Item> items;
+        size_t deficit = 0; // 差额轮转中尚未用完的字节额度
+    };
+
+    bool Admit(size_t size, bool droppable);
+    void ToWireV2(Item &item);
+    void Deflate(Item &item);
+    void Finish(Item &item);
+    void Gather(Item &first);
+    size_t Enqueue(Item &&item);
+    Item PopBulk();
+    void Schedule();
+    void PopReady();
+    void Consume(size_t sent, bool zeroCopy);
+    FlushResult SendTail(int fd);
+
+    PoolDeque<Item> ready;   // 已排定发送顺序的消息, 队首可能已发出一部分
+    size_t readyBytes = 0;   // ready 中尚未发出的字节数
+    PoolDeque<Item> control; // 聊天与控制消息, 先于文件消息排入 ready
+    std::unordered_map<uint64_t, Flow> flows;
+    PoolDeque<uint64_t> flowOrder; // 有待发消息的传输, 按轮转顺序
+    size_t headOffset = 0; // ready 队首已发出的字节数
+    size_t bytes = 0;      // 队列中尚未发出的字节数
+    size_t creditBytes = 0; // 其中带额度的转发包 (出队时整项扣除), 已由上传方额度限制, 不计入慢消费者水位
+    bool congested = false;
+    bool overflow = false;
+    int protocol = PROTOCOL_V1;
+    std::unique_ptr<LzEncoder> deflater; // 压缩流的历史按发出顺序累积, 所以控制消息在 Schedule 时才压缩
+    bool batching = false;
+
+    uint32_t zcNextId = 0;
+    std::deque<std::pair<uint32_t, FrameRef>> zcInflight;
+};
+
+#endif
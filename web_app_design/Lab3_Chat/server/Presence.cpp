@@ -0,0 +1,139 @@
+/*
+ * Description: 上线/下线合并器实现
+ * Author: 夏凡
+ * Create: 2025-12-15
+ */
+
+#include "Presence.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unordered_set>
+#include "../common/Protocol.h"
+
+void PresenceAggregator::Start(int window, Publisher publisher)
+{
+    windowMs = window;
+    publish = std::move(publisher);
+    std::thread([this]() { Run(); }).detach();
+}
+
+// v1: Version|Name1,Name2...  v2: Version, 之后每个用户为 UserId, Name
+std::string EncodeUserList(int protocol, uint64_t version, const std::vector<PresenceEntry> &entries)
+{
+    std::string body;
+    if (protocol == PROTOCOL_V2) {
+        AppendVarint(body, version);
+        for (const PresenceEntry &entry : entries) {
+            EncodeBody(UserEntryWire{entry.id, entry.name}, body);
+        }
+        return body;
+    }
+    body = std::to_string(version) + "|";
+    for (size_t i = 0; i < entries.size(); ++i) {
+        body += entries[i].name;
+        if (i != entries.size() - 1) {
+            body += ",";
+        }
+    }
+    return body;
+}
+
+void PresenceAggregator::Join(const std::string &name, uint64_t id)
+{
+    Record(name, id, 1);
+}
+
+void PresenceAggregator::Leave(const std::string &name, uint64_t id)
+{
+    Record(name, id, -1);
+}
+
+void PresenceAggregator::Record(const std::string &name, uint64_t id, int delta)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    bool wasIdle = pending.empty();
+    auto result = pending.emplace(name, Change());
+    if (result.second) {
+        pendingOrder.push_back(name);
+    }
+    Change &change = result.first->second;
+    change.delta += delta;
+    if (delta > 0) {
+        change.id = id;
+    }
+    if (wasIdle) {
+        wakeup.notify_one();
+    }
+}
+
+FrameRef PresenceAggregator::Snapshot(int protocol)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    FrameRef &frame = snapshotFrames[protocol == PROTOCOL_V2 ? 1 : 0];
+    if (!frame) {
+        frame = MakeFrame(MSG_USER_SNAPSHOT, EncodeUserList(protocol, version, published));
+    }
+    return frame;
+}
+
+// 第一条变化到达后再等一个窗口, 把期间累积的变化一次发布
+void PresenceAggregator::Run()
+{
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait(lock, [this]() { return !pending.empty(); });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(windowMs));
+        PresenceUpdate update = Flush();
+        if (!update.left.empty() || !update.joined.empty()) {
+            publish(update);
+        }
+    }
+}
+
+PresenceUpdate PresenceAggregator::Flush()
+{
+    PresenceUpdate update;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unordered_map<std::string, uint64_t> publishedIds;
+    for (const PresenceEntry &entry : published) {
+        publishedIds.emplace(entry.name, entry.id);
+    }
+    for (const std::string &name : pendingOrder) {
+        const Change &change = pending[name];
+        auto old = publishedIds.find(name);
+        if (change.delta > 0) {
+            update.joined.push_back({name, change.id});
+        } else if (change.delta < 0) {
+            update.left.push_back({name, old == publishedIds.end() ? 0 : old->second});
+        } else if (old != publishedIds.end() && old->second != change.id) {
+            // 窗口内下线又上线: 对 v1 客户端没有变化, v2 客户端要换成新的 ID
+            update.left.push_back({name, old->second});
+            update.joined.push_back({name, change.id});
+        }
+    }
+    pending.clear();
+    pendingOrder.clear();
+
+    if (!update.left.empty()) {
+        std::unordered_set<std::string> gone;
+        for (const PresenceEntry &entry : update.left) {
+            gone.insert(entry.name);
+        }
+        published.erase(std::remove_if(published.begin(), published.end(),
+            [&gone](const PresenceEntry &entry) { return gone.count(entry.name) != 0; }), published.end());
+        update.leftVersion = ++version;
+    }
+    if (!update.joined.empty()) {
+        published.insert(published.end(), update.joined.begin(), update.joined.end());
+        update.joinedVersion = ++version;
+    }
+    if (!update.left.empty() || !update.joined.empty()) {
+        for (FrameRef &frame : snapshotFrames) {
+            frame.Reset();
+        }
+    }
+    return update;
+}
@@ -0,0 +1,76 @@
+/*
+ * Description: 上线/下线合并器: 在一个时间窗口内累积变化, 每个窗口只发布一次,
+ *              同一窗口内互相抵消的上线与下线不发布 (换了用户 ID 的重新登录除外)
+ * Author: 夏凡
+ * Create: 2025-12-15
+ */
+
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Frame.h"
+
+// 列表中的一个用户; v1 客户端只用名字, v2 客户端另用 ID 指定私聊与文件的对方
+struct PresenceEntry {
+    std::string name;
+    uint64_t id;
+};
+
+// 一个窗口合并后的变化; 下线先于上线应用, 各占一个版本号
+// 窗口内同名用户重新登录 (ID 变了) 时同时出现在两边
+struct PresenceUpdate {
+    std::vector<PresenceEntry> left;
+    uint64_t leftVersion = 0;
+    std::vector<PresenceEntry> joined;
+    uint64_t joinedVersion = 0;
+};
+
+// 用户列表消息的包体 (MSG_USER_SNAPSHOT / JOINED / LEFT), 按客户端的协议版本编码
+std::string EncodeUserList(int protocol, uint64_t version, const std::vector<PresenceEntry> &entries);
+
+class PresenceAggregator {
+public:
+    using Publisher = std::function<void(const PresenceUpdate &update)>;
+
+    // 启动后台线程; publish 在该线程内按版本顺序调用
+    void Start(int windowMs, Publisher publish);
+
+    // 线程安全
+    void Join(const std::string &name, uint64_t id);
+    void Leave(const std::string &name, uint64_t id);
+
+    // 已发布列表的快照帧 (MSG_USER_SNAPSHOT), 每个版本的列表对每种协议只编码一次
+    FrameRef Snapshot(int protocol);
+
+private:
+    // 窗口内某个用户名的净变化 (+1 上线, -1 下线) 与最近一次上线的 ID
+    struct Change {
+        int delta = 0;
+        uint64_t id = 0;
+    };
+
+    void Record(const std::string &name, uint64_t id, int delta);
+    void Run();
+    PresenceUpdate Flush();
+
+    int windowMs = 50;
+    Publisher publish;
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::unordered_map<std::string, Change> pending;
+    std::vector<std::string> pendingOrder;        // 首次出现的顺序, 保证输出稳定
+
+    uint64_t version = 0;
+    std::vector<PresenceEntry> published;         // 按上线顺序
+    FrameRef snapshotFrames[2];                   // 对应 version 的 v1 / v2 快照, 过期时为空
+};
+
+#endif
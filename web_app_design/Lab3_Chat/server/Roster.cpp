@@ -0,0 +1,107 @@
+/*
+ * Description: 在线用户表实现
+ * Author: 夏凡
+ * Create: 2025-12-14
+ */
+
+#include "Roster.h"
+#include <algorithm>
+#include <thread>
+
+bool RosterSnapshot::Find(const std::string &name, ClientRef &ref) const
+{
+    const ClientRef *found = byName.Find(name);
+    if (found == nullptr) {
+        return false;
+    }
+    ref = *found;
+    return true;
+}
+
+bool RosterSnapshot::Find(uint64_t sessionId, ClientRef &ref) const
+{
+    const ClientRef *found = byId.Find(sessionId);
+    if (found == nullptr) {
+        return false;
+    }
+    ref = *found;
+    return true;
+}
+
+Roster::Roster() : published(nullptr), current(std::make_shared<RosterSnapshot>())
+{
+    published = current.get();
+}
+
+bool Roster::Find(const std::string &name, ClientRef &ref) const
+{
+    return Read([&](const RosterSnapshot &snapshot) { return snapshot.Find(name, ref); });
+}
+
+bool Roster::Find(uint64_t sessionId, ClientRef &ref) const
+{
+    return Read([&](const RosterSnapshot &snapshot) { return snapshot.Find(sessionId, ref); });
+}
+
+// 换上新快照并翻转阶段: 之后进入的读者计入另一个阶段, 旧阶段的计数只减不增, 持续的查找不会让旧快照永远留着
+void Roster::Publish(std::shared_ptr<const RosterSnapshot> next)
+{
+    published.store(next.get());
+    retired.push_back({std::move(current), 3});
+    current = std::move(next);
+    epoch.fetch_add(1);
+    Reclaim();
+    while (retired.size() > RETIRED_MAX) {
+        std::this_thread::yield();
+        epoch.fetch_add(1);
+        Reclaim();
+    }
+}
+
+// 计数此刻为 0 的阶段里, 在旧快照换下之前进入的读者都已退出; 两个阶段都看到过归零的旧快照可以释放
+void Roster::Reclaim()
+{
+    unsigned drained = 0;
+    for (unsigned phase = 0; phase < 2; ++phase) {
+        if (readers[phase].count.load() == 0) {
+            drained |= 1u << phase;
+        }
+    }
+    for (Retired &entry : retired) {
+        entry.pendingPhases &= ~drained;
+    }
+    retired.erase(std::remove_if(retired.begin(), retired.end(),
+                                 [](const Retired &entry) { return entry.pendingPhases == 0; }),
+                  retired.end());
+}
+
+std::shared_ptr<const RosterSnapshot> Roster::Add(const ClientContext &client)
+{
+    std::lock_guard<std::mutex> lock(writeMutex);
+    if (current->byName.Find(client.name) != nullptr) {
+        return nullptr;
+    }
+    std::shared_ptr<RosterSnapshot> next = std::make_shared<RosterSnapshot>();
+    next->byName = current->byName.With(client.name, client.ref);
+    next->byId = current->byId.With(client.ref.sessionId, client.ref);
+    next->size = current->size + 1;
+    std::shared_ptr<const RosterSnapshot> snapshot(std::move(next));
+    Publish(snapshot);
+    return snapshot;
+}
+
+std::shared_ptr<const RosterSnapshot> Roster::Remove(const std::string &name, uint64_t sessionId)
+{
+    std::lock_guard<std::mutex> lock(writeMutex);
+    const ClientRef *found = current->byName.Find(name);
+    if (found == nullptr || found->sessionId != sessionId) {
+        return nullptr;
+    }
+    std::shared_ptr<RosterSnapshot> next = std::make_shared<RosterSnapshot>();
+    next->byName = current->byName.Without(name);
+    next->byId = current->byId.Without(sessionId);
+    next->size = current->size - 1;
+    std::shared_ptr<const RosterSnapshot> snapshot(std::move(next));
+    Publish(snapshot);
+    return snapshot;
+}
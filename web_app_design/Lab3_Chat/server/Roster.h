@@ -0,0 +1,245 @@
+/*
+ * Description: 在线用户表: 以不可变快照发布 (RCU), 读者不取任何锁, 登录/退出时写时复制 (只复制改动的路径)
+ * Author: 夏凡
+ * Create: 2025-12-14
+ */
+
+#ifndef ROSTER_H
+#define ROSTER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../common/Protocol.h"
+
+// 连接在进程内的唯一标识: fd 会被复用, 用 sessionId 区分新旧连接
+// 给它发消息时包体按 protocol 对应的版本编码
+struct ClientRef {
+    int shard;
+    int fd;
+    uint64_t sessionId;
+    int protocol = PROTOCOL_V1;
+    bool compress = false; // 协商了压缩, 压缩过的文件块可以原样转给它
+};
+
+// 在线用户表的一项
+struct ClientContext {
+    ClientRef ref;
+    std::string name;
+};
+
+// 持久化的哈希数组映射字典树 (HAMT): 每层取哈希的 6 位选 64 路之一, 内部节点用位图只存非空子节点;
+// 叶子是一小组 (完整哈希, 键, 连接), 超过 LEAF_MAX 项时按下一层的 6 位拆开, 删空的子树随之收起。
+// 查找逐层下降, 叶子中先比较完整哈希, 相等才比较键; 修改时复制从根到叶子的一条路径, 其余节点与修改前共享。
+// 层数随在线人数按 64 为底的对数增长 (1000 人约 2 层, 10 万人约 3 层), 每次查找/修改的开销也随之对数增长, 不是常数
+template <typename Key>
+class RosterIndex {
+public:
+    const ClientRef *Find(const Key &key) const
+    {
+        size_t hash = std::hash<Key>()(key);
+        const Node *node = root.get();
+        for (unsigned shift = 0; node != nullptr && !node->IsLeaf(); shift += BITS) {
+            uint64_t bit = uint64_t(1) << HashSlot(hash, shift);
+            node = (node->bitmap & bit) != 0 ? node->children[node->Slot(bit)].get() : nullptr;
+        }
+        if (node == nullptr) {
+            return nullptr;
+        }
+        for (const Entry &entry : node->entries) {
+            if (entry.hash == hash && entry.key == key) {
+                return &entry.ref;
+            }
+        }
+        return nullptr;
+    }
+
+    // 返回加入 (键已存在时替换) 一项后的索引, 本索引不变
+    RosterIndex With(const Key &key, const ClientRef &ref) const
+    {
+        size_t hash = std::hash<Key>()(key);
+        RosterIndex next;
+        next.root = Update(root, 0, hash, key, [&](std::vector<Entry> &entries) {
+            entries.push_back({hash, key, ref});
+        });
+        return next;
+    }
+    // 返回删去一项后的索引, 本索引不变
+    RosterIndex Without(const Key &key) const
+    {
+        RosterIndex next;
+        next.root = Update(root, 0, std::hash<Key>()(key), key, [](std::vector<Entry> &) {});
+        return next;
+    }
+
+private:
+    static const unsigned BITS = 6;
+    static const size_t FANOUT = size_t(1) << BITS;
+    static const size_t MASK = FANOUT - 1;
+    static const unsigned HASH_BITS = std::numeric_limits<size_t>::digits;
+    static const size_t LEAF_MAX = 16; // 叶子超过这么多项就拆成下一层; 哈希位用完后不再拆 (只剩完整哈希相同的键)
+
+    struct Entry {
+        size_t hash;
+        Key key;
+        ClientRef ref;
+    };
+    // bitmap 非 0 为内部节点, children 按槽号顺序只存非空子节点; 否则为叶子, 项在 entries 中
+    struct Node {
+        uint64_t bitmap = 0;
+        std::vector<std::shared_ptr<const Node>> children;
+        std::vector<Entry> entries;
+
+        bool IsLeaf() const
+        {
+            return bitmap == 0;
+        }
+        size_t Slot(uint64_t bit) const
+        {
+            return (size_t)__builtin_popcountll(bitmap & (bit - 1));
+        }
+    };
+
+    static size_t HashSlot(size_t hash, unsigned shift)
+    {
+        return hash >> shift & MASK;
+    }
+
+    // 由一组项建子树: 不超过 LEAF_MAX 项 (或哈希位已用完) 时是一个叶子, 否则按 shift 处的 6 位分组递归
+    static std::shared_ptr<const Node> Build(std::vector<Entry> entries, unsigned shift)
+    {
+        std::shared_ptr<Node> node = std::make_shared<Node>();
+        if (entries.size() <= LEAF_MAX || shift >= HASH_BITS) {
+            node->entries = std::move(entries);
+            return node;
+        }
+        std::array<std::vector<Entry>, FANOUT> groups;
+        for (Entry &entry : entries) {
+            groups[HashSlot(entry.hash, shift)].push_back(std::move(entry));
+        }
+        for (size_t i = 0; i < FANOUT; ++i) {
+            if (!groups[i].empty()) {
+                node->bitmap |= uint64_t(1) << i;
+                node->children.push_back(Build(std::move(groups[i]), shift + BITS));
+            }
+        }
+        return node;
+    }
+
+    // 返回 node (位于 shift 处) 去掉 key、再由 insert 决定是否加回后的新子树, 子树为空时返回空指针;
+    // 只复制 key 所在的路径
+    template <typename Insert>
+    static std::shared_ptr<const Node> Update(const std::shared_ptr<const Node> &node, unsigned shift, size_t hash,
+                                              const Key &key, Insert insert)
+    {
+        if (node && !node->IsLeaf()) {
+            uint64_t bit = uint64_t(1) << HashSlot(hash, shift);
+            size_t slot = node->Slot(bit);
+            bool present = (node->bitmap & bit) != 0;
+            std::shared_ptr<const Node> child =
+                Update(present ? node->children[slot] : nullptr, shift + BITS, hash, key, insert);
+            std::shared_ptr<Node> next = std::make_shared<Node>(*node);
+            if (present && child) {
+                next->children[slot] = std::move(child);
+            } else if (child) {
+                next->bitmap |= bit;
+                next->children.insert(next->children.begin() + slot, std::move(child));
+            } else if (present) {
+                next->bitmap &= ~bit;
+                next->children.erase(next->children.begin() + slot);
+            }
+            // 删到只剩一个叶子时把它提上来, 树的高度跟着在线人数回落
+            if (next->children.size() == 1 && next->children[0]->IsLeaf()) {
+                return next->children[0];
+            }
+            return next->bitmap == 0 ? nullptr : std::shared_ptr<const Node>(std::move(next));
+        }
+        std::vector<Entry> entries;
+        if (node) {
+            entries.reserve(node->entries.size() + 1);
+            for (const Entry &entry : node->entries) {
+                if (!(entry.hash == hash && entry.key == key)) {
+                    entries.push_back(entry);
+                }
+            }
+        }
+        insert(entries);
+        return entries.empty() ? nullptr : Build(std::move(entries), shift);
+    }
+
+    std::shared_ptr<const Node> root;
+};
+
+// 某一时刻的在线用户表, 发布后不再修改
+struct RosterSnapshot {
+    RosterIndex<std::string> byName;
+    RosterIndex<uint64_t> byId; // 用户 ID (会话号), v2 客户端按它指定对方
+    size_t size = 0;
+
+    // 按用户名或用户 ID 查找, 开销随在线人数按对数增长 (见 RosterIndex)
+    bool Find(const std::string &name, ClientRef &ref) const;
+    bool Find(uint64_t sessionId, ClientRef &ref) const;
+};
+
+// 发布当前快照不用 std::atomic_load/atomic_store(shared_ptr): libstdc++ 用一个全局的自旋锁池实现它们,
+// 读者会在看不见的锁上互相等待。这里按 RCU 的做法发布裸指针: 读者在 Find 期间把当前阶段的计数加一;
+// 写者换上新快照后翻转阶段, 旧快照先留着, 两个阶段的计数在换上之后都被看到过归零 (宽限期已过) 才释放。
+// 读者只做两次原子加减, 不等任何锁; 写者一般不等读者, 只有积压的旧快照过多时才让出 CPU 等读者退出
+class Roster {
+public:
+    Roster();
+
+    // 读者: 在当前快照中按用户名或用户 ID 查找, 查找期间快照不会被释放
+    bool Find(const std::string &name, ClientRef &ref) const;
+    bool Find(uint64_t sessionId, ClientRef &ref) const;
+
+    // 写者: 由当前快照生成修改后的快照 (共享未改动的部分), 发布后等宽限期结束再释放旧快照; 写者之间用互斥锁串行
+    // 返回本次修改产生的快照; 用户名已被占用时返回空, 表不变
+    std::shared_ptr<const RosterSnapshot> Add(const ClientContext &client);
+    // 该会话不在表中时返回空 (按用户名定位, 再核对 sessionId)
+    std::shared_ptr<const RosterSnapshot> Remove(const std::string &name, uint64_t sessionId);
+
+private:
+    // 在读者区间内对已发布的快照调用 lookup
+    template <typename Lookup>
+    bool Read(Lookup lookup) const
+    {
+        unsigned phase = epoch.load() & 1;
+        readers[phase].count.fetch_add(1);
+        bool found = lookup(*published.load());
+        readers[phase].count.fetch_sub(1);
+        return found;
+    }
+    void Publish(std::shared_ptr<const RosterSnapshot> next);
+    void Reclaim();
+
+    static const size_t RETIRED_MAX = 64; // 等待宽限期的旧快照超过这么多个时写者等读者退出
+
+    // 换下的快照与尚未看到计数归零的阶段 (位掩码)
+    struct Retired {
+        std::shared_ptr<const RosterSnapshot> snapshot;
+        unsigned pendingPhases;
+    };
+
+    // 两个阶段的计数各占一个缓存行, 新进入的读者与正在退出的读者不争同一行
+    struct alignas(64) ReaderCount {
+        std::atomic<uint64_t> count{0};
+    };
+
+    std::atomic<const RosterSnapshot *> published;
+    std::atomic<unsigned> epoch{0};
+    mutable ReaderCount readers[2];
+    // 以下只在 writeMutex 内访问
+    std::shared_ptr<const RosterSnapshot> current; // 已发布的快照
+    std::vector<Retired> retired;
+    std::mutex writeMutex;
+};
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * Description: SHA-256 摘要, 用作文件仓库中的内容地址
+ * Author: 夏凡
+ * Create: 2025-12-16
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class Sha256 {
+public:
+    Sha256();
+
+    void Update(const void *data, size_t len);
+    // 结束计算, 返回 64 位小写十六进制; 之后不能再 Update
+    std::string HexDigest();
+
+private:
+    void Transform(const uint8_t *block);
+
+    uint32_t state[8];
+    uint64_t length = 0; // 已输入的字节数
+    uint8_t buffer[64];
+    size_t bufferLen = 0;
+};
+
+#endif
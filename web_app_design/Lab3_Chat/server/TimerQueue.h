@@ -0,0 +1,87 @@
+/*
+ * Description: 事件循环的定时任务表, 只在循环线程内使用; 内核定时器 (timerfd 或 io_uring 超时) 由各循环自己设置
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#ifndef TIMER_QUEUE_H
+#define TIMER_QUEUE_H
+
+#include <cstdint>
+#include <ctime>
+#include <utility>
+#include <vector>
+#include "InlineTask.h"
+
+class TimerQueue {
+public:
+    // CLOCK_MONOTONIC 当前时刻 (微秒)
+    static uint64_t Now()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+    }
+
+    // 登记 micros 微秒后执行的任务; 返回 true 表示它早于内核定时器当前的到期时刻, 调用方应按 Armed() 重设
+    bool Add(uint32_t micros, InlineTask task)
+    {
+        uint64_t deadline = Now() + micros;
+        timers.push_back({deadline, std::move(task)});
+        if (armedAt != 0 && armedAt <= deadline) {
+            return false;
+        }
+        armedAt = deadline;
+        return true;
+    }
+
+    // 内核定时器到期: 执行到期的任务 (任务中登记的新任务留到下一次);
+    // 返回 true 表示还有任务, 调用方应按 Armed() 重新设置内核定时器
+    bool RunDue()
+    {
+        armedAt = 0;
+        uint64_t now = Now();
+        size_t kept = 0;
+        for (size_t i = 0; i < timers.size(); ++i) {
+            if (timers[i].deadline <= now) {
+                due.push_back(std::move(timers[i].task));
+            } else if (kept++ != i) {
+                timers[kept - 1] = std::move(timers[i]);
+            }
+        }
+        timers.resize(kept);
+        for (InlineTask &task : due) {
+            task();
+        }
+        due.clear();
+        uint64_t earliest = 0;
+        for (const Timer &timer : timers) {
+            if (earliest == 0 || timer.deadline < earliest) {
+                earliest = timer.deadline;
+            }
+        }
+        if (earliest == 0 || (armedAt != 0 && armedAt <= earliest)) {
+            return false; // 没有剩余任务, 或任务中登记新任务时已设置得更早
+        }
+        armedAt = earliest;
+        return true;
+    }
+
+    // 内核定时器应设置的到期时刻 (微秒)
+    uint64_t Armed() const
+    {
+        return armedAt;
+    }
+
+private:
+    struct Timer {
+        uint64_t deadline;
+        InlineTask task;
+    };
+
+    std::vector<Timer> timers;
+    std::vector<InlineTask> due; // 本次到期的任务, 留着容量, 微批窗口的定时器每次到期不再分配
+    uint64_t armedAt = 0; // 0 为未设置
+};
+
+#endif
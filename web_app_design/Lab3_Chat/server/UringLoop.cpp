@@ -0,0 +1,545 @@
+/*
+ * Description: io_uring 事件循环实现, 直接使用系统调用, 不依赖 liburing
+ * Author: 夏凡
+ * Create: 2025-12-11
+ */
+
+#include "UringLoop.h"
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+const unsigned RING_ENTRIES = 1024;
+const unsigned BUF_COUNT = 512;       // 接收缓冲块个数 (2 的幂)
+const unsigned BUF_SIZE = 16 * 1024;  // 每块大小
+const uint16_t BUF_GROUP = 0;
+
+// user_data 编码: 低 3 位为标记; 标记为 0 时整个值是 SendOp 指针 (8 字节对齐)
+enum OpTag : uint64_t {
+    TAG_SEND = 0,
+    TAG_RECV = 1,
+    TAG_ACCEPT = 2,
+    TAG_WAKEUP = 3,
+    TAG_CANCEL = 4,
+    TAG_TIMER = 5
+};
+
+struct UringLoop::SendOp {
+    int fd;
+    uint32_t gen;
+    FrameBatch frames;
+    size_t offset; // 已发出的字节数 (跨帧累计)
+    iovec iov[UringLoop::MAX_SEND_BATCH];
+    msghdr msg;
+
+    // 每次发送一个, 从缓冲区池分配
+    static void *operator new(size_t size)
+    {
+        return PoolAlloc(size);
+    }
+    static void operator delete(void *ptr)
+    {
+        PoolFree(ptr);
+    }
+};
+
+static uint64_t EncodeUserData(int fd, uint32_t gen, OpTag tag)
+{
+    return ((uint64_t)(uint32_t)fd << 32) | ((uint64_t)(gen & 0xFFFFFF) << 8) | tag;
+}
+
+static int SysSetup(unsigned entries, io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int SysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+static int SysRegister(int fd, unsigned opcode, void *arg, unsigned nrArgs)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+UringLoop::UringLoop()
+    : ringFd(-1), wakeupFd(-1), wakeupValue(0),
+      sqRingPtr(MAP_FAILED), sqRingSize(0), cqRingPtr(MAP_FAILED), cqRingSize(0),
+      sqes(nullptr), sqesSize(0), sqTail(nullptr), sqMask(0), sqEntries(0), sqHead(nullptr),
+      localSqTail(0), sqPending(0), cqHead(nullptr), cqTail(nullptr), cqMask(0), cqes(nullptr),
+      bufRing(nullptr), bufRingSize(0), bufBase(nullptr), bufTail(0), wakeupPending(false)
+{
+}
+
+UringLoop::~UringLoop()
+{
+    if (bufBase != nullptr) {
+        munmap(bufBase, (size_t)BUF_COUNT * BUF_SIZE);
+    }
+    if (bufRing != nullptr) {
+        munmap(bufRing, bufRingSize);
+    }
+    if (sqes != nullptr) {
+        munmap(sqes, sqesSize);
+    }
+    if (cqRingPtr != MAP_FAILED && cqRingPtr != sqRingPtr) {
+        munmap(cqRingPtr, cqRingSize);
+    }
+    if (sqRingPtr != MAP_FAILED) {
+        munmap(sqRingPtr, sqRingSize);
+    }
+    if (wakeupFd != -1) {
+        close(wakeupFd);
+    }
+    if (ringFd != -1) {
+        close(ringFd);
+    }
+}
+
+bool UringLoop::Init()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = RING_ENTRIES * 4;
+    ringFd = SysSetup(RING_ENTRIES, &params);
+    if (ringFd == -1) {
+        perror("io_uring_setup failed");
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap && cqRingSize > sqRingSize) {
+        sqRingSize = cqRingSize;
+    }
+    sqRingPtr = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ringFd, IORING_OFF_SQ_RING);
+    if (sqRingPtr == MAP_FAILED) {
+        perror("mmap sq ring failed");
+        return false;
+    }
+    cqRingPtr = singleMmap ? sqRingPtr :
+        mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    if (cqRingPtr == MAP_FAILED) {
+        perror("mmap cq ring failed");
+        return false;
+    }
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqePtr = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ringFd, IORING_OFF_SQES);
+    if (sqePtr == MAP_FAILED) {
+        perror("mmap sqes failed");
+        return false;
+    }
+    sqes = (io_uring_sqe *)sqePtr;
+
+    char *sq = (char *)sqRingPtr;
+    char *cq = (char *)cqRingPtr;
+    sqHead = (unsigned *)(sq + params.sq_off.head);
+    sqTail = (unsigned *)(sq + params.sq_off.tail);
+    sqMask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    sqEntries = *(unsigned *)(sq + params.sq_off.ring_entries);
+    localSqTail = *sqTail;
+    // SQ 索引数组与 SQE 一一对应, 之后只需推进 tail
+    unsigned *array = (unsigned *)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sqEntries; ++i) {
+        array[i] = i;
+    }
+    cqHead = (unsigned *)(cq + params.cq_off.head);
+    cqTail = (unsigned *)(cq + params.cq_off.tail);
+    cqMask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // 注册接收缓冲环: 多路 recv 每次由内核从环中挑一块空闲缓冲
+    bufRingSize = BUF_COUNT * sizeof(io_uring_buf);
+    void *ringMem = mmap(nullptr, bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void *bufMem = mmap(nullptr, (size_t)BUF_COUNT * BUF_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ringMem == MAP_FAILED || bufMem == MAP_FAILED) {
+        perror("mmap buffer ring failed");
+        return false;
+    }
+    bufRing = (io_uring_buf_ring *)ringMem;
+    bufBase = (char *)bufMem;
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)bufRing;
+    reg.ring_entries = BUF_COUNT;
+    reg.bgid = BUF_GROUP;
+    if (SysRegister(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        perror("io_uring register buffer ring failed");
+        return false;
+    }
+    for (unsigned i = 0; i < BUF_COUNT; ++i) {
+        RecycleBuffer((uint16_t)i);
+    }
+
+    wakeupFd = eventfd(0, EFD_CLOEXEC);
+    if (wakeupFd == -1) {
+        perror("eventfd failed");
+        return false;
+    }
+    ArmWakeup();
+    return true;
+}
+
+io_uring_sqe *UringLoop::GetSqe()
+{
+    if (localSqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+        // 提交队列已满: 先提交一批, 不等待完成
+        SubmitPending();
+    }
+    io_uring_sqe *sqe = &sqes[localSqTail & sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    ++localSqTail;
+    ++sqPending;
+    return sqe;
+}
+
+void UringLoop::SubmitPending()
+{
+    __atomic_store_n(sqTail, localSqTail, __ATOMIC_RELEASE);
+    while (sqPending > 0) {
+        int ret = SysEnter(ringFd, sqPending, 0, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            perror("io_uring_enter failed");
+            return;
+        }
+        sqPending -= ret;
+    }
+}
+
+void UringLoop::RecycleBuffer(uint16_t bid)
+{
+    // 不能用 bufRing->bufs: 该柔性数组在 C++ 下会被编译器后移 8 字节,
+    // 按内核布局, 第一项与 tail 共用起始的 16 字节
+    io_uring_buf *entries = reinterpret_cast<io_uring_buf *>(bufRing);
+    io_uring_buf *buf = &entries[bufTail & (BUF_COUNT - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(bufBase + (size_t)bid * BUF_SIZE);
+    buf->len = BUF_SIZE;
+    buf->bid = bid;
+    ++bufTail;
+    __atomic_store_n(&bufRing->tail, bufTail, __ATOMIC_RELEASE);
+}
+
+void UringLoop::ArmWakeup()
+{
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeupFd;
+    sqe->addr = (uint64_t)(uintptr_t)&wakeupValue;
+    sqe->len = sizeof(wakeupValue);
+    sqe->user_data = EncodeUserData(wakeupFd, 0, TAG_WAKEUP);
+}
+
+// 超时在提交时由内核读取 timerSpec; 同一轮里重设两次时两个超时都按较早的时刻, 同样无害
+void UringLoop::ArmTimer()
+{
+    uint64_t deadline = timers.Armed();
+    timerSpec.tv_sec = (int64_t)(deadline / 1000000);
+    timerSpec.tv_nsec = (long long)(deadline % 1000000) * 1000;
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)&timerSpec;
+    sqe->len = 1;
+    sqe->timeout_flags = IORING_TIMEOUT_ABS;
+    sqe->user_data = EncodeUserData(0, 0, TAG_TIMER);
+}
+
+void UringLoop::ArmAccept(int listenFd)
+{
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenFd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = EncodeUserData(listenFd, 0, TAG_ACCEPT);
+}
+
+void UringLoop::ArmRecv(int fd)
+{
+    fds[fd].recvArmed = true;
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = EncodeUserData(fd, fds[fd].gen, TAG_RECV);
+}
+
+bool UringLoop::AddAcceptor(int listenFd, AcceptHandler handler)
+{
+    if (listenFd >= (int)acceptors.size()) {
+        acceptors.resize(listenFd + 1);
+    }
+    acceptors[listenFd] = std::move(handler);
+    ArmAccept(listenFd);
+    return true;
+}
+
+void UringLoop::AddConnection(int fd, ReadHandler onRead, Task onWritable)
+{
+    if (fd >= (int)fds.size()) {
+        fds.resize(fd + 1);
+    }
+    FdState &st = fds[fd];
+    st.active = true;
+    st.sending = false;
+    st.recvPaused = false;
+    st.onRead = std::move(onRead);
+    st.onWritable = std::move(onWritable);
+    ArmRecv(fd);
+}
+
+void UringLoop::RemoveConnection(int fd)
+{
+    if (fd >= (int)fds.size() || !fds[fd].active) {
+        return;
+    }
+    FdState &st = fds[fd];
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = EncodeUserData(fd, st.gen, TAG_RECV);
+    sqe->user_data = EncodeUserData(fd, 0, TAG_CANCEL);
+
+    // gen 递增后, 旧连接残留的完成事件都会被识别为过期并丢弃
+    ++st.gen;
+    st.active = false;
+    st.sending = false;
+    st.onRead = nullptr;
+    st.onWritable = nullptr;
+    // 让在途的 recv/send 立即结束, 内核才会释放对 socket 的引用
+    shutdown(fd, SHUT_RDWR);
+}
+
+void UringLoop::PauseRecv(int fd)
+{
+    if (fd >= (int)fds.size() || !fds[fd].active || fds[fd].recvPaused) {
+        return;
+    }
+    FdState &st = fds[fd];
+    st.recvPaused = true;
+    if (!st.recvArmed) {
+        return;
+    }
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = EncodeUserData(fd, st.gen, TAG_RECV);
+    sqe->user_data = EncodeUserData(fd, 0, TAG_CANCEL);
+}
+
+// 取消还没结束时不重复挂 recv, 等它结束后由 HandleRecv 重新挂上
+void UringLoop::ResumeRecv(int fd)
+{
+    if (fd >= (int)fds.size() || !fds[fd].active || !fds[fd].recvPaused) {
+        return;
+    }
+    fds[fd].recvPaused = false;
+    if (!fds[fd].recvArmed) {
+        ArmRecv(fd);
+    }
+}
+
+bool UringLoop::IsSending(int fd) const
+{
+    return fd < (int)fds.size() && fds[fd].sending;
+}
+
+void UringLoop::Send(int fd, FrameBatch frames)
+{
+    if (fd >= (int)fds.size() || !fds[fd].active || fds[fd].sending || frames.empty()) {
+        return;
+    }
+    FdState &st = fds[fd];
+    SendOp *op = new SendOp();
+    op->fd = fd;
+    op->gen = st.gen;
+    op->frames = std::move(frames);
+    if (op->frames.size() > MAX_SEND_BATCH) {
+        op->frames.resize(MAX_SEND_BATCH);
+    }
+    op->offset = 0;
+    st.sending = true;
+    SubmitSend(op);
+}
+
+void UringLoop::SubmitSend(SendOp *op)
+{
+    // 跳过已发出的部分, 余下的帧各占一个 iovec
+    size_t skip = op->offset;
+    size_t count = 0;
+    for (auto &frame : op->frames) {
+        if (skip >= frame.Size()) {
+            skip -= frame.Size();
+            continue;
+        }
+        op->iov[count].iov_base = (void *)(frame.Data() + skip);
+        op->iov[count].iov_len = frame.Size() - skip;
+        skip = 0;
+        ++count;
+    }
+    memset(&op->msg, 0, sizeof(op->msg));
+    op->msg.msg_iov = op->iov;
+    op->msg.msg_iovlen = count;
+
+    io_uring_sqe *sqe = GetSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = op->fd;
+    sqe->addr = (uint64_t)(uintptr_t)&op->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uint64_t)(uintptr_t)op;
+}
+
+void UringLoop::HandleSend(SendOp *op, int res)
+{
+    int fd = op->fd;
+    FdState &st = fds[fd];
+    if (!st.active || st.gen != op->gen) {
+        delete op;
+        return;
+    }
+    if (res <= 0) {
+        delete op;
+        st.sending = false;
+        ReadHandler handler = st.onRead;
+        handler(nullptr, 0);
+        return;
+    }
+    op->offset += res;
+    size_t total = 0;
+    for (auto &frame : op->frames) {
+        total += frame.Size();
+    }
+    if (op->offset < total) {
+        SubmitSend(op);
+        return;
+    }
+    delete op;
+    st.sending = false;
+    Task handler = st.onWritable;
+    handler();
+}
+
+void UringLoop::HandleRecv(int fd, uint32_t gen, const io_uring_cqe &cqe)
+{
+    bool hasBuffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+    uint16_t bid = (uint16_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    bool current = fd < (int)fds.size() && fds[fd].active && (fds[fd].gen & 0xFFFFFF) == gen;
+
+    if (current) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            fds[fd].recvArmed = false;
+        }
+        ReadHandler handler = fds[fd].onRead;
+        if (cqe.res > 0 && hasBuffer) {
+            handler(bufBase + (size_t)bid * BUF_SIZE, (size_t)cqe.res);
+        } else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+            handler(nullptr, 0);
+        }
+    }
+    if (hasBuffer) {
+        RecycleBuffer(bid);
+    }
+    // 多路 recv 被内核终止 (如缓冲暂时用尽, 或暂停时被取消) 时, 未暂停就重新挂上
+    bool stillCurrent = fd < (int)fds.size() && fds[fd].active && (fds[fd].gen & 0xFFFFFF) == gen;
+    if (stillCurrent && !fds[fd].recvArmed && !fds[fd].recvPaused) {
+        ArmRecv(fd);
+    }
+}
+
+void UringLoop::HandleCompletion(const io_uring_cqe &cqe)
+{
+    uint64_t tag = cqe.user_data & 0x7;
+    if (tag == TAG_SEND) {
+        HandleSend((SendOp *)(uintptr_t)cqe.user_data, cqe.res);
+        return;
+    }
+    int fd = (int)(cqe.user_data >> 32);
+    uint32_t gen = (uint32_t)((cqe.user_data >> 8) & 0xFFFFFF);
+    if (tag == TAG_RECV) {
+        HandleRecv(fd, gen, cqe);
+    } else if (tag == TAG_ACCEPT) {
+        if (cqe.res >= 0 && fd < (int)acceptors.size() && acceptors[fd]) {
+            AcceptHandler handler = acceptors[fd];
+            handler(cqe.res);
+        }
+        if (!(cqe.flags & IORING_CQE_F_MORE)) {
+            ArmAccept(fd);
+        }
+    } else if (tag == TAG_WAKEUP) {
+        ArmWakeup();
+    } else if (tag == TAG_TIMER && timers.RunDue()) {
+        ArmTimer();
+    }
+}
+
+void UringLoop::RunInLoop(Task task)
+{
+    pendingTasks.Push(std::move(task));
+    if (wakeupPending.exchange(true)) {
+        return;
+    }
+    uint64_t one = 1;
+    ssize_t n = write(wakeupFd, &one, sizeof(one));
+    (void)n;
+}
+
+void UringLoop::RunAfter(uint32_t micros, Task task)
+{
+    if (timers.Add(micros, std::move(task))) {
+        ArmTimer();
+    }
+}
+
+void UringLoop::RunPendingTasks()
+{
+    // 先清标志再取任务: 清标志之后投递的任务一定会再次唤醒
+    wakeupPending.store(false);
+    Task task;
+    while (pendingTasks.Pop(task)) {
+        task();
+    }
+}
+
+void UringLoop::Loop()
+{
+    while (true) {
+        // 本轮积攒的所有 SQE 与等待完成合并为一次 io_uring_enter
+        __atomic_store_n(sqTail, localSqTail, __ATOMIC_RELEASE);
+        int ret = SysEnter(ringFd, sqPending, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                perror("io_uring_enter failed");
+                break;
+            }
+        } else {
+            sqPending -= ret;
+        }
+
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            io_uring_cqe cqe = cqes[head & cqMask];
+            ++head;
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            HandleCompletion(cqe);
+        }
+        RunPendingTasks();
+    }
+}
@@ -0,0 +1,120 @@
+/*
+ * Description: 基于 io_uring 的事件循环 (CHAT_USE_IO_URING 构建选项启用)
+ *              多路 recv + 注册缓冲环, 发送批量提交, 每轮循环只进入内核一次
+ * Author: 夏凡
+ * Create: 2025-12-11
+ */
+
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <linux/io_uring.h>
+#include "Frame.h"
+#include "InlineTask.h"
+#include "Mailbox.h"
+#include "TimerQueue.h"
+
+class UringLoop {
+public:
+    using Task = InlineTask;
+    using AcceptHandler = std::function<void(int fd)>;
+    // len > 0 为收到的数据 (只在回调期间有效); len == 0 表示对端关闭或出错
+    using ReadHandler = std::function<void(const char *data, size_t len)>;
+
+    UringLoop();
+    ~UringLoop();
+
+    bool Init();
+    void Loop();
+
+    // 线程安全(无锁): 投递任务到循环线程, 本轮完成事件处理完后执行
+    void RunInLoop(Task task);
+    // 仅限循环线程: 约 micros 微秒后执行 (不早于)
+    void RunAfter(uint32_t micros, Task task);
+
+    bool AddAcceptor(int listenFd, AcceptHandler handler);
+    // onWritable 在一批帧全部发出后调用, 相当于 epoll 的 EPOLLOUT
+    void AddConnection(int fd, ReadHandler onRead, Task onWritable);
+    // 取消该连接上未完成的收发, 返回后调用方即可 close(fd)
+    void RemoveConnection(int fd);
+    // 暂停/恢复接收: 暂停时取消多路 recv, 取消生效前已收到的数据仍会交给 onRead
+    void PauseRecv(int fd);
+    void ResumeRecv(int fd);
+
+    // 同一连接同时只有一个 sendmsg 在途; 在途期间调用方自行排队
+    bool IsSending(int fd) const;
+    // 一批帧作为 iovec 一次提交 (最多 MAX_SEND_BATCH 帧)
+    void Send(int fd, FrameBatch frames);
+
+    static const size_t MAX_SEND_BATCH = 64;
+
+private:
+    struct FdState {
+        uint32_t gen = 0;
+        bool active = false;
+        bool sending = false;
+        bool recvArmed = false;  // 多路 recv 在途 (尚未收到不带 F_MORE 的完成事件)
+        bool recvPaused = false;
+        ReadHandler onRead;
+        Task onWritable;
+    };
+    struct SendOp;
+
+    io_uring_sqe *GetSqe();
+    void SubmitPending();
+    void ArmRecv(int fd);
+    void ArmAccept(int listenFd);
+    void ArmWakeup();
+    void SubmitSend(SendOp *op);
+    void RecycleBuffer(uint16_t bid);
+    void HandleCompletion(const io_uring_cqe &cqe);
+    void HandleRecv(int fd, uint32_t gen, const io_uring_cqe &cqe);
+    void HandleSend(SendOp *op, int res);
+    void RunPendingTasks();
+    void ArmTimer();
+
+    int ringFd;
+    int wakeupFd;
+    uint64_t wakeupValue;
+
+    // SQ/CQ 映射
+    void *sqRingPtr;
+    size_t sqRingSize;
+    void *cqRingPtr;
+    size_t cqRingSize;
+    io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned *sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned *sqHead;
+    unsigned localSqTail;
+    unsigned sqPending;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned cqMask;
+    io_uring_cqe *cqes;
+
+    // 注册给内核的接收缓冲环
+    io_uring_buf_ring *bufRing;
+    size_t bufRingSize;
+    char *bufBase;
+    uint16_t bufTail;
+
+    std::vector<FdState> fds;                // 下标即 fd
+    std::vector<AcceptHandler> acceptors;    // 下标即监听 fd
+
+    Mailbox<Task> pendingTasks;
+    std::atomic<bool> wakeupPending;
+
+    // 定时任务: 每次需要更早到期时提交一个 IORING_OP_TIMEOUT, 晚到期的那个完成时没有到期任务, 无害
+    TimerQueue timers;
+    __kernel_timespec timerSpec;
+};
+
+#endif
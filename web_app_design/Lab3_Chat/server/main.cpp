@@ -7,268 +7,1847 @@
 #include <iostream>
 #include <vector>
 #include <thread>
-#include <mutex>
-#include <map>
+#include <memory>
+#include <atomic>
 #include <algorithm>
+#include <unordered_map>
+#include <charconv>
+#include <string_view>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
 #include <arpa/inet.h>
 #include <cstdlib>
+#include "../common/Crc32c.h"
+#include "../common/Lz.h"
 #include "../common/Protocol.h"
+#include "BufferPool.h"
+#include "EventLoop.h"
+#include "FileStore.h"
+#include "FlowControl.h"
+#include "Frame.h"
+#include "OutboundQueue.h"
+#include "Presence.h"
+#include "Roster.h"
+#ifdef CHAT_USE_IO_URING
+#include "UringLoop.h"
+using IoLoop = UringLoop;
+#else
+using IoLoop = EventLoop;
+#endif
 
-// 常量定义 
-const int MAX_BUFFER_SIZE = 1024 * 10;
-const int LISTEN_BACKLOG = 10;
+// 常量定义
+const int MAX_BUFFER_SIZE = 1024 * 10;     // 登录前及未协商文件块大小时的包体上限
+const size_t BODY_POOL_THRESHOLD = 64 * 1024; // 超过该容量的包体缓冲区用完归还分片
+const size_t BODY_POOL_MAX = 16;              // 每个分片最多留存的大缓冲区
+const size_t READ_BUDGET = 256 * 1024;        // 一次可读事件最多处理的字节, 超过后让其他连接先处理
+const size_t READ_CHUNK = 64 * 1024;          // 分片读缓冲区大小, 一次 recv 取回多个小包
+const size_t DIRECT_READ_MIN = 16 * 1024;     // 包体剩余不少于该值时直接读进包体缓冲区, 不经读缓冲区中转
+const int LISTEN_BACKLOG = SOMAXCONN;
+const size_t MAX_TRANSFERS_PER_CONN = 64; // 每个连接同时进行的发送数上限
+const uint32_t BATCH_WINDOW_MIN_US = 25;  // 微批窗口从这里起步, 减半到这以下归零
+const size_t BATCH_BUSY_PUSHES = 2;       // 一次刷新平均每个连接攒下这么多条消息时加大窗口
+const size_t BUNDLE_MAX_BYTES = 16 * 1024; // 分片广播批次攒到这么大时立即封口
 
-struct ClientContext {
+// 一路文件传输的去向
+struct FileRoute {
+    ClientRef target;                 // fd 为 -1 代表群发
+    std::shared_ptr<SplicePipe> pipe; // 仅一对一且开启 --splice 时非空
+
+    // 群发先整体上传到仓库, 仓库中已有相同内容时 blob 非空, 不再上传
+    std::string fileName;
+    std::shared_ptr<StoreUpload> upload;
+    std::shared_ptr<const StoreBlob> blob;
+    bool rewindRequested = false;
+};
+
+// 一个接收方正在接收的仓库文件, 按该接收方自己的速度发送
+struct FileServe {
+    std::shared_ptr<const StoreBlob> blob;
+    uint32_t transferId = 0;
+    int32_t senderId = -1;
+    std::string senderName;
+    int64_t offset = -1; // 下一块的偏移; -1 表示在等接收方的续传应答或完成确认
+};
+
+// 连接的读写状态, 只由所属分片线程访问
+struct Connection {
     int socketFd;
-    std::string name;
+    uint64_t sessionId;
+    std::string name = "Unknown";
+    bool loggedIn = false;
+    size_t liveIndex = 0; // 在 ConnTable::live 中的位置
+
+    // 协议版本: 登录应答之后按 protocol 发送, 收到 MSG_PROTOCOL 之后按 recvProtocol 解析
+    int protocol = PROTOCOL_V1;
+    int recvProtocol = PROTOCOL_V1;
+    int features = 0; // 登录时协商的 FEATURE_*
+    std::unique_ptr<LzDecoder> inflater; // 协商了压缩时解开带 COMPRESSED_FLAG 的消息
+
+    // 增量解码状态: 先收满包头, 再收满包体; 跨多次读取的半个包保存在这里, 读缓冲区本身不留残余
+    // v2 包头先攒在 wireHead 里, 解出后同样转成 header, 此后两种版本走同一条路径
+    MsgHeader header;
+    size_t headerRead = 0;
+    char wireHead[V2_HEADER_MAX];
+    size_t wireHeadLen = 0;
+    std::string body;
+    size_t bodyRead = 0;
+    // 包体原样转发的消息直接读进池化的帧 (包头位置已写好), 分发时按引用扇出, 此时 body 不用
+    FrameRef inFrame;
+    char *inBody = nullptr;
+    size_t maxBodyLen = MAX_BUFFER_SIZE; // 登录时按协商的文件块大小放宽
+
+    // 待发送的帧 (与其他接收方共享), 有界, 超限按 g_queueLimits 策略处理
+    OutboundQueue outQueue;
+    bool dirty = false;        // 已登记到分片的待刷新列表
+    bool writeBlocked = false; // 内核发送缓冲区已满, 等 EPOLLOUT
+    bool closing = false;
+    bool closeAfterFlush = false; // 发完队列中的帧再关闭
+
+    // 文件传输路由表: 发送方自选的传输 ID -> 去向, 多路传输可同时进行
+    std::unordered_map<uint32_t, FileRoute> fileRoutes;
+    // 从仓库发给本连接的文件, 发送队列低于低水位时轮流补一块
+    std::vector<FileServe> serves;
+    size_t serveCursor = 0;
+
+    // splice 转发: 一对一路由的文件块只解析包头和传输 ID, 其余包体经管道直接送到接收方
+    bool relayProbe = false;    // 正在读取包体开头的传输 ID
+    bool relaying = false;      // 当前包体走转发路径
+    uint32_t relayId = 0;
+    ClientRef relayTarget;
+    std::shared_ptr<SplicePipe> relayPipe;
+    bool relaySplicing = false; // 仍在往管道里 splice
+    size_t relayPipeBytes = 0;  // 当前包体已进入管道的字节
+
+    // 一对一转发的额度, 第一次向他人发文件时创建; 用尽时暂停读取本连接
+    std::shared_ptr<UploadCredit> credit;
 };
 
-// 全局状态 
-std::vector<ClientContext> g_clients;
-std::mutex g_clientsMutex;
+// 分片内的连接表: fd 直接作下标查找, 另有紧凑数组供广播遍历
+class ConnTable {
+public:
+    Connection *Find(int fd) const
+    {
+        return (fd >= 0 && fd < (int)byFd.size()) ? byFd[fd].get() : nullptr;
+    }
+
+    Connection &Insert(int fd)
+    {
+        if (fd >= (int)byFd.size()) {
+            byFd.resize(fd + 1);
+        }
+        byFd[fd].reset(new Connection());
+        Connection *conn = byFd[fd].get();
+        conn->socketFd = fd;
+        conn->liveIndex = live.size();
+        live.push_back(conn);
+        return *conn;
+    }
+
+    // 与末尾元素交换后删除, 遍历顺序因此会变化
+    void Erase(int fd)
+    {
+        Connection *conn = Find(fd);
+        if (conn == nullptr) {
+            return;
+        }
+        Connection *last = live.back();
+        live[conn->liveIndex] = last;
+        last->liveIndex = conn->liveIndex;
+        live.pop_back();
+        byFd[fd].reset();
+    }
+
+    size_t Size() const
+    {
+        return live.size();
+    }
+    Connection &At(size_t i) const
+    {
+        return *live[i];
+    }
+
+private:
+    std::vector<std::unique_ptr<Connection>> byFd;
+    std::vector<Connection *> live;
+};
+
+// 每个分片独占一个线程、一个 EventLoop 和一个 SO_REUSEPORT 监听套接字
+struct Shard {
+    int index;
+    int listenFd = -1;
+    IoLoop loop;
+    ConnTable conns;
+
+    // 本轮有新帧入队的连接, 事件处理完后统一刷新, 多帧合并成一次 sendmsg
+    // 两个数组轮流使用, 容量保留下来, 刷新时不再分配
+    std::vector<int> dirtyFds;
+    std::vector<int> flushingFds;
+    bool flushScheduled = false;
+    // 微批窗口: 聊天与控制消息的刷新推迟 batchWindowUs 微秒, 让同一连接攒下多条消息合成一帧、一次 sendmsg;
+    // 每次刷新按这段时间内平均每个连接收到的消息数调整, 空闲时降到 0 (不推迟)
+    uint32_t batchWindowUs = 0;
+    bool flushDeferred = false;
+    size_t batchPushes = 0; // 上次刷新以来入队的聊天与控制消息
+    // 发给协商了 FEATURE_BATCH 的连接的广播在这里按 v2 子帧拼接, 刷新时封成一个 MSG_BUNDLE,
+    // 这些连接共享同一帧的引用: 每条广播只编码一次, 不再逐连接入队
+    std::string bundle;
+    size_t bundleMessages = 0;
+
+    // 大包体的缓冲区在分片内复用: 空闲连接不长期占着 1MB, 大文件块也不必每次重新分配
+    std::vector<std::string> bodyPool;
+
+#ifndef CHAT_USE_IO_URING
+    // 读缓冲区: 一次 recv 尽量多读, 读到的字节当场解码完, 所以整个分片共用一块
+    std::vector<char> readBuf = std::vector<char>(READ_CHUNK);
+#endif
+};
+
+// 全局状态
+std::vector<std::unique_ptr<Shard>> g_shards;
+thread_local Shard *t_shard = nullptr;
+std::atomic<uint64_t> g_nextSessionId(1);
+bool g_zeroCopy = false; // --zerocopy: 大帧使用 MSG_ZEROCOPY 发送
+bool g_spliceRelay = false; // --splice: 一对一文件块经管道 splice 转发 (仅 epoll 后端)
+int g_maxProtocol = PROTOCOL_V2; // --protocol=1: 不与客户端协商 v2, 全部按 v1 收发
+int g_features = FEATURE_COMPRESS | FEATURE_BATCH; // --compress=0 / --batch=0: 不与客户端协商对应的功能
+// --batch-window=微秒: 微批窗口的上限 (0 为不推迟刷新); 空闲时窗口为 0, 新帧在本轮事件处理完后立即发出
+uint32_t g_batchWindowMaxUs = 200;
+int g_maxChunkSize = MAX_FILE_CHUNK_SIZE; // --max-chunk=字节: 与客户端协商文件块大小的上限
+// --notsent-lowat=字节: 内核中未发出的字节超过该值时不再接受写入 (0 为不限),
+// 让积压留在用户态的发送队列里, 聊天消息才能按优先级排到文件块前面
+int g_notsentLowat = 128 * 1024;
+size_t g_relayWindow = 4 * 1024 * 1024; // --relay-window=字节: 每个上传连接转发中的字节上限
+std::string g_storeDir = "chat_store"; // --store=目录: 群发文件的仓库
+
+// 在线用户表, 跨分片共享; 读者取快照, 不加锁
+Roster g_roster;
+// 上线/下线通知按窗口合并后再广播
+PresenceAggregator g_presence;
+int g_presenceWindowMs = 50;
+const size_t PRESENCE_NAMES_SHOWN = 5; // 合并通知中最多列出的名字数
+
+void CloseClient(Shard &shard, int clientFd);
+void UnwatchClient(Shard &shard, int clientFd);
+void RefillServes(Shard &shard, Connection &conn);
+void HandleReadable(Shard &shard, Connection &conn);
+
+// 辅助：非阻塞地读取固定长度, got 记录已读字节, 跨多次可读事件累计
+// 返回 false 表示连接断开; done 表示 len 字节已收齐
+bool RecvFixedLen(int sockfd, char *buf, size_t len, size_t &got, bool &done)
+{
+    done = false;
+    while (got < len) {
+        ssize_t received = recv(sockfd, buf + got, len - got, 0);
+        if (received > 0) {
+            got += received;
+            continue;
+        }
+        if (received == -1 && errno == EINTR) {
+            continue;
+        }
+        if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        return false;
+    }
+    done = true;
+    return true;
+}
+
+// 尽量发出排队的帧, 剩余部分等 EPOLLOUT 再发
+// io_uring 后端下每次取一批帧交给事件循环, 这批发完后回调本函数取下一批
+void FlushClient(Shard &shard, Connection &conn)
+{
+#ifdef CHAT_USE_IO_URING
+    if (shard.loop.IsSending(conn.socketFd)) {
+        return;
+    }
+    FrameBatch batch;
+    conn.outQueue.TakeBatch(batch, UringLoop::MAX_SEND_BATCH);
+    if (!batch.empty()) {
+        shard.loop.Send(conn.socketFd, std::move(batch));
+    } else if (conn.closeAfterFlush) {
+        CloseClient(shard, conn.socketFd);
+    } else if (!conn.serves.empty()) {
+        RefillServes(shard, conn);
+    }
+#else
+    if (conn.writeBlocked) {
+        return;
+    }
+    OutboundQueue::FlushResult result = conn.outQueue.Flush(conn.socketFd, g_zeroCopy);
+    if (result == OutboundQueue::FLUSH_AGAIN) {
+        conn.writeBlocked = true;
+    } else if (result == OutboundQueue::FLUSH_ERROR || conn.closeAfterFlush) {
+        CloseClient(shard, conn.socketFd);
+    } else if (!conn.serves.empty()) {
+        RefillServes(shard, conn);
+    }
+#endif
+}
+
+// 调整微批窗口: 平均每个待刷新的连接 (或分片广播批次) 攒下 BATCH_BUSY_PUSHES 条以上消息时加倍 (不超过上限), 否则减半
+void AdaptBatchWindow(Shard &shard, size_t conns, size_t bundled)
+{
+    bool busy = (conns > 0 && shard.batchPushes >= conns * BATCH_BUSY_PUSHES) || bundled >= BATCH_BUSY_PUSHES;
+    shard.batchPushes = 0;
+    if (busy) {
+        shard.batchWindowUs = std::min(std::max(BATCH_WINDOW_MIN_US, shard.batchWindowUs * 2), g_batchWindowMaxUs);
+    } else {
+        shard.batchWindowUs = shard.batchWindowUs / 2 < BATCH_WINDOW_MIN_US ? 0 : shard.batchWindowUs / 2;
+    }
+}
+
+void SealBundle(Shard &shard);
+
+// 刷新本轮 (或本个微批窗口内) 积累了新帧的连接; 先封口广播批次, 由它产生的入队在这次一并发出
+void FlushDirty(Shard &shard)
+{
+    size_t bundled = shard.bundleMessages;
+    shard.flushScheduled = true;
+    SealBundle(shard);
+    shard.flushScheduled = false;
+    std::vector<int> &fds = shard.flushingFds;
+    fds.swap(shard.dirtyFds);
+    AdaptBatchWindow(shard, fds.size(), bundled);
+    for (int fd : fds) {
+        Connection *conn = shard.conns.Find(fd);
+        if (conn == nullptr || !conn->dirty) {
+            continue;
+        }
+        conn->dirty = false;
+        if (!conn->closing) {
+            FlushClient(shard, *conn);
+        }
+    }
+    fds.clear();
+}
+
+// 安排刷新: 聊天与控制消息在微批窗口不为 0 时推迟到窗口结束, 文件消息 (及窗口为 0 时) 在本轮事件处理完后刷新
+void ScheduleFlush(Shard &shard, bool batchable)
+{
+    Shard *owner = &shard;
+    if (batchable && shard.batchWindowUs > 0) {
+        if (!shard.flushScheduled && !shard.flushDeferred) {
+            shard.flushDeferred = true;
+            shard.loop.RunAfter(shard.batchWindowUs, [owner]() {
+                owner->flushDeferred = false;
+                FlushDirty(*owner);
+            });
+        }
+        return;
+    }
+    if (!shard.flushScheduled) {
+        shard.flushScheduled = true;
+        shard.loop.RunInLoop([owner]() { FlushDirty(*owner); });
+    }
+}
+
+// 入队结果: 超限按策略断开, 否则登记到待刷新列表; batchable 为可以等微批窗口的聊天与控制消息
+void HandlePushResult(Shard &shard, Connection &conn, OutboundQueue::PushResult result, bool batchable = false)
+{
+    int fd = conn.socketFd;
+    if (result == OutboundQueue::PUSH_OVERFLOW) {
+        std::cout << "慢速客户端, 断开: " << conn.name << " (积压 " << conn.outQueue.Bytes() << " 字节)" << std::endl;
+        CloseClient(shard, fd);
+        return;
+    }
+    if (result == OutboundQueue::PUSH_DROPPED) {
+        return;
+    }
+    if (batchable) {
+        ++shard.batchPushes;
+    }
+    if (!conn.dirty) {
+        conn.dirty = true;
+        shard.dirtyFds.push_back(fd);
+    }
+    ScheduleFlush(shard, batchable);
+}
+
+// 封口本分片的广播批次: 合成一个 MSG_BUNDLE, 所有协商了合批的连接入队同一帧的引用
+void SealBundle(Shard &shard)
+{
+    if (shard.bundle.empty()) {
+        return;
+    }
+    FrameRef frame = MakeFrame(MSG_BUNDLE, shard.bundle);
+    shard.bundle.clear();
+    shard.bundleMessages = 0;
+    for (size_t i = 0; i < shard.conns.Size(); ++i) {
+        Connection &conn = shard.conns.At(i);
+        if ((conn.features & FEATURE_BATCH) && !conn.closing) {
+            HandlePushResult(shard, conn, conn.outQueue.Push(frame), true);
+        }
+    }
+}
+
+// 单独发给某个连接的帧入队前调用: 批次里还有它没收到的广播时先封口, 收到的顺序与服务端处理的顺序一致
+void SealBundleFor(Shard &shard, const Connection &conn)
+{
+    if ((conn.features & FEATURE_BATCH) && !shard.bundle.empty()) {
+        SealBundle(shard);
+    }
+}
+
+void EnqueueFrame(Shard &shard, Connection &conn, const FrameRef &frame,
+                  const std::shared_ptr<CreditTicket> &ticket = nullptr)
+{
+    if (!conn.closing) {
+        SealBundleFor(shard, conn);
+        bool batchable = !ticket && frame.Type() != MSG_FILE_DATA && frame.Type() != MSG_FILE_PACKED;
+        HandlePushResult(shard, conn, conn.outQueue.Push(frame, ticket), batchable);
+    }
+}
+
+// 向本分片内的连接发送, sessionId 不匹配说明原连接已关闭、fd 被复用
+void SendLocal(Shard &shard, int fd, uint64_t sessionId, const FrameRef &frame,
+               const std::shared_ptr<CreditTicket> &ticket = nullptr)
+{
+    Connection *conn = shard.conns.Find(fd);
+    if (conn != nullptr && conn->sessionId == sessionId) {
+        EnqueueFrame(shard, *conn, frame, ticket);
+    }
+}
+
+void SendLocal(Shard &shard, int fd, uint64_t sessionId, int type, const std::string &data)
+{
+    SendLocal(shard, fd, sessionId, MakeFrame(type, data));
+}
+
+// 发送已编码的帧: 目标在其他分片时投递到该分片的邮箱
+// ticket 随帧走, 目标已离线时随任务一起析构, 额度同样归还
+void SendFrame(const ClientRef &ref, const FrameRef &frame, const std::shared_ptr<CreditTicket> &ticket = nullptr)
+{
+    if (t_shard != nullptr && t_shard->index == ref.shard) {
+        SendLocal(*t_shard, ref.fd, ref.sessionId, frame, ticket);
+        return;
+    }
+    g_shards[ref.shard]->loop.RunInLoop([ref, frame, ticket]() {
+        SendLocal(*t_shard, ref.fd, ref.sessionId, frame, ticket);
+    });
+}
+
+// 发送一个 splice 转发的包: 包头 + 管道中的 pipeBytes 字节 + tail
+void SendRelay(const ClientRef &ref, const FrameRef &header, const std::shared_ptr<SplicePipe> &pipe,
+               size_t pipeBytes, const FrameRef &tail, const std::shared_ptr<CreditTicket> &ticket)
+{
+    auto deliver = [ref, header, pipe, pipeBytes, tail, ticket]() {
+        Connection *conn = t_shard->conns.Find(ref.fd);
+        if (conn != nullptr && conn->sessionId == ref.sessionId && !conn->closing) {
+            SealBundleFor(*t_shard, *conn);
+            HandlePushResult(*t_shard, *conn, conn->outQueue.PushRelay(header, pipe, pipeBytes, tail, ticket));
+        }
+    };
+    if (t_shard != nullptr && t_shard->index == ref.shard) {
+        deliver();
+        return;
+    }
+    g_shards[ref.shard]->loop.RunInLoop(deliver);
+}
+
+// 发送分段的消息: head 是包头与包体开头, payload 引用收到的帧中的一段, 两段各自作为一个 iovec 发出
+void SendParts(const ClientRef &ref, const FrameRef &head, const FrameRef &payload)
+{
+    auto deliver = [ref, head, payload]() {
+        Connection *conn = t_shard->conns.Find(ref.fd);
+        if (conn != nullptr && conn->sessionId == ref.sessionId && !conn->closing) {
+            SealBundleFor(*t_shard, *conn);
+            HandlePushResult(*t_shard, *conn, conn->outQueue.PushParts(head, payload), true);
+        }
+    };
+    if (t_shard != nullptr && t_shard->index == ref.shard) {
+        deliver();
+        return;
+    }
+    g_shards[ref.shard]->loop.RunInLoop(deliver);
+}
+
+// 通用发送函数
+void SendPacket(const ClientRef &ref, int type, const std::string &data)
+{
+    SendFrame(ref, MakeFrame(type, data));
+}
+
+// 一条消息发给某一版本客户端时的编码: head 为整帧, 或分段消息的开头 (之后紧接 payload)
+// 两个版本包体不同时各有一份, 正文部分通常是同一帧的引用; 包头的版本差异由发送队列处理
+struct Encoding {
+    FrameRef head;
+    FrameRef payload;
+};
+
+void EnqueueEncoding(Shard &shard, Connection &conn, const Encoding &encoding)
+{
+    if (conn.closing) {
+        return;
+    }
+    if (encoding.payload) {
+        HandlePushResult(shard, conn, conn.outQueue.PushParts(encoding.head, encoding.payload), true);
+    } else {
+        HandlePushResult(shard, conn, conn.outQueue.Push(encoding.head), true);
+    }
+}
+
+// 把一条广播的 v2 编码追加到分片广播批次
+void AppendBundle(Shard &shard, const Encoding &encoding)
+{
+    MsgHeader header;
+    memcpy(&header, encoding.head.Data(), sizeof(header));
+    char head[V2_HEADER_MAX];
+    shard.bundle.append(head, EncodeHeaderV2(header, head));
+    shard.bundle.append(encoding.head.Data() + sizeof(header), encoding.head.Size() - sizeof(header));
+    if (encoding.payload) {
+        shard.bundle.append(encoding.payload.Data(), encoding.payload.Size());
+    }
+    ++shard.bundleMessages;
+    if (shard.bundle.size() >= BUNDLE_MAX_BYTES) {
+        SealBundle(shard);
+    }
+    ScheduleFlush(shard, true);
+}
+
+// 协商了合批的连接共用分片广播批次, 批次对它们是同一帧, 所以不排除发送方 (客户端按 senderId 跳过自己的群聊);
+// 其余连接各自入队
+void BroadcastLocal(Shard &shard, const Encoding &v1, const Encoding &v2, uint64_t excludeSession)
+{
+    bool bundled = false;
+    for (size_t i = 0; i < shard.conns.Size(); ++i) {
+        Connection &conn = shard.conns.At(i);
+        if (conn.features & FEATURE_BATCH) {
+            bundled = bundled || (conn.sessionId != excludeSession && !conn.closing);
+        } else if (conn.sessionId != excludeSession) {
+            EnqueueEncoding(shard, conn, conn.protocol == PROTOCOL_V2 ? v2 : v1);
+        }
+    }
+    if (bundled) {
+        AppendBundle(shard, v2);
+    }
+}
+
+// 广播一条消息 (excludeSession 为 0 表示不排除任何人), 各接收方队列里放的是同样几帧的引用
+void BroadcastEncoded(const Encoding &v1, const Encoding &v2, uint64_t excludeSession)
+{
+    for (auto &shard : g_shards) {
+        if (shard.get() == t_shard) {
+            BroadcastLocal(*shard, v1, v2, excludeSession);
+        } else {
+            shard->loop.RunInLoop([v1, v2, excludeSession]() {
+                BroadcastLocal(*t_shard, v1, v2, excludeSession);
+            });
+        }
+    }
+}
+
+// 广播两个版本包体相同的帧
+void BroadcastFrame(const FrameRef &frame, uint64_t excludeSession)
+{
+    Encoding encoding = {frame, FrameRef()};
+    BroadcastEncoded(encoding, encoding, excludeSession);
+}
+
+// 广播消息, 只编码一次
+void BroadcastPacket(int type, const std::string &data, uint64_t excludeSession)
+{
+    BroadcastFrame(MakeFrame(type, data), excludeSession);
+}
+
+// 用户列表全量快照, 只发给刚登录或版本对不上的客户端
+void SendUserSnapshot(Shard &shard, Connection &conn)
+{
+    SendLocal(shard, conn.socketFd, conn.sessionId, g_presence.Snapshot(conn.protocol));
+}
+
+// 广播一条上线/下线增量, 客户端按版本号原地更新列表
+void BroadcastUserDelta(int type, uint64_t version, const std::vector<PresenceEntry> &entries)
+{
+    Encoding v1 = {MakeFrame(type, EncodeUserList(PROTOCOL_V1, version, entries)), FrameRef()};
+    Encoding v2 = {MakeFrame(type, EncodeUserList(PROTOCOL_V2, version, entries)), FrameRef()};
+    BroadcastEncoded(v1, v2, 0);
+}
+
+// 系统通知里的名字: 人数多时只列出前几个
+std::string DescribeNames(const std::vector<PresenceEntry> &names)
+{
+    std::string text;
+    for (size_t i = 0; i < names.size() && i < PRESENCE_NAMES_SHOWN; ++i) {
+        text += (i == 0 ? "" : ", ") + names[i].name;
+    }
+    if (names.size() > PRESENCE_NAMES_SHOWN) {
+        text += " 等 " + std::to_string(names.size()) + " 人";
+    }
+    return text;
+}
+
+// 合并器每个窗口调用一次: 一条系统通知 + 一条增量 (上线、下线各一)
+void PublishPresence(const PresenceUpdate &update)
+{
+    if (!update.left.empty()) {
+        BroadcastPacket(MSG_CHAT_TEXT, "[系统]: " + DescribeNames(update.left) + " 离开了群聊", 0);
+        BroadcastUserDelta(MSG_USER_LEFT, update.leftVersion, update.left);
+    }
+    if (!update.joined.empty()) {
+        BroadcastPacket(MSG_CHAT_TEXT, "[系统]: " + DescribeNames(update.joined) + " 加入了群聊", 0);
+        BroadcastUserDelta(MSG_USER_JOINED, update.joinedVersion, update.joined);
+    }
+}
+
+bool FindClient(const std::string &name, ClientRef &ref)
+{
+    return g_roster.Find(name, ref);
+}
+
+bool FindClient(uint64_t sessionId, ClientRef &ref)
+{
+    return g_roster.Find(sessionId, ref);
+}
+
+// 取出 text 开头到下一个 '|' 之前的字段, text 前进到分隔符之后; 没有分隔符时返回 false
+bool TakeField(std::string_view &text, std::string_view &field)
+{
+    const char *sep = text.empty() ? nullptr : static_cast<const char *>(memchr(text.data(), '|', text.size()));
+    if (sep == nullptr) {
+        return false;
+    }
+    field = text.substr(0, sep - text.data());
+    text.remove_prefix(field.size() + 1);
+    return true;
+}
+
+// 解析开头的十进制数, 遇到非数字字符停止, 没有数字时为 0
+template <typename T>
+T ParseNumber(std::string_view text)
+{
+    T value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+}
+
+std::string_view BodyView(const std::string &body)
+{
+    return std::string_view(body.data(), body.size());
+}
+
+// 处理登录 (Name|MaxChunk|Version|Features) [cite: 389]
+void HandleLogin(Shard &shard, Connection &conn, const std::string &body)
+{
+    if (conn.loggedIn) {
+        return;
+    }
+    std::string_view rest = BodyView(body);
+    std::string_view nameField = rest;
+    bool negotiate = TakeField(rest, nameField);
+    std::string_view chunkField = rest;
+    int protocol = PROTOCOL_V1;
+    int features = 0;
+    if (negotiate && TakeField(rest, chunkField) && ParseNumber<int>(rest) >= PROTOCOL_V2) {
+        protocol = g_maxProtocol;
+        std::string_view versionField;
+        if (protocol == PROTOCOL_V2 && TakeField(rest, versionField)) {
+            features = ParseNumber<int>(rest) & g_features;
+        }
+    }
+    bool compress = (features & FEATURE_COMPRESS) != 0;
+    std::string data(nameField);
+    if (!g_roster.Add({{shard.index, conn.socketFd, conn.sessionId, protocol, compress}, data})) {
+        // 重名: 告知原因后断开
+        std::cout << "登录被拒绝 (重名): " << data << std::endl;
+        SendLocal(shard, conn.socketFd, conn.sessionId, MSG_CHAT_TEXT, "[系统]: 用户名已被占用, 请换一个名字");
+        conn.closeAfterFlush = true;
+        return;
+    }
+    conn.name = data;
+    conn.loggedIn = true;
+    std::cout << "登录: " << conn.name << std::endl;
+    if (negotiate) {
+        // 取双方上限中较小的一个, 旧客户端不带该字段, 保持原来的包体上限
+        long chunk = ParseNumber<long>(chunkField);
+        chunk = std::max<long>(FILE_CHUNK_SIZE, std::min<long>(chunk, g_maxChunkSize));
+        conn.maxBodyLen = std::max<size_t>(MAX_BUFFER_SIZE, chunk + sizeof(FileChunkHeader));
+        std::string reply = std::to_string(chunk);
+        if (protocol == PROTOCOL_V2) {
+            reply += "|2|" + std::to_string(conn.sessionId);
+        }
+        if (features != 0) {
+            reply += "|" + std::to_string(features);
+        }
+        SendLocal(shard, conn.socketFd, conn.sessionId, MSG_LOGIN, reply);
+        // 应答本身是 v1 格式, 不压缩也不合批, 之后入队的帧才换成 v2 包头
+        // 之前攒下的广播发生在登录前, 先封口, 不让新连接收到
+        if (features & FEATURE_BATCH) {
+            SealBundle(shard);
+        }
+        conn.protocol = protocol;
+        conn.features = features;
+        conn.outQueue.SetProtocol(protocol);
+        if (compress) {
+            conn.inflater.reset(new LzDecoder());
+            conn.outQueue.EnableCompression();
+        }
+        if (features & FEATURE_BATCH) {
+            conn.outQueue.EnableBatching();
+        }
+    }
+    // 自己会在下一次合并广播中出现在列表里
+    SendUserSnapshot(shard, conn);
+    g_presence.Join(conn.name, conn.sessionId);
+}
+
+// 群聊: v2 客户端收正文并按 senderId 显示发送方, v1 客户端收 "[名字]: 正文"; 两种编码共享同一段正文
+// v1 客户端发来的正文已带 "[名字]: " 前缀, 给 v2 客户端时去掉; 前缀对不上的按原样作为系统消息显示
+void BroadcastChat(Shard &, Connection &conn, const FrameRef &frame)
+{
+    size_t bodyLen = frame.Size() - sizeof(MsgHeader);
+    if (conn.recvProtocol == PROTOCOL_V2) {
+        FrameRef text = frame.Slice(sizeof(MsgHeader), bodyLen);
+        Encoding v1 = {MakeFrame(MSG_CHAT_TEXT, {"[", conn.name, "]: "}, -1, bodyLen), text};
+        BroadcastEncoded(v1, {frame, FrameRef()}, conn.sessionId);
+        return;
+    }
+    std::string_view body(frame.Data() + sizeof(MsgHeader), bodyLen);
+    size_t prefixLen = conn.name.size() + 4;
+    Encoding v2 = {frame, FrameRef()};
+    if (body.size() >= prefixLen && body[0] == '[' && body.compare(1, conn.name.size(), conn.name) == 0 &&
+        body.compare(prefixLen - 3, 3, "]: ") == 0) {
+        FrameRef text = frame.Slice(sizeof(MsgHeader) + prefixLen, bodyLen - prefixLen);
+        v2 = {MakeHeader(MSG_CHAT_TEXT, text.Size(), (int32_t)conn.sessionId), text};
+    }
+    BroadcastEncoded({frame, FrameRef()}, v2, conn.sessionId);
+}
+
+// 处理私聊 (v1 为 Target|Content, v2 为 TargetId, Content): 包体已读进帧, 正文作为帧的一段原样发给双方,
+// v1 客户端收到的 "(私聊) 名字: " 这样的开头与包头一起新编码, v2 客户端只收正文, 由 senderId 得知发送方
+void HandlePrivateChat(Shard &shard, Connection &conn, const FrameRef &frame)
+{
+    std::string_view body(frame.Data() + sizeof(MsgHeader), frame.Size() - sizeof(MsgHeader));
+    ClientRef target;
+    bool found;
+    std::string targetName; // 名单按 std::string 查找
+    if (conn.recvProtocol == PROTOCOL_V2) {
+        PrivateChatToServer chat;
+        if (!DecodeBody(body.data(), body.size(), chat)) {
+            return;
+        }
+        body = chat.text.data;
+        found = FindClient(chat.targetId, target);
+    } else {
+        std::string_view targetView;
+        if (!TakeField(body, targetView)) {
+            return;
+        }
+        targetName.assign(targetView);
+        found = FindClient(targetName, target);
+    }
+    FrameRef content = frame.Slice(frame.Size() - body.size(), body.size());
+
+    if (found) {
+        if (target.protocol == PROTOCOL_V2) {
+            SendParts(target, MakeHeader(MSG_CHAT_PRIVATE, content.Size(), (int32_t)conn.sessionId), content);
+        } else {
+            SendParts(target, MakeFrame(MSG_CHAT_PRIVATE, {"(私聊) ", conn.name, ": "}, -1, content.Size()),
+                      content);
+        }
+        if (conn.protocol == PROTOCOL_V1) {
+            ClientRef self = {shard.index, conn.socketFd, conn.sessionId};
+            SendParts(self, MakeFrame(MSG_CHAT_PRIVATE, {"(私聊) 我 -> ", targetName, ": "}, -1, content.Size()),
+                      content);
+        }
+    } else {
+        SendLocal(shard, conn.socketFd, conn.sessionId, MSG_CHAT_TEXT, "[系统]: 用户不存在");
+    }
+}
+
+// 发出仓库文件的下一块, 发完后接着发带整体校验值的结束标记; 返回 false 表示这个文件已发完
+bool PushServeChunk(Shard &shard, Connection &conn, FileServe &serve)
+{
+    const StoreBlob &blob = *serve.blob;
+    size_t len = (size_t)std::min<int64_t>(STORE_CHUNK_SIZE, blob.size - serve.offset);
+    bool readFailed = false;
+    if (len > 0) {
+        FileChunkHeader chunk = {serve.transferId, blob.chunkCrcs[serve.offset / STORE_CHUNK_SIZE], serve.offset};
+#ifdef CHAT_USE_IO_URING
+        // io_uring 后端没有 sendfile, 读出来作为普通帧发送
+        std::string body(sizeof(chunk) + len, '\0');
+        memcpy(&body[0], &chunk, sizeof(chunk));
+        readFailed = pread(blob.fd, &body[sizeof(chunk)], len, serve.offset) != (ssize_t)len;
+        if (!readFailed) {
+            EnqueueFrame(shard, conn, MakeFrame(MSG_FILE_DATA, body, serve.senderId));
+        }
+#else
+        MsgHeader header = {MSG_FILE_DATA, (int32_t)(sizeof(chunk) + len), serve.senderId};
+        char head[sizeof(header) + sizeof(chunk)];
+        memcpy(head, &header, sizeof(header));
+        memcpy(head + sizeof(header), &chunk, sizeof(chunk));
+        SealBundleFor(shard, conn);
+        HandlePushResult(shard, conn,
+                         conn.outQueue.PushFile(MakeRawFrame(head, sizeof(head)), serve.blob, serve.offset, len));
+#endif
+        serve.offset += len;
+    }
+    if (serve.offset < blob.size && !readFailed) {
+        return true;
+    }
+    // 读盘失败时只带 TransferId, 接收方当作中断处理
+    char end[TRANSFER_ID_LEN + sizeof(uint32_t)];
+    memcpy(end, &serve.transferId, TRANSFER_ID_LEN);
+    memcpy(end + TRANSFER_ID_LEN, &blob.fileCrc, sizeof(uint32_t));
+    EnqueueFrame(shard, conn, MakeFrame(MSG_FILE_END, end, readFailed ? TRANSFER_ID_LEN : sizeof(end), serve.senderId));
+    return false;
+}
+
+// 发送队列低于低水位时轮流为各个文件补一块, 慢接收方只拖慢自己
+void RefillServes(Shard &shard, Connection &conn)
+{
+    while (!conn.closing && !conn.serves.empty() &&
+           (conn.outQueue.Empty() || conn.outQueue.Bytes() < g_queueLimits.lowWatermark)) {
+        size_t index = conn.serves.size();
+        for (size_t step = 0; step < conn.serves.size(); ++step) {
+            size_t candidate = (conn.serveCursor + step) % conn.serves.size();
+            if (conn.serves[candidate].offset >= 0) {
+                index = candidate;
+                break;
+            }
+        }
+        if (index == conn.serves.size()) {
+            return; // 都在等续传应答
+        }
+        conn.serveCursor = index + 1;
+        FileServe &serve = conn.serves[index];
+        if (!PushServeChunk(shard, conn, serve)) {
+            serve.offset = -1; // 等接收方确认, 校验失败时它会要求从某处重发
+        }
+    }
+}
+
+// 发给接收方的文件头 (v1 为 TransferId|Name|Size|SenderName[|1], v2 见 Protocol.h)
+// fromStore 告诉接收方这是仓库发出的, 不必发旧版本的分块签名
+FrameRef EncodeFileInfo(int protocol, uint32_t transferId, std::string_view fileName, int64_t size,
+                        const std::string &senderName, bool fromStore, int32_t senderId)
+{
+    if (protocol == PROTOCOL_V2) {
+        std::string body;
+        EncodeBody(FileInfoToClient{transferId, (uint64_t)size, fromStore ? 1u : 0u, fileName}, body);
+        return MakeFrame(MSG_FILE_INFO, body, senderId);
+    }
+    return MakeFrame(MSG_FILE_INFO, {std::to_string(transferId), "|", fileName, "|", std::to_string(size), "|",
+                                     senderName, fromStore ? "|1" : ""}, senderId);
+}
+
+// 续传偏移 (v1 为 TransferId|Offset, 完成时再加 |1; v2 为 TransferId, Offset, Done)
+FrameRef EncodeResume(int protocol, uint32_t transferId, int64_t offset, bool done, int32_t senderId = -1)
+{
+    if (protocol == PROTOCOL_V2) {
+        std::string body;
+        EncodeBody(ResumeToClient{transferId, (uint64_t)offset, done ? 1u : 0u}, body);
+        return MakeFrame(MSG_FILE_RESUME, body, senderId);
+    }
+    return MakeFrame(MSG_FILE_RESUME, {std::to_string(transferId), "|", std::to_string(offset), done ? "|1" : ""},
+                     senderId);
+}
+
+void ServeLocal(Shard &shard, const FileServe &serve, const FrameRef &v1, const FrameRef &v2, uint64_t senderSession)
+{
+    for (size_t i = 0; i < shard.conns.Size(); ++i) {
+        Connection &conn = shard.conns.At(i);
+        if (!conn.loggedIn || conn.closing || conn.sessionId == senderSession ||
+            conn.serves.size() >= MAX_TRANSFERS_PER_CONN) {
+            continue;
+        }
+        conn.serves.push_back(serve);
+        EnqueueFrame(shard, conn, conn.protocol == PROTOCOL_V2 ? v2 : v1);
+    }
+}
+
+// 入库完成: 向发送方以外的在线用户发文件头, 各自应答续传偏移后开始发送
+void ServeToAll(const FileServe &serve, const std::string &fileName, uint64_t senderSession)
+{
+    int64_t size = serve.blob->size;
+    FrameRef v1 = EncodeFileInfo(PROTOCOL_V1, serve.transferId, fileName, size, serve.senderName, true, serve.senderId);
+    FrameRef v2 = EncodeFileInfo(PROTOCOL_V2, serve.transferId, fileName, size, serve.senderName, true, serve.senderId);
+    for (auto &shard : g_shards) {
+        if (shard.get() == t_shard) {
+            ServeLocal(*shard, serve, v1, v2, senderSession);
+        } else {
+            shard->loop.RunInLoop([serve, v1, v2, senderSession]() {
+                ServeLocal(*t_shard, serve, v1, v2, senderSession);
+            });
+        }
+    }
+}
+
+// 发送方 conn 的一个群发文件已在仓库中, 开始发给其他人
+void ServeBlob(const Connection &conn, uint32_t transferId, const std::shared_ptr<const StoreBlob> &blob,
+               const std::string &fileName)
+{
+    FileServe serve;
+    serve.blob = blob;
+    serve.transferId = transferId;
+    serve.senderId = (int32_t)conn.sessionId;
+    serve.senderName = conn.name;
+    ServeToAll(serve, fileName, conn.sessionId);
+}
+
+// 告诉发送方从哪里继续上传, done 表示已入库 (此时 offset 为文件大小)
+void SendUploadOffset(Shard &shard, Connection &conn, uint32_t transferId, int64_t offset, bool done = false)
+{
+    EnqueueFrame(shard, conn, EncodeResume(conn.protocol, transferId, offset, done));
+}
+
+// 文件头中服务端用到的字段, 两个版本的包体都解析成这个结构
+struct FileInfoFields {
+    bool group = false;
+    std::string targetName; // v1 按名字指定接收方
+    uint64_t targetId = 0;  // v2 按用户 ID 指定接收方
+    uint32_t transferId = 0;
+    std::string_view fileName;
+    int64_t size = 0;
+    std::string hash;       // 群发时的 SHA-256, 64 位十六进制
+};
+
+// v1: Target|TransferId|Name|Size[|Sha256], Target 为空表示群发; v2 见 Protocol.h
+bool ParseFileInfo(const Connection &conn, const std::string &body, FileInfoFields &info)
+{
+    if (conn.recvProtocol == PROTOCOL_V2) {
+        FileInfoToServer wire;
+        if (!DecodeBody(body.data(), body.size(), wire)) {
+            return false;
+        }
+        info.targetId = wire.targetId;
+        info.group = info.targetId == 0;
+        info.transferId = (uint32_t)wire.transferId;
+        info.size = (int64_t)wire.size;
+        info.fileName = wire.name;
+        std::string_view digest = wire.digest.data;
+        if (info.group && digest.size() >= SHA256_LEN) {
+            static const char HEX[] = "0123456789abcdef";
+            for (size_t i = 0; i < SHA256_LEN; ++i) {
+                info.hash += HEX[(uint8_t)digest[i] >> 4];
+                info.hash += HEX[(uint8_t)digest[i] & 0xf];
+            }
+        }
+        return true;
+    }
+    std::string_view rest = BodyView(body);
+    std::string_view targetName;
+    std::string_view idField;
+    if (!TakeField(rest, targetName) || !TakeField(rest, idField) || !TakeField(rest, info.fileName)) {
+        return false;
+    }
+    info.group = targetName.empty();
+    info.targetName.assign(targetName);
+    info.transferId = ParseNumber<uint32_t>(idField);
+    std::string_view sizeField = rest;
+    if (TakeField(rest, sizeField)) {
+        info.hash.assign(rest);
+    }
+    info.size = ParseNumber<int64_t>(sizeField);
+    return true;
+}
+
+// 群发的文件头: 仓库已有该内容就不用上传, 否则开始或继续上传
+bool BeginGroupUpload(FileRoute &route, const FileInfoFields &info)
+{
+    route.fileName.assign(info.fileName);
+    route.blob = g_fileStore.Find(info.hash, info.size);
+    if (!route.blob) {
+        route.upload = g_fileStore.BeginUpload(info.hash, info.size);
+    }
+    return route.blob || route.upload;
+}
+
+// 额度恢复: 回到上传方所在分片继续读取
+void ResumeReading(Shard &shard, int fd, uint64_t sessionId)
+{
+    Connection *conn = shard.conns.Find(fd);
+    if (conn == nullptr || conn->sessionId != sessionId || conn->closing || conn->credit->Paused()) {
+        return; // 恢复任务送达前可能又暂停了, 以最近一次恢复为准
+    }
+#ifdef CHAT_USE_IO_URING
+    shard.loop.ResumeRecv(fd);
+#else
+    HandleReadable(shard, *conn);
+#endif
+}
+
+// 第一次向他人发文件时创建额度, 窗口至少容纳两个协商大小的文件块, 否则转发会一停一走
+void EnsureCredit(Shard &shard, Connection &conn)
+{
+    if (conn.credit) {
+        return;
+    }
+    Shard *owner = &shard;
+    int fd = conn.socketFd;
+    uint64_t sessionId = conn.sessionId;
+    size_t window = std::max(g_relayWindow, 2 * conn.maxBodyLen);
+    conn.credit = std::make_shared<UploadCredit>(window, [owner, fd, sessionId]() {
+        owner->loop.RunInLoop([owner, fd, sessionId]() { ResumeReading(*owner, fd, sessionId); });
+    });
+}
+
+// 转发一个包后检查额度: 用尽时暂停读取, 额度恢复后由 ResumeReading 接着读
+// (epoll 后端停止读取即可, io_uring 后端还要取消多发的接收请求, 所以 shard 只在后者用到)
+bool PauseIfNoCredit([[maybe_unused]] Shard &shard, Connection &conn)
+{
+    if (!conn.credit || !conn.credit->ShouldPause()) {
+        return false;
+    }
+#ifdef CHAT_USE_IO_URING
+    shard.loop.PauseRecv(conn.socketFd);
+#endif
+    return true;
+}
+
+// 处理文件信息头
+void HandleFileInfo(Shard &shard, Connection &conn, const std::string &body)
+{
+    FileInfoFields info;
+    if (!ParseFileInfo(conn, body, info)) {
+        return;
+    }
+    uint32_t transferId = info.transferId;
+
+    ClientRef target = {-1, -1, 0}; // fd 为 -1 代表群发
+    bool found = info.group || (conn.recvProtocol == PROTOCOL_V2 ? FindClient(info.targetId, target)
+                                                                 : FindClient(info.targetName, target));
+    if (!found) {
+        SendLocal(shard, conn.socketFd, conn.sessionId, MSG_CHAT_TEXT, "[系统]: 目标不在线，文件取消");
+        return;
+    }
+    if (conn.fileRoutes.size() >= MAX_TRANSFERS_PER_CONN && conn.fileRoutes.count(transferId) == 0) {
+        SendLocal(shard, conn.socketFd, conn.sessionId, MSG_CHAT_TEXT, "[系统]: 同时进行的传输过多，文件取消");
+        return;
+    }
+
+    FileRoute &route = conn.fileRoutes[transferId];
+    route = FileRoute(); // 重发的文件头: 先释放上次的上传
+    route.target = target;
+    if (target.fd == -1) {
+        // 群发不直接转发, 整个文件入库后再分别发给每个接收方
+        if (!BeginGroupUpload(route, info)) {
+            conn.fileRoutes.erase(transferId);
+            SendLocal(shard, conn.socketFd, conn.sessionId, MSG_CHAT_TEXT,
+                      "[系统]: 群发文件无法入库 (可能正由他人上传)，文件取消");
+            return;
+        }
+        if (route.blob) {
+            // 仓库已有相同内容: 上传直接完成
+            ServeBlob(conn, transferId, route.blob, route.fileName);
+            SendUploadOffset(shard, conn, transferId, route.blob->size, true);
+            conn.fileRoutes.erase(transferId);
+            return;
+        }
+        SendUploadOffset(shard, conn, transferId, route.upload->Written());
+        return;
+    }
+    if (g_spliceRelay) {
+        route.pipe = SplicePipe::Create();
+    }
+    EnsureCredit(shard, conn);
+
+    // 接收方按 (senderId, TransferId) 区分同时进行的多路传输, 按发送方名字 (v2 为 senderId) 应答续传偏移
+    SendFrame(target, EncodeFileInfo(target.protocol, transferId, info.fileName, info.size, conn.name, false,
+                                     (int32_t)conn.sessionId));
+}
+
+// 续传应答 (v1 为 SenderName|TransferId|Offset[|1], v2 为 SenderId, TransferId, Offset, Done):
+// 仓库文件由本连接的发送状态处理, 其余按发送方的版本重新编码后转给它
+void HandleFileResume(Shard &shard, Connection &conn, const std::string &body)
+{
+    std::string_view rest = BodyView(body);
+    std::string senderName;
+    uint64_t senderId = 0;
+    uint64_t transferId = 0;
+    uint64_t offset = 0;
+    uint64_t done = 0;
+    if (conn.recvProtocol == PROTOCOL_V2) {
+        ResumeToServer wire;
+        if (!DecodeBody(body.data(), body.size(), wire)) {
+            return;
+        }
+        senderId = wire.senderId;
+        transferId = wire.transferId;
+        offset = wire.offset;
+        done = wire.done;
+    } else {
+        std::string_view nameField;
+        std::string_view idField;
+        if (!TakeField(rest, nameField) || !TakeField(rest, idField)) {
+            return;
+        }
+        senderName.assign(nameField);
+        transferId = ParseNumber<uint32_t>(idField);
+        std::string_view offsetField = rest;
+        done = TakeField(rest, offsetField) ? 1 : 0;
+        offset = ParseNumber<uint64_t>(offsetField);
+    }
+    for (size_t i = 0; i < conn.serves.size(); ++i) {
+        FileServe &serve = conn.serves[i];
+        bool sameSender = conn.recvProtocol == PROTOCOL_V2 ? serve.senderId == (int32_t)senderId
+                                                           : serve.senderName == senderName;
+        if (serve.transferId != (uint32_t)transferId || !sameSender) {
+            continue;
+        }
+        if (done != 0) {
+            conn.serves.erase(conn.serves.begin() + i); // 接收方已确认完成
+            return;
+        }
+        int64_t start = std::max<int64_t>(0, std::min<int64_t>((int64_t)offset, serve.blob->size));
+        serve.offset = start - start % STORE_CHUNK_SIZE; // 块校验值按整块预先算好
+        RefillServes(shard, conn);
+        return;
+    }
+    ClientRef sender;
+    bool found = conn.recvProtocol == PROTOCOL_V2 ? FindClient(senderId, sender) : FindClient(senderName, sender);
+    if (!found) {
+        return; // 发送方已离线, 它重连后会重新发文件头
+    }
+    SendFrame(sender, EncodeResume(sender.protocol, (uint32_t)transferId, (int64_t)offset, done != 0,
+                                   (int32_t)conn.sessionId));
+}
+
+// 旧版本的分块签名 (v1 为 SenderName|TransferId|BlockSize|FirstIndex| + 签名数组, v2 见 Protocol.h):
+// 去掉发送方后按它的版本重新编码, 签名数组原样带上
+void HandleFileSigs(Shard &, Connection &conn, const std::string &body)
+{
+    uint64_t senderId = 0;
+    uint64_t fields[3]; // TransferId, BlockSize, FirstIndex
+    std::string_view sigs;
+    ClientRef sender;
+    bool found;
+    if (conn.recvProtocol == PROTOCOL_V2) {
+        SigsToServer wire;
+        if (!DecodeBody(body.data(), body.size(), wire)) {
+            return;
+        }
+        senderId = wire.senderId;
+        fields[0] = wire.transferId;
+        fields[1] = wire.blockSize;
+        fields[2] = wire.firstIndex;
+        sigs = wire.sigs.data;
+        found = FindClient(senderId, sender);
+    } else {
+        std::string_view rest = BodyView(body);
+        std::string_view senderName;
+        if (!TakeField(rest, senderName)) {
+            return;
+        }
+        for (uint64_t &field : fields) {
+            std::string_view text;
+            if (!TakeField(rest, text)) {
+                return;
+            }
+            field = ParseNumber<uint64_t>(text);
+        }
+        sigs = rest;
+        found = FindClient(std::string(senderName), sender);
+    }
+    if (!found) {
+        return; // 发送方已离线, 它重连后会重新发文件头
+    }
+    if (sender.protocol == PROTOCOL_V2) {
+        std::string out;
+        EncodeBody(SigsToClient{fields[0], fields[1], fields[2], {sigs}}, out);
+        SendFrame(sender, MakeFrame(MSG_FILE_SIGS, out, (int32_t)conn.sessionId));
+    } else {
+        SendFrame(sender, MakeFrame(MSG_FILE_SIGS, {std::to_string(fields[0]), "|", std::to_string(fields[1]), "|",
+                                                    std::to_string(fields[2]), "|", sigs}, (int32_t)conn.sessionId));
+    }
+}
 
-// 文件传输路由表: SenderFD -> ReceiverFD (-1代表群发)
-std::map<int, int> g_fileTransferRoutes;
-std::mutex g_fileMutex;
+// 压缩过的文件块 (MSG_FILE_PACKED) 解开为 MSG_FILE_DATA 帧, 给不支持压缩的接收方; 数据损坏时返回空帧
+FrameRef UnpackChunk(const FrameRef &frame, size_t maxLen)
+{
+    static thread_local std::string data;
+    const char *body = frame.Data() + sizeof(MsgHeader);
+    size_t len = frame.Size() - sizeof(MsgHeader);
+    if (len < sizeof(FileChunkHeader) ||
+        !LzDecompressBlock(body + sizeof(FileChunkHeader), len - sizeof(FileChunkHeader), maxLen, data)) {
+        return FrameRef();
+    }
+    MsgHeader header;
+    memcpy(&header, frame.Data(), sizeof(header));
+    return MakeFrame(MSG_FILE_DATA, {std::string_view(body, sizeof(FileChunkHeader)), data}, header.senderId);
+}
 
-// 辅助：读取固定长度 
-bool RecvFixedLen(int sockfd, char *buf, int len)
+// 群发的文件块: 按顺序写入仓库, 校验失败时让发送方从已写入处重发; 压缩过的块先解开再校验
+void AppendUpload(Shard &shard, Connection &conn, FileRoute &route, const char *body, size_t bodyLen, bool packed)
 {
-    int total = 0;
-    while (total < len) {
-        int received = recv(sockfd, buf + total, len - total, 0);
-        if (received <= 0) {
-            return false;
+    FileChunkHeader chunk;
+    if (!route.upload || bodyLen < sizeof(chunk)) {
+        return;
+    }
+    memcpy(&chunk, body, sizeof(chunk));
+    if (chunk.offset != route.upload->Written()) {
+        return; // 重复的块, 或重传请求发出前已在路上的块
+    }
+    const char *data = body + sizeof(chunk);
+    size_t len = bodyLen - sizeof(chunk);
+    static thread_local std::string unpacked;
+    bool intact = true; // 解不开的块按校验失败处理
+    if (packed) {
+        intact = LzDecompressBlock(data, len, conn.maxBodyLen, unpacked);
+        data = unpacked.data();
+        len = unpacked.size();
+    }
+    if (!intact || Crc32c(0, data, len) != chunk.crc) {
+        if (!route.rewindRequested) {
+            route.rewindRequested = true;
+            SendUploadOffset(shard, conn, chunk.transferId, route.upload->Written());
         }
-        total += received;
+        return;
     }
-    return true;
+    if (!route.upload->Append(data, len)) {
+        route.upload = nullptr;
+        SendLocal(shard, conn.socketFd, conn.sessionId, MSG_CHAT_TEXT, "[系统]: 服务器写入文件失败，群发取消");
+        return;
+    }
+    route.rewindRequested = false;
 }
 
-// 通用发送函数
-void SendPacket(int fd, int type, const std::string &data)
+// 群发的结束标记: 入库 (长度与摘要都相符) 后确认发送方并开始向各接收方发送
+// 还没传完 (有块校验失败) 时 .part 留在仓库, 发送方收到偏移后重发文件头续传
+void FinishUpload(Shard &shard, Connection &conn, uint32_t transferId, FileRoute &route)
 {
-    MsgHeader header;
-    header.type = type;
-    header.bodyLen = data.size();
-    header.senderId = -1;
-    send(fd, (char *)&header, sizeof(header), 0);
-    if (!data.empty()) {
-        send(fd, data.c_str(), data.size(), 0);
+    if (!route.upload) {
+        return;
+    }
+    int64_t written = route.upload->Written();
+    int64_t size = route.upload->Size();
+    std::shared_ptr<const StoreBlob> blob = g_fileStore.Commit(route.upload);
+    route.upload = nullptr;
+    if (written < size) {
+        if (!route.rewindRequested) {
+            SendUploadOffset(shard, conn, transferId, written);
+        }
+        return;
+    }
+    if (!blob) {
+        SendLocal(shard, conn.socketFd, conn.sessionId, MSG_CHAT_TEXT, "[系统]: 群发文件校验失败，已丢弃");
+    } else {
+        ServeBlob(conn, transferId, blob, route.fileName);
     }
+    SendUploadOffset(shard, conn, transferId, size, true);
 }
 
-// 广播消息
-void BroadcastPacket(int type, const std::string &data, int excludeFd)
+// 文件块、复制指令与结束标记 (已编码为发给接收方的帧): 按包体开头的传输 ID 查路由,
+// 一对一把这一帧原样转发 (压缩过的块对方不支持时解开再发), 群发写入仓库 (群发没有复制指令)
+void HandleFileChunk(Shard &shard, Connection &conn, const FrameRef &frame)
 {
-    std::lock_guard<std::mutex> lock(g_clientsMutex);
-    for (auto &cli : g_clients) {
-        if (excludeFd == -1 || cli.socketFd != excludeFd) {
-            SendPacket(cli.socketFd, type, data);
+    const char *body = frame.Data() + sizeof(MsgHeader);
+    size_t len = frame.Size() - sizeof(MsgHeader);
+    int type = frame.Type();
+    if (len < (size_t)TRANSFER_ID_LEN) {
+        return;
+    }
+    uint32_t transferId;
+    memcpy(&transferId, body, TRANSFER_ID_LEN);
+    auto found = conn.fileRoutes.find(transferId);
+    if (found == conn.fileRoutes.end()) {
+        return;
+    }
+    FileRoute &route = found->second;
+    if (route.target.fd != -1) {
+        FrameRef out = frame;
+        if (type == MSG_FILE_PACKED && !route.target.compress) {
+            out = UnpackChunk(frame, conn.maxBodyLen);
+        }
+        if (out) {
+            SendFrame(route.target, out, conn.credit->Take(out.Size()));
         }
+    } else if (type == MSG_FILE_DATA || type == MSG_FILE_PACKED) {
+        AppendUpload(shard, conn, route, body, len, type == MSG_FILE_PACKED);
+    } else if (type == MSG_FILE_END) {
+        FinishUpload(shard, conn, transferId, route);
+    }
+    if (type == MSG_FILE_END) {
+        conn.fileRoutes.erase(found);
     }
 }
 
-// 广播用户列表
-void BroadcastUserList()
+// 只有 splice 转发探测传输 ID 后发现路由不带管道时, 文件块才会读进 body
+void HandleFileDataBody(Shard &shard, Connection &conn, const std::string &body)
 {
-    std::string nameListStr;
-    {
-        std::lock_guard<std::mutex> lock(g_clientsMutex);
-        for (size_t i = 0; i < g_clients.size(); ++i) {
-            nameListStr += g_clients[i].name;
-            if (i != g_clients.size() - 1) {
-                nameListStr += ",";
-            }
-        }
+    HandleFileChunk(shard, conn, MakeFrame(MSG_FILE_DATA, body, (int32_t)conn.sessionId));
+}
+
+void HandleUserListRequest(Shard &shard, Connection &conn, const std::string &)
+{
+    SendUserSnapshot(shard, conn);
+}
+
+// 只接受登录时同意过的版本; 之后的字节 (可能已在同一次读取中) 按 v2 解码
+void HandleProtocol(Shard &, Connection &conn, const std::string &body)
+{
+    if (conn.protocol == PROTOCOL_V2 && ParseNumber<int>(BodyView(body)) == PROTOCOL_V2) {
+        conn.recvProtocol = PROTOCOL_V2;
+    }
+}
+
+void HandleLogout(Shard &shard, Connection &conn, const std::string &)
+{
+    CloseClient(shard, conn.socketFd);
+}
+
+// 读进 conn.body 的消息
+using BodyHandlers = DispatchTable<void (*)(Shard &, Connection &, const std::string &),
+                                   On<MSG_LOGIN, HandleLogin>,
+                                   On<MSG_FILE_INFO, HandleFileInfo>,
+                                   On<MSG_FILE_DATA, HandleFileDataBody>,
+                                   On<MSG_FILE_RESUME, HandleFileResume>,
+                                   On<MSG_FILE_SIGS, HandleFileSigs>,
+                                   On<MSG_USER_LIST_REQ, HandleUserListRequest>,
+                                   On<MSG_PROTOCOL, HandleProtocol>,
+                                   On<MSG_LOGOUT, HandleLogout>>;
+
+// 包体 (或其一段) 原样转发、直接读进帧的消息: 群聊文本按引用扇出到所有分片, 私聊正文按段转发,
+// 一对一时的文件块、复制指令与结束标记按路由转发或入库
+using FrameHandlers = DispatchTable<void (*)(Shard &, Connection &, const FrameRef &),
+                                    On<MSG_CHAT_TEXT, BroadcastChat>,
+                                    On<MSG_CHAT_PRIVATE, HandlePrivateChat>,
+                                    On<MSG_FILE_DATA, HandleFileChunk>,
+                                    On<MSG_FILE_COPY, HandleFileChunk>,
+                                    On<MSG_FILE_END, HandleFileChunk>,
+                                    On<MSG_FILE_PACKED, HandleFileChunk>>;
+
+// 分发一个读进 conn.body 的消息 (聊天文本与一对一文件消息见 DispatchFrame)
+void DispatchMessage(Shard &shard, Connection &conn, const MsgHeader &header, const std::string &body)
+{
+    if (conn.closeAfterFlush) {
+        return; // 已被拒绝, 等待断开
     }
-    
-    std::lock_guard<std::mutex> lock(g_clientsMutex);
-    for (auto &cli : g_clients) {
-        SendPacket(cli.socketFd, MSG_USER_LIST, nameListStr);
+    BodyHandlers::Dispatch(header.type, shard, conn, body);
+}
+
+void DispatchFrame(Shard &shard, Connection &conn, const FrameRef &frame)
+{
+    if (conn.closeAfterFlush) {
+        return;
     }
+    FrameHandlers::Dispatch(frame.Type(), shard, conn, frame);
 }
 
-// 处理登录 [cite: 389]
-void HandleLogin(int clientFd, const std::string &data, std::string &clientName)
+bool ForwardsBody(int type)
 {
-    clientName = data;
-    std::cout << "登录: " << clientName << std::endl;
-    {
-        std::lock_guard<std::mutex> lock(g_clientsMutex);
-        for (auto &c : g_clients) {
-            if (c.socketFd == clientFd) {
-                c.name = clientName;
-            }
-        }
+    return FrameHandlers::Handles(type);
+}
+
+// 原样转发的帧标的发送方: 聊天不带发送方, 文件消息带会话号
+// (v1 客户端的群聊正文自带名字前缀, 不标发送方; 私聊帧只转发其中的正文, 包头不发出)
+int32_t InboundSenderId(const Connection &conn, int type)
+{
+    bool chat = type == MSG_CHAT_TEXT || type == MSG_CHAT_PRIVATE;
+    return (chat && conn.recvProtocol == PROTOCOL_V1) ? -1 : (int32_t)conn.sessionId;
+}
+
+// 解开带 COMPRESSED_FLAG 的消息, 按原类型分发; 没协商压缩或数据损坏时断开
+void DispatchCompressed(Shard &shard, Connection &conn)
+{
+    const char *data;
+    size_t len;
+    if (!conn.inflater || !conn.inflater->Decompress(conn.body.data(), conn.body.size(), conn.maxBodyLen, data, len)) {
+        CloseClient(shard, conn.socketFd);
+        return;
+    }
+    int type = conn.header.type & ~COMPRESSED_FLAG;
+    if (ForwardsBody(type)) {
+        char *body;
+        FrameRef frame = MakeFrame(type, len, InboundSenderId(conn, type), body);
+        memcpy(body, data, len);
+        DispatchFrame(shard, conn, frame);
+        return;
     }
-    std::string notify = "[系统]: " + clientName + " 加入了群聊";
-    BroadcastPacket(MSG_CHAT_TEXT, notify, -1);
-    BroadcastUserList();
+    MsgHeader header = conn.header;
+    header.type = type;
+    header.bodyLen = (int32_t)len;
+    DispatchMessage(shard, conn, header, std::string(data, len));
 }
 
-// 处理私聊
-void HandlePrivateChat(int clientFd, const std::string &clientName, const std::string &body)
+// 为即将读入的包体准备缓冲区: 原样转发的消息直接读进帧, 其余读进 conn.body, 大包体优先借用分片留存的缓冲区
+void PrepareBody(Shard &shard, Connection &conn, size_t len)
 {
-    size_t splitPos = body.find('|');
-    if (splitPos == std::string::npos) {
+    if (ForwardsBody(conn.header.type) && !conn.relayProbe) {
+        conn.inFrame = MakeFrame(conn.header.type, len, InboundSenderId(conn, conn.header.type), conn.inBody);
+        conn.bodyRead = 0;
         return;
     }
+    if (len > BODY_POOL_THRESHOLD && conn.body.capacity() < len && !shard.bodyPool.empty()) {
+        conn.body.swap(shard.bodyPool.back());
+        shard.bodyPool.pop_back();
+    }
+    conn.body.resize(len);
+    conn.bodyRead = 0;
+}
 
-    std::string targetName = body.substr(0, splitPos);
-    std::string msgContent = body.substr(splitPos + 1);
-    
-    int targetFd = -1;
-    {
-        std::lock_guard<std::mutex> lock(g_clientsMutex);
-        for (auto &cli : g_clients) {
-            if (cli.name == targetName) {
-                targetFd = cli.socketFd;
-                break;
+char *BodyBuffer(Connection &conn)
+{
+    return conn.inFrame ? conn.inBody : &conn.body[0];
+}
+
+size_t BodySize(const Connection &conn)
+{
+    return conn.inFrame ? (size_t)conn.header.bodyLen : conn.body.size();
+}
+
+// 包体处理完毕: 大缓冲区还给分片 (保留长度, 下次同样大小的包体不必再清零)
+void ReleaseBody(Shard &shard, Connection &conn)
+{
+    if (conn.body.capacity() <= BODY_POOL_THRESHOLD) {
+        return;
+    }
+    if (shard.bodyPool.size() < BODY_POOL_MAX) {
+        shard.bodyPool.push_back(std::string());
+        shard.bodyPool.back().swap(conn.body);
+    } else {
+        std::string().swap(conn.body);
+    }
+}
+
+// 把包体从 socket 直接移入转发管道, 不经过用户态
+// 返回 false 表示连接断开; done 表示这一阶段结束 (包体全部入管道, 或管道已满、剩余部分改为普通读取)
+bool SpliceToPipe(Connection &conn, size_t len, bool &done)
+{
+    done = false;
+    while (conn.relayPipeBytes < len) {
+        ssize_t n = splice(conn.socketFd, nullptr, conn.relayPipe->writeFd, nullptr, len - conn.relayPipeBytes,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            conn.relayPipeBytes += n;
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // EAGAIN 可能是 socket 没数据, 也可能是管道满了 (接收方太慢)
+            int avail = 0;
+            if (ioctl(conn.socketFd, FIONREAD, &avail) == 0 && avail == 0) {
+                return true;
             }
+            done = true;
+            return true;
+        }
+        return false;
+    }
+    done = true;
+    return true;
+}
+
+// 转发一个文件块: 包头与传输 ID 重新编码, 其余包体在管道里 (管道满时剩余部分在 conn.body)
+void RelayFileData(Connection &conn)
+{
+    char head[sizeof(MsgHeader) + TRANSFER_ID_LEN];
+    MsgHeader header = conn.header;
+    header.senderId = (int32_t)conn.sessionId;
+    memcpy(head, &header, sizeof(header));
+    memcpy(head + sizeof(header), &conn.relayId, TRANSFER_ID_LEN);
+    FrameRef tail;
+    if (!conn.body.empty()) {
+        tail = MakeRawFrame(conn.body.data(), conn.body.size());
+    }
+    SendRelay(conn.relayTarget, MakeRawFrame(head, sizeof(head)), conn.relayPipe, conn.relayPipeBytes, tail,
+              conn.credit->Take(sizeof(head) + conn.relayPipeBytes + conn.body.size()));
+}
+
+// 文件块的传输 ID 已读到 conn.body 开头: 路由带管道时改走 splice 转发
+void BeginRelay(Connection &conn)
+{
+    uint32_t transferId;
+    memcpy(&transferId, conn.body.data(), TRANSFER_ID_LEN);
+    auto route = conn.fileRoutes.find(transferId);
+    if (route == conn.fileRoutes.end() || !route->second.pipe) {
+        return; // 其余包体照常读入 conn.body
+    }
+    conn.relaying = true;
+    conn.relaySplicing = true;
+    conn.relayId = transferId;
+    conn.relayTarget = route->second.target;
+    conn.relayPipe = route->second.pipe;
+    conn.relayPipeBytes = 0;
+    conn.body.clear();
+    conn.bodyRead = 0;
+}
+
+#ifndef CHAT_USE_IO_URING
+// 读满一次的额度时还有数据: 让出本轮, 下一轮接着读 (边沿触发不会再次通知)
+void YieldRead(Shard &shard, Connection &conn)
+{
+    Shard *owner = &shard;
+    int fd = conn.socketFd;
+    uint64_t sessionId = conn.sessionId;
+    shard.loop.RunNextRound([owner, fd, sessionId]() {
+        Connection *conn = owner->conns.Find(fd);
+        if (conn != nullptr && conn->sessionId == sessionId && !conn->closing) {
+            HandleReadable(*owner, *conn);
         }
+    });
+}
+#endif
+
+// 包头收齐: 检查长度并准备包体缓冲区; 返回 false 表示连接已关闭
+bool BeginFrame(Shard &shard, Connection &conn)
+{
+    if ((size_t)conn.header.bodyLen > conn.maxBodyLen || conn.header.bodyLen < 0) {
+        CloseClient(shard, conn.socketFd);
+        return false;
     }
+    conn.relayProbe = g_spliceRelay && conn.header.type == MSG_FILE_DATA &&
+                      conn.header.bodyLen > TRANSFER_ID_LEN && !conn.fileRoutes.empty();
+    conn.relaying = false;
+    conn.relaySplicing = false;
+    PrepareBody(shard, conn, conn.header.bodyLen);
+    return true;
+}
 
-    if (targetFd != -1) {
-        SendPacket(targetFd, MSG_CHAT_PRIVATE, "(私聊) " + clientName + ": " + msgContent);
-        SendPacket(clientFd, MSG_CHAT_PRIVATE, "(私聊) 我 -> " + targetName + ": " + msgContent);
+// 包体收齐: 分发并复位状态机; 返回 true 表示转发额度用尽, 应暂停读取
+bool FinishFrame(Shard &shard, Connection &conn)
+{
+    conn.headerRead = 0;
+    if (conn.relaying) {
+        RelayFileData(conn);
+    } else if (conn.inFrame) {
+        DispatchFrame(shard, conn, FrameRef(std::move(conn.inFrame)));
+    } else if (conn.header.type & COMPRESSED_FLAG) {
+        DispatchCompressed(shard, conn);
     } else {
-        SendPacket(clientFd, MSG_CHAT_TEXT, "[系统]: 用户不存在");
+        DispatchMessage(shard, conn, conn.header, conn.body);
     }
+    ReleaseBody(shard, conn);
+    return PauseIfNoCredit(shard, conn);
 }
 
-// 处理文件信息头
-void HandleFileInfo(int clientFd, const std::string &body)
+// 从 data 中取包头, 返回用掉的字节数, 格式错误时返回 -1; 包头收满后 headerRead 为 sizeof(MsgHeader)
+// v2 包头长度不定, 先攒进 wireHead 再解码, 没用上的字节留给包体
+ssize_t TakeHeader(Connection &conn, const char *data, size_t len)
 {
-    size_t firstPipe = body.find('|');
-    if (firstPipe == std::string::npos) {
-        return;
+    if (conn.recvProtocol == PROTOCOL_V1) {
+        size_t n = std::min(len, sizeof(MsgHeader) - conn.headerRead);
+        memcpy((char *)&conn.header + conn.headerRead, data, n);
+        conn.headerRead += n;
+        return (ssize_t)n;
     }
+    size_t before = conn.wireHeadLen;
+    size_t n = std::min(len, V2_HEADER_MAX - before);
+    memcpy(conn.wireHead + before, data, n);
+    conn.wireHeadLen += n;
+    int headLen = DecodeHeaderV2(conn.wireHead, conn.wireHeadLen, conn.header);
+    if (headLen < 0 || (headLen == 0 && conn.wireHeadLen == V2_HEADER_MAX)) {
+        return -1;
+    }
+    if (headLen == 0) {
+        return (ssize_t)n;
+    }
+    conn.wireHeadLen = 0;
+    conn.headerRead = sizeof(MsgHeader);
+    return (ssize_t)(headLen - before);
+}
 
-    std::string targetName = body.substr(0, firstPipe);
-    std::string restInfo = body.substr(firstPipe + 1);
-
-    int targetFd = -1; // -1代表群发
-    if (!targetName.empty()) {
-        std::lock_guard<std::mutex> lock(g_clientsMutex);
-        for (auto &cli : g_clients) {
-            if (cli.name == targetName) {
-                targetFd = cli.socketFd;
-                break;
+// 增量解码内存中的字节: 取出其中所有完整的包, 末尾不完整的部分记在连接的解码状态里
+// 额度用尽后已读到的数据仍照常处理, 超出窗口的最多是一次读取的量
+void ConsumeBytes(Shard &shard, Connection &conn, const char *data, size_t len)
+{
+    while (len > 0 && !conn.closing) {
+        if (conn.headerRead < sizeof(MsgHeader)) {
+            ssize_t n = TakeHeader(conn, data, len);
+            if (n < 0) {
+                CloseClient(shard, conn.socketFd);
+                return;
+            }
+            data += n;
+            len -= n;
+            if (conn.headerRead < sizeof(MsgHeader) || !BeginFrame(shard, conn)) {
+                return;
             }
+            // 包体已有一部分读进内存, 不能再从 socket splice, 这个文件块照常读入后转发
+            conn.relayProbe = conn.relayProbe && len == 0;
         }
-        if (targetFd == -1) {
-            SendPacket(clientFd, MSG_CHAT_TEXT, "[系统]: 目标不在线，文件取消");
+        size_t n = std::min(len, BodySize(conn) - conn.bodyRead);
+        if (n > 0) {
+            memcpy(BodyBuffer(conn) + conn.bodyRead, data, n);
+        }
+        conn.bodyRead += n;
+        data += n;
+        len -= n;
+        if (conn.bodyRead < BodySize(conn)) {
             return;
         }
+        FinishFrame(shard, conn);
     }
+}
 
-    {
-        std::lock_guard<std::mutex> lock(g_fileMutex);
-        g_fileTransferRoutes[clientFd] = targetFd;
+#ifndef CHAT_USE_IO_URING
+// 下一次缓冲读取最多读多少: 连接上有 splice 路由时不越过当前包的边界,
+// 文件块的包体要留在 socket 里才能 splice, 这类连接传的是大块, 多几次 recv 无妨
+size_t BufferedReadLen(const Connection &conn)
+{
+    if (!g_spliceRelay || conn.fileRoutes.empty()) {
+        return READ_CHUNK;
     }
+    if (conn.headerRead < sizeof(MsgHeader) && conn.recvProtocol == PROTOCOL_V1) {
+        return sizeof(MsgHeader) - conn.headerRead;
+    }
+    if (conn.headerRead < sizeof(MsgHeader)) {
+        // v2 包头: 每个还没读完的 varint 至少还有一个字节
+        size_t finished = 0;
+        for (size_t i = 0; i < conn.wireHeadLen; ++i) {
+            finished += ((uint8_t)conn.wireHead[i] & 0x80) == 0;
+        }
+        return 3 - finished;
+    }
+    return std::min(READ_CHUNK, BodySize(conn) - conn.bodyRead);
+}
 
-    if (targetFd == -1) {
-        BroadcastPacket(MSG_FILE_INFO, restInfo, clientFd);
-    } else {
-        SendPacket(targetFd, MSG_FILE_INFO, restInfo);
+// 读取一次: splice 转发与大包体的剩余部分直接读入, 其余经分片读缓冲区批量读入后解码
+// consumed 为读到的字节数; 返回 false 表示 socket 暂时读空或连接已关闭
+bool ReadOnce(Shard &shard, Connection &conn, size_t &consumed)
+{
+    bool done = false;
+    bool inBody = conn.headerRead == sizeof(MsgHeader);
+    consumed = 0;
+    if (inBody && conn.relayProbe) {
+        size_t before = conn.bodyRead;
+        if (!RecvFixedLen(conn.socketFd, &conn.body[0], TRANSFER_ID_LEN, conn.bodyRead, done)) {
+            CloseClient(shard, conn.socketFd);
+            return false;
+        }
+        consumed = conn.bodyRead - before;
+        if (!done) {
+            return false;
+        }
+        conn.relayProbe = false;
+        BeginRelay(conn);
+        return true;
+    }
+    if (inBody && conn.relaySplicing) {
+        size_t before = conn.relayPipeBytes;
+        if (!SpliceToPipe(conn, conn.header.bodyLen - TRANSFER_ID_LEN, done)) {
+            CloseClient(shard, conn.socketFd);
+            return false;
+        }
+        consumed = conn.relayPipeBytes - before;
+        if (!done) {
+            return false;
+        }
+        // 管道满时剩余包体改为普通读入 conn.body
+        conn.relaySplicing = false;
+        conn.body.resize(conn.header.bodyLen - TRANSFER_ID_LEN - conn.relayPipeBytes);
+        if (conn.body.empty()) {
+            FinishFrame(shard, conn);
+        }
+        return true;
+    }
+    if (inBody && (conn.relaying || BodySize(conn) - conn.bodyRead >= DIRECT_READ_MIN)) {
+        size_t before = conn.bodyRead;
+        if (!RecvFixedLen(conn.socketFd, BodyBuffer(conn), BodySize(conn), conn.bodyRead, done)) {
+            CloseClient(shard, conn.socketFd);
+            return false;
+        }
+        consumed = conn.bodyRead - before;
+        if (!done) {
+            return false;
+        }
+        FinishFrame(shard, conn);
+        return true;
+    }
+    size_t want = BufferedReadLen(conn);
+    while (true) {
+        ssize_t received = recv(conn.socketFd, shard.readBuf.data(), want, 0);
+        if (received > 0) {
+            consumed = received;
+            ConsumeBytes(shard, conn, shard.readBuf.data(), received);
+            // 流式 socket 读不满说明内核中已读空 (见 epoll(7)), 之后到达的数据会触发新的边沿, 省掉一次 EAGAIN 的 recv
+            return (size_t)received == want;
+        }
+        if (received == -1 && errno == EINTR) {
+            continue;
+        }
+        if (received == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return false;
+        }
+        CloseClient(shard, conn.socketFd);
+        return false;
     }
 }
 
-// 处理客户端逻辑
-void HandleClient(int clientFd)
+// 可读事件: 边沿触发, 必须一直读到 EAGAIN (或读满 READ_BUDGET 后让出, 下一轮继续)
+// 持续发送大文件的连接因此不会让同一分片上的聊天消息一直等着
+// 小包经读缓冲区批量读取, 流水线发来的多条消息只需一次 recv
+// 转发额度用尽时不再读取, 数据留在内核里, 上传方的 TCP 窗口随之关闭
+void HandleReadable(Shard &shard, Connection &conn)
 {
-    char buffer[MAX_BUFFER_SIZE];
-    std::string clientName = "Unknown";
+    size_t budget = READ_BUDGET;
+    while (!conn.closing && !(conn.credit && conn.credit->Paused())) {
+        size_t consumed = 0;
+        if (!ReadOnce(shard, conn, consumed)) {
+            return;
+        }
+        if (consumed >= budget) {
+            YieldRead(shard, conn);
+            return;
+        }
+        budget -= consumed;
+    }
+}
 
-    while (true) {
-        MsgHeader header;
-        if (!RecvFixedLen(clientFd, (char *)&header, sizeof(MsgHeader))) {
-            break;
+void HandleClientEvent(Shard &shard, int clientFd, uint32_t events)
+{
+    Connection *found = shard.conns.Find(clientFd);
+    if (found == nullptr) {
+        return;
+    }
+    Connection &conn = *found;
+    if (events & EPOLLIN) {
+        HandleReadable(shard, conn);
+    }
+    if ((events & EPOLLOUT) && !conn.closing) {
+        conn.writeBlocked = false;
+        FlushClient(shard, conn);
+    }
+    if ((events & EPOLLERR) && !conn.closing) {
+        // 零拷贝完成通知也经错误队列上报, 只有 SO_ERROR 非零才是真正的错误
+        conn.outQueue.ReapZeroCopy(clientFd);
+        int err = 0;
+        socklen_t errLen = sizeof(err);
+        getsockopt(clientFd, SOL_SOCKET, SO_ERROR, &err, &errLen);
+        if (err != 0) {
+            CloseClient(shard, clientFd);
         }
-        if (header.bodyLen > sizeof(buffer) || header.bodyLen < 0) {
-            break;
+    }
+    if ((events & EPOLLHUP) && !conn.closing) {
+        CloseClient(shard, clientFd);
+    }
+}
+#endif
+
+// 关闭连接: 立即摘除事件, 资源在本轮事件处理完后再回收,
+// 避免广播遍历 conns 途中删除元素
+void CloseClient(Shard &shard, int clientFd)
+{
+    Connection *conn = shard.conns.Find(clientFd);
+    if (conn == nullptr || conn->closing) {
+        return;
+    }
+    conn->closing = true;
+    UnwatchClient(shard, clientFd);
+
+    Shard *owner = &shard;
+    shard.loop.RunInLoop([owner, clientFd]() {
+        Connection *conn = owner->conns.Find(clientFd);
+        if (conn == nullptr) {
+            return;
         }
-        if (header.bodyLen > 0) {
-            if (!RecvFixedLen(clientFd, buffer, header.bodyLen)) {
-                break;
+        std::string clientName = conn->name;
+        uint64_t sessionId = conn->sessionId;
+        bool loggedIn = conn->loggedIn;
+        // 未完成的一对一传输通知接收方中断, 避免其一直等待; 群发的上传留在仓库待续传
+        for (const auto &route : conn->fileRoutes) {
+            if (route.second.target.fd != -1) {
+                SendFrame(route.second.target, MakeFrame(MSG_FILE_END, (const char *)&route.first, TRANSFER_ID_LEN,
+                                                         (int32_t)sessionId));
             }
         }
+        owner->conns.Erase(clientFd);
+        close(clientFd);
 
-        std::string body(buffer, header.bodyLen);
-        if (header.type == MSG_LOGIN) {
-            HandleLogin(clientFd, body, clientName);
-        } else if (header.type == MSG_CHAT_TEXT) {
-            BroadcastPacket(MSG_CHAT_TEXT, body, clientFd);
-        } else if (header.type == MSG_CHAT_PRIVATE) {
-            HandlePrivateChat(clientFd, clientName, body);
-        } else if (header.type == MSG_FILE_INFO) {
-            HandleFileInfo(clientFd, body);
-        } else if (header.type == MSG_FILE_DATA) {
-            // 文件数据块直接转发，不解包字符串
-            int targetFd = -2;
-            {
-                std::lock_guard<std::mutex> lock(g_fileMutex);
-                if (g_fileTransferRoutes.count(clientFd)) {
-                    targetFd = g_fileTransferRoutes[clientFd];
-                }
-            }
-            if (targetFd == -1) {
-                BroadcastPacket(MSG_FILE_DATA, body, clientFd);
-            } else if (targetFd >= 0) {
-                // 发送头和体
-                send(targetFd, (char *)&header, sizeof(header), 0);
-                send(targetFd, buffer, header.bodyLen, 0);
-            }
-        } else if (header.type == MSG_LOGOUT) {
-            break;
+        if (loggedIn && g_roster.Remove(clientName, sessionId)) {
+            g_presence.Leave(clientName, sessionId);
         }
-    }
+    });
+}
 
-    // 清理资源
-    close(clientFd);
-    {
-        std::lock_guard<std::mutex> lock(g_fileMutex);
-        g_fileTransferRoutes.erase(clientFd);
+// 把连接挂到所属分片的事件循环上
+bool WatchClient(Shard &shard, int clientFd)
+{
+    Shard *owner = &shard;
+#ifdef CHAT_USE_IO_URING
+    shard.loop.AddConnection(clientFd, [owner, clientFd](const char *data, size_t len) {
+        Connection *conn = owner->conns.Find(clientFd);
+        if (conn == nullptr) {
+            return;
+        }
+        if (len == 0) {
+            CloseClient(*owner, clientFd);
+        } else {
+            ConsumeBytes(*owner, *conn, data, len);
+        }
+    }, [owner, clientFd]() {
+        Connection *conn = owner->conns.Find(clientFd);
+        if (conn != nullptr && !conn->closing) {
+            FlushClient(*owner, *conn);
+        }
+    });
+    return true;
+#else
+    // 边沿触发下同时关注读写, 之后无需再修改事件掩码
+    uint32_t events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    return shard.loop.AddFd(clientFd, events,
+        [owner, clientFd](uint32_t ev) { HandleClientEvent(*owner, clientFd, ev); });
+#endif
+}
+
+void UnwatchClient(Shard &shard, int clientFd)
+{
+#ifdef CHAT_USE_IO_URING
+    shard.loop.RemoveConnection(clientFd);
+#else
+    shard.loop.RemoveFd(clientFd);
+#endif
+}
+
+void AcceptClient(Shard &shard, int clientFd)
+{
+    Connection &conn = shard.conns.Insert(clientFd);
+    conn.sessionId = g_nextSessionId.fetch_add(1);
+    if (g_zeroCopy) {
+        int opt = 1;
+        setsockopt(clientFd, SOL_SOCKET, SO_ZEROCOPY, &opt, sizeof(opt));
     }
-    {
-        std::lock_guard<std::mutex> lock(g_clientsMutex);
-        g_clients.erase(std::remove_if(g_clients.begin(), g_clients.end(), 
-            [clientFd](const ClientContext &c){ return c.socketFd == clientFd; }), 
-            g_clients.end());
+    if (g_notsentLowat > 0) {
+        setsockopt(clientFd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &g_notsentLowat, sizeof(g_notsentLowat));
     }
-    
-    if (clientName != "Unknown") {
-        std::string notify = "[系统]: " + clientName + " 离开了群聊";
-        BroadcastPacket(MSG_CHAT_TEXT, notify, -1);
-        BroadcastUserList();
+    if (!WatchClient(shard, clientFd)) {
+        shard.conns.Erase(clientFd);
+        close(clientFd);
     }
 }
 
-void AdminConsole()
+void HandleAccept(Shard &shard)
 {
-    std::string input;
     while (true) {
-        std::getline(std::cin, input);
-        if (input.empty()) {
-            continue;
+        sockaddr_in clientAddr;
+        socklen_t len = sizeof(clientAddr);
+        int clientFd = accept4(shard.listenFd, (sockaddr *)&clientAddr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientFd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return; // EAGAIN: 已取完
         }
-        std::string msg = "[系统公告]: " + input;
-        BroadcastPacket(MSG_CHAT_TEXT, msg, -1);
+        AcceptClient(shard, clientFd);
     }
 }
 
-int main(int argc, char *argv[])
+bool WatchListener(Shard &shard)
 {
-    int port = DEFAULT_PORT;
-    if (argc > 1) {
-        port = std::atoi(argv[1]);
-    }
+    Shard *owner = &shard;
+#ifdef CHAT_USE_IO_URING
+    return shard.loop.AddAcceptor(shard.listenFd, [owner](int clientFd) { AcceptClient(*owner, clientFd); });
+#else
+    return shard.loop.AddFd(shard.listenFd, EPOLLIN | EPOLLET, [owner](uint32_t) { HandleAccept(*owner); });
+#endif
+}
 
-    int serverFd = socket(AF_INET, SOCK_STREAM, 0);
+// 每个分片独立 bind 同一端口, 由内核按连接哈希分发
+int CreateListenSocket(int port)
+{
+    int serverFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (serverFd == -1) {
         perror("Socket failed");
         return -1;
@@ -276,39 +1855,158 @@ int main(int argc, char *argv[])
 
     int opt = 1;
     setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (setsockopt(serverFd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
+        perror("SO_REUSEPORT failed");
+        close(serverFd);
+        return -1;
+    }
 
     sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
     addr.sin_addr.s_addr = INADDR_ANY;
-    
+
     if (bind(serverFd, (sockaddr *)&addr, sizeof(addr)) == -1) {
         perror("Bind failed");
+        close(serverFd);
         return -1;
     }
-    
+
     if (listen(serverFd, LISTEN_BACKLOG) == -1) {
         perror("Listen failed");
+        close(serverFd);
         return -1;
     }
-    
-    std::cout << "----------------------------------------" << std::endl;
-    std::cout << " Server started on port " << port << std::endl;
-    std::thread(AdminConsole).detach();
+    return serverFd;
+}
+
+void RunShard(Shard *shard)
+{
+    t_shard = shard;
+    int cpuCount = (int)std::thread::hardware_concurrency();
+    if (cpuCount > 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(shard->index % cpuCount, &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    shard->loop.Loop();
+}
 
+void AdminConsole()
+{
+    std::string input;
     while (true) {
-        sockaddr_in clientAddr;
-        socklen_t len = sizeof(clientAddr);
-        int clientFd = accept(serverFd, (sockaddr *)&clientAddr, &len);
-        if (clientFd != -1) {
-            {
-                std::lock_guard<std::mutex> lock(g_clientsMutex);
-                g_clients.push_back({clientFd, "Unknown"});
-            }
-            std::thread(HandleClient, clientFd).detach();
+        std::getline(std::cin, input);
+        if (input.empty()) {
+            continue;
+        }
+        std::string msg = "[系统公告]: " + input;
+        BroadcastPacket(MSG_CHAT_TEXT, msg, 0);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    // 用法: chat_server [端口] [分片数] [--zerocopy]
+    //       [--high-watermark=字节] [--low-watermark=字节] [--slow-policy=drop|conflate|disconnect]
+    //       [--presence-window=毫秒] [--splice] [--store=目录] [--max-chunk=字节]
+    //       [--notsent-lowat=字节] [--relay-window=字节] [--relay-budget=字节] [--protocol=1|2] [--compress=0]
+    //       [--batch=0] [--batch-window=微秒]
+    int port = DEFAULT_PORT;
+    int shardCount = (int)std::thread::hardware_concurrency(); // 默认每个核一个
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--zerocopy") {
+            g_zeroCopy = true;
+        } else if (arg == "--splice") {
+            g_spliceRelay = true;
+        } else if (arg.compare(0, 17, "--high-watermark=") == 0) {
+            g_queueLimits.highWatermark = std::strtoul(arg.c_str() + 17, nullptr, 10);
+        } else if (arg.compare(0, 16, "--low-watermark=") == 0) {
+            g_queueLimits.lowWatermark = std::strtoul(arg.c_str() + 16, nullptr, 10);
+        } else if (arg.compare(0, 18, "--presence-window=") == 0) {
+            g_presenceWindowMs = std::atoi(arg.c_str() + 18);
+        } else if (arg.compare(0, 8, "--store=") == 0) {
+            g_storeDir = arg.substr(8);
+        } else if (arg.compare(0, 12, "--max-chunk=") == 0) {
+            g_maxChunkSize = std::atoi(arg.c_str() + 12);
+        } else if (arg.compare(0, 16, "--notsent-lowat=") == 0) {
+            g_notsentLowat = std::atoi(arg.c_str() + 16);
+        } else if (arg.compare(0, 15, "--relay-window=") == 0) {
+            g_relayWindow = std::strtoul(arg.c_str() + 15, nullptr, 10);
+        } else if (arg.compare(0, 15, "--relay-budget=") == 0) {
+            g_relayBudget.SetLimit(std::strtoul(arg.c_str() + 15, nullptr, 10));
+        } else if (arg == "--protocol=1") {
+            g_maxProtocol = PROTOCOL_V1;
+        } else if (arg == "--compress=0") {
+            g_features &= ~FEATURE_COMPRESS;
+        } else if (arg == "--batch=0") {
+            g_features &= ~FEATURE_BATCH;
+        } else if (arg.compare(0, 15, "--batch-window=") == 0) {
+            g_batchWindowMaxUs = (uint32_t)std::strtoul(arg.c_str() + 15, nullptr, 10);
+        } else if (arg == "--slow-policy=drop") {
+            g_queueLimits.policy = SLOW_DROP;
+        } else if (arg == "--slow-policy=conflate") {
+            g_queueLimits.policy = SLOW_CONFLATE;
+        } else if (arg == "--slow-policy=disconnect") {
+            g_queueLimits.policy = SLOW_DISCONNECT;
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    if (positional.size() > 0) {
+        port = std::atoi(positional[0].c_str());
+    }
+    if (positional.size() > 1) {
+        shardCount = std::atoi(positional[1].c_str());
+    }
+    if (shardCount <= 0) {
+        shardCount = 1;
+    }
+    if (g_presenceWindowMs < 0) {
+        g_presenceWindowMs = 0;
+    }
+    g_maxChunkSize = std::max(FILE_CHUNK_SIZE, std::min(g_maxChunkSize, MAX_FILE_CHUNK_SIZE));
+#ifdef CHAT_USE_IO_URING
+    if (g_spliceRelay) {
+        std::cout << "io_uring 后端不支持 --splice, 已忽略" << std::endl;
+        g_spliceRelay = false;
+    }
+#endif
+    if (g_queueLimits.lowWatermark > g_queueLimits.highWatermark) {
+        g_queueLimits.lowWatermark = g_queueLimits.highWatermark;
+    }
+    if (!g_fileStore.Open(g_storeDir)) {
+        return -1;
+    }
+
+    PoolReserve(1);
+    for (int i = 0; i < shardCount; ++i) {
+        std::unique_ptr<Shard> shard(new Shard());
+        shard->index = i;
+        shard->bundle.reserve(2 * BUNDLE_MAX_BYTES); // 封口前最多再超出一条消息, 普通聊天消息不会让它扩容
+        shard->listenFd = CreateListenSocket(port);
+        if (shard->listenFd == -1 || !shard->loop.Init() || !WatchListener(*shard)) {
+            return -1;
         }
+        g_shards.push_back(std::move(shard));
+    }
+
+    std::cout << "----------------------------------------" << std::endl;
+    std::cout << " Server started on port " << port << " with " << shardCount << " reactor(s)" << std::endl;
+    std::thread(AdminConsole).detach();
+    g_presence.Start(g_presenceWindowMs, PublishPresence);
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < shardCount; ++i) {
+        threads.emplace_back(RunShard, g_shards[i].get());
+    }
+    RunShard(g_shards[0].get());
+    for (auto &t : threads) {
+        t.join();
     }
-    close(serverFd);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,180 @@
+/*
+ * Description: 经 LD_PRELOAD 注入服务端的分配计数器: 统计 malloc 系列与 operator new 的调用次数,
+ *              收到 SIGUSR1 时把累计次数写到标准错误 ("ALLOCS 次数"), 由 BroadcastAllocTest 读取
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#include <signal.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static std::atomic<long> g_allocs{0};
+
+static void Count()
+{
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" void *malloc(size_t size)
+{
+    Count();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    Count();
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    Count();
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+    Count();
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **out, size_t alignment, size_t size)
+{
+    Count();
+    *out = __libc_memalign(alignment, size);
+    return *out == nullptr ? ENOMEM : 0;
+}
+
+extern "C" void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+static void *NewBlock(size_t size)
+{
+    Count();
+    void *ptr = __libc_malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+static void *NewAligned(size_t size, std::align_val_t alignment)
+{
+    Count();
+    void *ptr = __libc_memalign((size_t)alignment, size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new(size_t size)
+{
+    return NewBlock(size);
+}
+
+void *operator new[](size_t size)
+{
+    return NewBlock(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    Count();
+    return __libc_malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    Count();
+    return __libc_malloc(size == 0 ? 1 : size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    return NewAligned(size, alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+    return NewAligned(size, alignment);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    __libc_free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    __libc_free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    __libc_free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    __libc_free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    __libc_free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    __libc_free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+    __libc_free(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept
+{
+    __libc_free(ptr);
+}
+
+// 信号处理中只用 write
+static void Report(int)
+{
+    char line[32] = "ALLOCS ";
+    char digits[20];
+    long value = g_allocs.load(std::memory_order_relaxed);
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    int len = 7;
+    while (n > 0) {
+        line[len++] = digits[--n];
+    }
+    line[len++] = '\n';
+    ssize_t ignored = write(STDERR_FILENO, line, len);
+    (void)ignored;
+}
+
+__attribute__((constructor)) static void InstallReporter()
+{
+    signal(SIGUSR1, Report);
+}
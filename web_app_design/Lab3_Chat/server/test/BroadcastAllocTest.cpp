@@ -0,0 +1,120 @@
+/*
+ * Description: 群聊广播的分配测试: 服务端注入 AllocCounter, 预热到某一轮不再分配之后, 再一轮广播中
+ *              malloc 与 operator new 的次数必须为 0
+ *              用法: broadcast_alloc_test <chat_server 路径> <liballoc_counter.so 路径>
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#include <poll.h>
+#include <signal.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "TestSupport.h"
+
+const int CLIENT_COUNT = 8;
+const int ROUND_MESSAGES = 5000;
+const int MAX_WARMUP_ROUNDS = 10; // 预热轮数上限, 到这么多轮仍在分配则失败
+
+// 各种接收方都要有: v1, v2, v2 + 压缩, v2 + 压缩 + 合批
+static const int CLIENT_FEATURES[4] = {-1, 0, FEATURE_COMPRESS, FEATURE_COMPRESS | FEATURE_BATCH};
+
+static std::atomic<long> g_received{0};
+static std::atomic<bool> g_stop{false};
+
+static void DrainAll(std::vector<std::unique_ptr<TestClient>> &clients)
+{
+    std::vector<pollfd> fds;
+    for (auto &client : clients) {
+        fds.push_back({client->Fd(), POLLIN, 0});
+    }
+    while (!g_stop) {
+        if (poll(fds.data(), fds.size(), 50) <= 0) {
+            continue;
+        }
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i].revents != 0) {
+                g_received += (long)clients[i]->Discard();
+            }
+        }
+    }
+}
+
+// 发一轮群聊, 等到接收方不再收到字节
+static void Round(std::vector<std::unique_ptr<TestClient>> &clients, const std::vector<std::string> &names)
+{
+    for (int i = 0; i < ROUND_MESSAGES; ++i) {
+        int index = i % CLIENT_COUNT;
+        std::string text = "hello world message " + std::to_string(i);
+        if (CLIENT_FEATURES[index % 4] < 0) {
+            text = "[" + names[index] + "]: " + text;
+        }
+        CHECK(clients[index]->Send(MSG_CHAT_TEXT, text));
+        if (i % 50 == 49) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    long last = -1;
+    while (g_received != last) {
+        last = g_received;
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    }
+}
+
+static long AllocCount(ServerProcess &server)
+{
+    CHECK(kill(server.pid, SIGUSR1) == 0);
+    std::string count;
+    CHECK(ReadServerLine(server, "ALLOCS ", count, 2000));
+    return std::atol(count.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+    CHECK(argc == 3);
+    ServerProcess server;
+    // 两个分片, 广播要经过跨分片的邮箱
+    CHECK(StartServer(server, argv[1], {"2"}, argv[2]));
+
+    std::vector<std::unique_ptr<TestClient>> clients;
+    std::vector<std::string> names;
+    for (int i = 0; i < CLIENT_COUNT; ++i) {
+        int features = CLIENT_FEATURES[i % 4];
+        names.push_back("user" + std::to_string(i));
+        clients.emplace_back(new TestClient());
+        if (features < 0) {
+            CHECK(clients.back()->Login(server.port, names.back()));
+        } else {
+            CHECK(clients.back()->Login(server.port, names.back(), PROTOCOL_V2, features));
+            CHECK(clients.back()->WaitLoggedIn(2000));
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300)); // 上线通知发布完
+    std::thread drain(DrainAll, std::ref(clients));
+
+    // 预热: 缓冲区池、队列容量等随流量增长, 直到完整的一轮不再分配
+    int warmup = 0;
+    long warmAllocs = -1;
+    while (warmAllocs != 0) {
+        CHECK(warmup++ < MAX_WARMUP_ROUNDS);
+        long count = AllocCount(server);
+        Round(clients, names);
+        warmAllocs = AllocCount(server) - count;
+    }
+    long before = AllocCount(server);
+    long bytesBefore = g_received;
+    Round(clients, names);
+    long allocs = AllocCount(server) - before;
+    long bytes = g_received - bytesBefore;
+
+    g_stop = true;
+    drain.join();
+    StopServer(server);
+    std::printf("broadcast_alloc_test: 预热 %d 轮后, %d 条群聊广播给 %d 个客户端 (%ld 字节), 分配 %ld 次\n", warmup,
+                ROUND_MESSAGES, CLIENT_COUNT, bytes, allocs);
+    CHECK(bytes > 0);
+    CHECK(allocs == 0);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+/*
+ * Description: 大文件转发期间的聊天延迟基准: 一个客户端以 1 MB 文件块持续向接收方发文件,
+ *              另一个客户端每 5 ms 给同一接收方发一条私聊 (正文为发出时刻), 统计私聊从发出到接收方解析出的延迟
+ *              用法: chat_latency_bench <chat_server 路径> [兆字节数, 默认 1024] [服务端参数...]
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#include <sys/socket.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <thread>
+#include "TestSupport.h"
+
+const int CHUNK_SIZE = MAX_FILE_CHUNK_SIZE;
+const int CHAT_INTERVAL_MS = 5;
+
+// 接收方: 按 v1 包解析, 文件块只数字节, 私聊取出正文末尾的发出时刻
+static void Receive(int fd, int64_t total, std::vector<int64_t> &latencies)
+{
+    static char buf[4 * 1024 * 1024];
+    MsgHeader header;
+    size_t headGot = 0;
+    size_t bodyLeft = 0;
+    std::string text;
+    int64_t got = 0;
+    while (got < total) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        CHECK(n > 0);
+        const char *p = buf;
+        const char *end = buf + n;
+        while (p < end) {
+            if (headGot < sizeof(header)) {
+                size_t take = std::min(sizeof(header) - headGot, (size_t)(end - p));
+                memcpy((char *)&header + headGot, p, take);
+                headGot += take;
+                p += take;
+                if (headGot == sizeof(header)) {
+                    bodyLeft = header.bodyLen;
+                    text.clear();
+                    if (header.type == MSG_FILE_DATA) {
+                        got += header.bodyLen - (int64_t)sizeof(FileChunkHeader);
+                    }
+                }
+            } else {
+                size_t take = std::min(bodyLeft, (size_t)(end - p));
+                if (header.type == MSG_CHAT_PRIVATE) {
+                    text.append(p, take);
+                }
+                p += take;
+                bodyLeft -= take;
+            }
+            if (headGot == sizeof(header) && bodyLeft == 0) {
+                if (header.type == MSG_CHAT_PRIVATE) {
+                    latencies.push_back(NowUs() - std::atoll(text.c_str() + text.rfind(' ') + 1));
+                }
+                headGot = 0;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    CHECK(argc >= 2);
+    int64_t megabytes = argc > 2 ? std::atol(argv[2]) : 1024;
+    std::vector<std::string> args(argv + std::min(argc, 3), argv + argc);
+    int64_t total = megabytes * CHUNK_SIZE;
+
+    ServerProcess server;
+    CHECK(StartServer(server, argv[1], args));
+    TestClient receiver;
+    TestClient sender;
+    TestClient chatter;
+    CHECK(receiver.Login(server.port, "recv", PROTOCOL_V1, 0, CHUNK_SIZE));
+    CHECK(receiver.WaitLoggedIn(2000));
+    CHECK(sender.Login(server.port, "send", PROTOCOL_V1, 0, CHUNK_SIZE));
+    CHECK(sender.WaitLoggedIn(2000));
+    CHECK(chatter.Login(server.port, "chat"));
+    // 读走登录后的用户列表与系统消息, 之后接收方直接从 socket 解析
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    MsgHeader header;
+    std::string body;
+    while (receiver.Receive(header, body, 0)) {
+    }
+    CHECK(sender.Send(MSG_FILE_INFO, "recv|1|big.bin|" + std::to_string(total)));
+
+    std::vector<int64_t> latencies;
+    std::atomic<bool> done(false);
+    int64_t start = NowUs();
+    std::thread reader([&] {
+        Receive(receiver.Fd(), total, latencies);
+        done = true;
+    });
+    std::thread chat([&] {
+        while (!done) {
+            CHECK(chatter.Send(MSG_CHAT_PRIVATE, "recv|" + std::to_string(NowUs())));
+            chatter.Discard(); // 服务端给发送方的回显
+            std::this_thread::sleep_for(std::chrono::milliseconds(CHAT_INTERVAL_MS));
+        }
+    });
+
+    std::string data(CHUNK_SIZE, '\0');
+    std::mt19937 random(1);
+    for (char &c : data) {
+        c = (char)random();
+    }
+    for (int64_t offset = 0; offset < total; offset += CHUNK_SIZE) {
+        FileChunkHeader chunk = {1, 0, offset};
+        MsgHeader frame = {MSG_FILE_DATA, (int32_t)(sizeof(chunk) + CHUNK_SIZE), 0};
+        CHECK(sender.SendRaw(&frame, sizeof(frame)) && sender.SendRaw(&chunk, sizeof(chunk)) &&
+              sender.SendRaw(data.data(), data.size()));
+    }
+    reader.join();
+    chat.join();
+    double seconds = (NowUs() - start) / 1e6;
+    StopServer(server);
+
+    CHECK(!latencies.empty());
+    std::sort(latencies.begin(), latencies.end());
+    size_t n = latencies.size();
+    std::printf("转发 %ld MB, %.0f MB/s; %zu 条私聊延迟 p50 %.2f ms p99 %.2f ms 最大 %.2f ms\n", (long)megabytes,
+                megabytes / seconds, n, latencies[n / 2] / 1e3, latencies[std::min(n - 1, n * 99 / 100)] / 1e3,
+                latencies.back() / 1e3);
+    return EXIT_SUCCESS;
+}
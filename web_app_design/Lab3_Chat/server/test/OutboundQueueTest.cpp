@@ -0,0 +1,189 @@
+/*
+ * Description: 发送队列测试: 一路传输中压缩与未压缩的文件块交替出现时, 接收方按偏移顺序收到,
+ *              且文件块不进流式压缩、不进合批; 穿插其间的聊天消息照常送达;
+ *              转发中的文件块积压再多, 发给接收方的聊天消息也不被判为慢消费者
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../../common/Crc32c.h"
+#include "../FlowControl.h"
+#include "../Frame.h"
+#include "../OutboundQueue.h"
+#include "TestSupport.h"
+
+const int CHUNK_COUNT = 8;
+const size_t CHUNK_LEN = 32 * 1024;
+const int32_t SENDER_ID = 7;
+const uint32_t TRANSFER_ID = 42;
+
+struct Received {
+    std::vector<int64_t> offsets; // 文件块按到达顺序的偏移
+    std::vector<int> types;
+    int chats = 0;
+};
+
+static std::string ChunkData(int index)
+{
+    std::string data;
+    while (data.size() < CHUNK_LEN) {
+        data += "chunk " + std::to_string(index) + " line " + std::to_string(data.size()) + "\n";
+    }
+    data.resize(CHUNK_LEN);
+    return data;
+}
+
+// 偶数块原样发 MSG_FILE_DATA, 奇数块单块压缩后发 MSG_FILE_PACKED, 与客户端压不动时退回原样的做法相同
+static FrameRef ChunkFrame(int index)
+{
+    std::string data = ChunkData(index);
+    FileChunkHeader chunk;
+    chunk.transferId = TRANSFER_ID;
+    chunk.crc = Crc32c(0, data.data(), data.size());
+    chunk.offset = (int64_t)index * CHUNK_LEN;
+    std::string_view head((const char *)&chunk, sizeof(chunk));
+    if (index % 2 == 1) {
+        std::string packed;
+        CHECK(LzCompressBlock(data.data(), data.size(), packed));
+        return MakeFrame(MSG_FILE_PACKED, {head, packed}, SENDER_ID);
+    }
+    return MakeFrame(MSG_FILE_DATA, {head, data}, SENDER_ID);
+}
+
+static void OnFrame(Received &out, const MsgHeader &header, const char *body, size_t len, bool nested)
+{
+    int type = header.type & ~COMPRESSED_FLAG;
+    if (type == MSG_CHAT_TEXT) {
+        ++out.chats;
+        return;
+    }
+    CHECK(type == MSG_FILE_DATA || type == MSG_FILE_PACKED);
+    CHECK((header.type & COMPRESSED_FLAG) == 0); // 文件块不走流式压缩
+    CHECK(!nested);                              // 也不合进批次
+    FileChunkHeader chunk;
+    CHECK(len >= sizeof(chunk));
+    memcpy(&chunk, body, sizeof(chunk));
+    CHECK(chunk.transferId == TRANSFER_ID);
+    std::string data(body + sizeof(chunk), len - sizeof(chunk));
+    if (type == MSG_FILE_PACKED) {
+        std::string raw;
+        CHECK(LzDecompressBlock(data.data(), data.size(), MAX_FILE_CHUNK_SIZE, raw));
+        data = raw;
+    }
+    CHECK(Crc32c(0, data.data(), data.size()) == chunk.crc);
+    out.offsets.push_back(chunk.offset);
+    out.types.push_back(type);
+}
+
+// 解析 v2 字节流: 带 COMPRESSED_FLAG 的包体先按流解压, MSG_BUNDLE 的包体是依次相连的 v2 帧
+static void Parse(Received &out, const std::string &stream)
+{
+    LzDecoder inflater;
+    size_t pos = 0;
+    while (pos < stream.size()) {
+        MsgHeader header;
+        int headLen = DecodeHeaderV2(stream.data() + pos, stream.size() - pos, header);
+        CHECK(headLen > 0);
+        pos += headLen;
+        CHECK(stream.size() - pos >= (size_t)header.bodyLen);
+        const char *body = stream.data() + pos;
+        size_t len = header.bodyLen;
+        pos += len;
+        if ((header.type & COMPRESSED_FLAG) && (header.type & ~COMPRESSED_FLAG) != MSG_FILE_DATA &&
+            (header.type & ~COMPRESSED_FLAG) != MSG_FILE_PACKED) {
+            CHECK(inflater.Decompress(body, len, MAX_FILE_CHUNK_SIZE, body, len));
+            header.type &= ~COMPRESSED_FLAG;
+        }
+        if (header.type != MSG_BUNDLE) {
+            OnFrame(out, header, body, len, false);
+            continue;
+        }
+        size_t inner = 0;
+        while (inner < len) {
+            MsgHeader sub;
+            int subLen = DecodeHeaderV2(body + inner, len - inner, sub);
+            CHECK(subLen > 0 && len - inner - subLen >= (size_t)sub.bodyLen);
+            OnFrame(out, sub, body + inner + subLen, sub.bodyLen, true);
+            inner += subLen + sub.bodyLen;
+        }
+    }
+}
+
+static void Drain(int fd, std::string &stream)
+{
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        stream.append(buf, n);
+    }
+}
+
+// 默认水位下转发积压超过硬上限: 带额度的文件块由上传方的窗口限制, 不计入积压, 聊天消息照常入队;
+// 不带额度的消息仍按积压判断
+static void CheckRelayBacklog()
+{
+    OutboundQueue queue;
+    auto credit = std::make_shared<UploadCredit>(64 * 1024 * 1024, []() {});
+    std::string data(MAX_FILE_CHUNK_SIZE, 'x');
+    size_t relayed = 0;
+    for (int64_t offset = 0; relayed <= g_queueLimits.highWatermark * 4; offset += MAX_FILE_CHUNK_SIZE) {
+        FileChunkHeader chunk = {TRANSFER_ID, 0, offset};
+        FrameRef frame = MakeFrame(MSG_FILE_DATA, {std::string_view((const char *)&chunk, sizeof(chunk)), data},
+                                   SENDER_ID);
+        CHECK(queue.Push(frame, credit->Take(frame.Size())) == OutboundQueue::PUSH_QUEUED);
+        relayed += frame.Size();
+    }
+    CHECK(queue.Push(MakeFrame(MSG_CHAT_PRIVATE, std::string("hello"), SENDER_ID)) == OutboundQueue::PUSH_QUEUED);
+    std::string flood(g_queueLimits.highWatermark * 4, 'y');
+    CHECK(queue.Push(MakeFrame(MSG_CHAT_TEXT, flood, SENDER_ID)) == OutboundQueue::PUSH_OVERFLOW);
+}
+
+int main()
+{
+    CheckRelayBacklog();
+
+    int fds[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    // 协商了 v2、压缩与合批的接收方; 聊天消息穿插在文件块之间入队
+    g_queueLimits.highWatermark = 64 * 1024 * 1024;
+    OutboundQueue queue;
+    queue.SetProtocol(PROTOCOL_V2);
+    queue.EnableCompression();
+    queue.EnableBatching();
+    for (int i = 0; i < CHUNK_COUNT; ++i) {
+        CHECK(queue.Push(ChunkFrame(i)) == OutboundQueue::PUSH_QUEUED);
+        std::string text = "message " + std::to_string(i);
+        CHECK(queue.Push(MakeFrame(MSG_CHAT_TEXT, text, SENDER_ID)) == OutboundQueue::PUSH_QUEUED);
+    }
+
+    std::string stream;
+    while (!queue.Empty()) {
+        CHECK(queue.Flush(fds[0], false) != OutboundQueue::FLUSH_ERROR);
+        Drain(fds[1], stream);
+    }
+    Drain(fds[1], stream);
+    close(fds[0]);
+    close(fds[1]);
+
+    Received received;
+    Parse(received, stream);
+    CHECK(received.chats == CHUNK_COUNT);
+    CHECK(received.offsets.size() == (size_t)CHUNK_COUNT);
+    for (int i = 0; i < CHUNK_COUNT; ++i) {
+        CHECK(received.offsets[i] == (int64_t)i * (int64_t)CHUNK_LEN);
+        CHECK(received.types[i] == (i % 2 == 1 ? MSG_FILE_PACKED : MSG_FILE_DATA));
+    }
+    std::printf("outbound_queue_test: %d 个文件块按序到达, %d 条聊天消息; 转发积压不影响聊天消息入队\n", CHUNK_COUNT,
+                received.chats);
+    return EXIT_SUCCESS;
+}
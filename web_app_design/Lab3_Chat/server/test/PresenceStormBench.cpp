@@ -0,0 +1,120 @@
+/*
+ * Description: 登录风暴基准: 大量客户端同时登录, 测量到每个客户端的用户列表都包含全部在线用户 (稳定状态) 所需的时间
+ *              与服务端 CPU 时间; 用户列表按快照 + 增量的版本号维护, 与客户端的做法相同
+ *              用法: presence_storm_bench <chat_server 路径> [客户端数, 默认 10000] [分片数, 默认 2]
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <memory>
+#include "TestSupport.h"
+
+struct RosterView {
+    uint64_t version = 0;
+    long users = 0;
+    bool settled = false;
+};
+
+// 包体 Version|Name1,Name2...; 返回名字个数
+static long CountNames(const std::string &body, uint64_t &version)
+{
+    size_t sep = body.find('|');
+    version = std::strtoull(body.c_str(), nullptr, 10);
+    if (sep == std::string::npos || sep + 1 == body.size()) {
+        return 0;
+    }
+    long count = 1;
+    for (size_t i = sep + 1; i < body.size(); ++i) {
+        count += body[i] == ',';
+    }
+    return count;
+}
+
+// 返回这个客户端是否刚刚达到稳定状态
+static bool Apply(RosterView &view, const MsgHeader &header, const std::string &body, long expected)
+{
+    uint64_t version;
+    if (header.type == MSG_USER_SNAPSHOT) {
+        view.users = CountNames(body, version);
+        view.version = version;
+    } else if (header.type == MSG_USER_JOINED || header.type == MSG_USER_LEFT) {
+        long count = CountNames(body, version);
+        if (version <= view.version) {
+            return false; // 快照里已经包含
+        }
+        view.users += header.type == MSG_USER_JOINED ? count : -count;
+        view.version = version;
+    } else {
+        return false;
+    }
+    if (!view.settled && view.users == expected) {
+        view.settled = true;
+        return true;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    CHECK(argc >= 2);
+    long count = argc > 2 ? std::atol(argv[2]) : 10000;
+    std::string shards = argc > 3 ? argv[3] : "2";
+
+    // 服务端继承这里的上限, 两边各需要 count 个连接
+    rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < (rlim_t)count + 64) {
+        std::fprintf(stderr, "打开文件数上限 %ld 不够 %ld 个客户端\n", (long)limit.rlim_cur, count);
+        return EXIT_FAILURE;
+    }
+
+    ServerProcess server;
+    CHECK(StartServer(server, argv[1], {shards}));
+    double cpuBefore = CpuSeconds(server.pid);
+
+    std::vector<std::unique_ptr<TestClient>> clients(count);
+    std::vector<RosterView> views(count);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    long settled = 0;
+    MsgHeader header;
+    std::string body;
+    auto service = [&](int timeoutMs) {
+        epoll_event events[256];
+        int n = epoll_wait(epfd, events, 256, timeoutMs);
+        for (int i = 0; i < n; ++i) {
+            uint32_t index = events[i].data.u32;
+            while (clients[index]->Receive(header, body, 0)) {
+                settled += Apply(views[index], header, body, count);
+            }
+        }
+    };
+
+    int64_t start = NowUs();
+    for (long i = 0; i < count; ++i) {
+        clients[i].reset(new TestClient());
+        CHECK(clients[i]->Login(server.port, "storm" + std::to_string(i)));
+        epoll_event event = {EPOLLIN, {}};
+        event.data.u32 = (uint32_t)i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, clients[i]->Fd(), &event);
+        if (i % 256 == 255) {
+            service(0); // 边登录边读, 服务端的发送队列不至于积压到断开
+        }
+    }
+    int64_t loggedIn = NowUs();
+    while (settled < count && NowUs() - loggedIn < 120 * 1000000LL) {
+        service(100);
+    }
+    int64_t steady = NowUs();
+    double cpu = CpuSeconds(server.pid) - cpuBefore;
+    StopServer(server);
+    close(epfd);
+
+    std::printf("%ld 个客户端登录: 发出登录 %.2f s, 全部看到完整用户列表 %.2f s (%ld 个达到), 服务端 CPU %.2f s\n",
+                count, (loggedIn - start) / 1e6, (steady - start) / 1e6, settled, cpu);
+    return settled == count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
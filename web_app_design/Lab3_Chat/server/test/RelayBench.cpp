@@ -0,0 +1,144 @@
+/*
+ * Description: 一对一文件转发基准: 同一份数据分别经普通转发 (读入内存再写出) 与 --splice 转发 (经管道 splice),
+ *              测量吞吐与服务端 CPU 时间; 接收方只解析包头与块头, 核对偏移连续
+ *              用法: relay_bench <chat_server 路径> [兆字节数, 默认 256] [文件块大小, 默认 65536]
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#include <sys/socket.h>
+#include <cstring>
+#include <random>
+#include <thread>
+#include "TestSupport.h"
+
+const size_t SEND_BATCH = 1024 * 1024; // 发送方攒够这么多字节写一次
+
+struct RelayResult {
+    double seconds = 0;
+    double serverCpu = 0;
+    bool ok = false;
+};
+
+// 接收方: 逐字节流解析 v1 包, 文件块只取块头, 数据不拷贝
+static bool ReceiveChunks(int fd, int64_t total)
+{
+    static char buf[SEND_BATCH];
+    MsgHeader header;
+    FileChunkHeader chunk;
+    size_t headGot = 0;
+    size_t bodyLeft = 0;
+    size_t chunkGot = 0;
+    int64_t expected = 0;
+    while (expected < total) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return false;
+        }
+        const char *p = buf;
+        const char *end = buf + n;
+        while (p < end) {
+            if (headGot < sizeof(header)) {
+                size_t take = std::min(sizeof(header) - headGot, (size_t)(end - p));
+                memcpy((char *)&header + headGot, p, take);
+                headGot += take;
+                p += take;
+                bodyLeft = headGot == sizeof(header) ? (size_t)header.bodyLen : 0;
+                chunkGot = 0;
+                continue;
+            }
+            if (header.type == MSG_FILE_DATA && chunkGot < sizeof(chunk)) {
+                size_t take = std::min(sizeof(chunk) - chunkGot, (size_t)(end - p));
+                memcpy((char *)&chunk + chunkGot, p, take);
+                chunkGot += take;
+                p += take;
+                bodyLeft -= take;
+                if (chunkGot == sizeof(chunk)) {
+                    CHECK(chunk.offset == expected);
+                    expected += header.bodyLen - (int64_t)sizeof(chunk);
+                }
+            } else {
+                size_t take = std::min(bodyLeft, (size_t)(end - p));
+                p += take;
+                bodyLeft -= take;
+            }
+            if (bodyLeft == 0) {
+                headGot = 0;
+            }
+        }
+    }
+    return expected == total;
+}
+
+static RelayResult RunRelay(const char *serverPath, const std::vector<std::string> &args, int64_t total,
+                            int chunkSize, const std::string &blob)
+{
+    ServerProcess server;
+    CHECK(StartServer(server, serverPath, args));
+    TestClient receiver;
+    TestClient sender;
+    CHECK(receiver.Login(server.port, "recv", PROTOCOL_V1, 0, chunkSize));
+    CHECK(receiver.WaitLoggedIn(2000));
+    CHECK(sender.Login(server.port, "send", PROTOCOL_V1, 0, chunkSize));
+    CHECK(sender.WaitLoggedIn(2000));
+    // 读走登录后的用户列表与系统消息, 之后接收方直接从 socket 解析
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    MsgHeader header;
+    std::string body;
+    while (receiver.Receive(header, body, 0)) {
+    }
+    sender.Discard();
+
+    CHECK(sender.Send(MSG_FILE_INFO, "recv|1|big.bin|" + std::to_string(total)));
+    RelayResult result;
+    double cpuBefore = CpuSeconds(server.pid);
+    int64_t start = NowUs();
+    std::thread reader([&] { result.ok = ReceiveChunks(receiver.Fd(), total); });
+
+    std::string batch;
+    for (int64_t offset = 0; offset < total;) {
+        size_t len = (size_t)std::min<int64_t>(chunkSize, total - offset);
+        FileChunkHeader chunk = {1, 0, offset};
+        MsgHeader frame = {MSG_FILE_DATA, (int32_t)(sizeof(chunk) + len), 0};
+        batch.append((const char *)&frame, sizeof(frame));
+        batch.append((const char *)&chunk, sizeof(chunk));
+        batch.append(blob, (size_t)(offset % blob.size()) / chunkSize * chunkSize, len);
+        offset += len;
+        if (batch.size() >= SEND_BATCH || offset == total) {
+            CHECK(sender.SendRaw(batch.data(), batch.size()));
+            batch.clear();
+        }
+    }
+    reader.join();
+    result.seconds = (NowUs() - start) / 1e6;
+    result.serverCpu = CpuSeconds(server.pid) - cpuBefore;
+    StopServer(server);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    CHECK(argc >= 2);
+    int64_t megabytes = argc > 2 ? std::atol(argv[2]) : 256;
+    int chunkSize = argc > 3 ? std::atoi(argv[3]) : 65536;
+    CHECK(megabytes > 0 && chunkSize > 0 && chunkSize <= MAX_FILE_CHUNK_SIZE);
+    int64_t total = megabytes * 1024 * 1024;
+
+    // 不可压缩的数据, 转发路径上不会有人因为内容而走捷径
+    std::string blob(4 * 1024 * 1024, '\0');
+    std::mt19937 random(1);
+    for (char &c : blob) {
+        c = (char)random();
+    }
+
+    std::printf("一对一转发 %ld MB, 文件块 %d 字节\n", (long)megabytes, chunkSize);
+    const std::pair<const char *, std::vector<std::string>> modes[] = {{"复制", {}}, {"splice", {"--splice"}}};
+    bool ok = true;
+    for (const auto &mode : modes) {
+        RelayResult result = RunRelay(argv[1], mode.second, total, chunkSize, blob);
+        std::printf("%-8s %s %8.1f MB/s, 服务端 CPU %.2f s (每 GB %.2f s)\n", mode.first, result.ok ? "完整" : "出错",
+                    megabytes / result.seconds, result.serverCpu, result.serverCpu * 1024 / megabytes);
+        ok = ok && result.ok;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,209 @@
+/*
+ * Description: 在线用户表的锁基准: 改动前的互斥锁 + 数组线性扫描、经 shared_ptr 原子操作发布的快照, 与现在 RCU 发布的快照对比;
+ *              若干读者线程按用户名查找 (私聊、文件路由), 一个写者线程不断登录/退出,
+ *              统计读者的持锁时间、单次查找耗时 (含等锁) 与写者的单次修改耗时
+ *              用法: roster_lock_bench [在线人数, 默认 1000] [读者线程数, 默认 4] [秒数, 默认 3]
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "../Roster.h"
+#include "TestSupport.h"
+
+using Clock = std::chrono::steady_clock;
+
+// 改动前 main.cpp 中的做法: 全局数组由一把锁保护, 查找与修改都在锁内进行
+class LockedRoster {
+public:
+    bool Find(const std::string &name, ClientRef &ref, int64_t &holdNs)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Clock::time_point locked = Clock::now();
+        bool found = false;
+        for (const ClientContext &client : clients) {
+            if (client.name == name) {
+                ref = client.ref;
+                found = true;
+                break;
+            }
+        }
+        holdNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - locked).count();
+        return found;
+    }
+    void Add(const ClientContext &client)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        clients.push_back(client);
+    }
+    void Remove(const std::string &, uint64_t sessionId)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                     [sessionId](const ClientContext &c) { return c.ref.sessionId == sessionId; }),
+                      clients.end());
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<ClientContext> clients;
+};
+
+// 上一版的做法: 快照经 std::atomic_load/atomic_store(shared_ptr) 发布; libstdc++ 用全局自旋锁池实现它们,
+// 读者取快照时要拿锁并改引用计数, 锁在标准库内部, 持锁时间量不到, 只体现在查找耗时里
+class SharedPtrRoster {
+public:
+    bool Find(const std::string &name, ClientRef &ref, int64_t &holdNs)
+    {
+        holdNs = 0;
+        return std::atomic_load(&current)->Find(name, ref);
+    }
+    void Add(const ClientContext &client)
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        std::shared_ptr<RosterSnapshot> next = std::make_shared<RosterSnapshot>(*current);
+        next->byName = current->byName.With(client.name, client.ref);
+        std::atomic_store(&current, std::shared_ptr<const RosterSnapshot>(std::move(next)));
+    }
+    void Remove(const std::string &name, uint64_t)
+    {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        std::shared_ptr<RosterSnapshot> next = std::make_shared<RosterSnapshot>(*current);
+        next->byName = current->byName.Without(name);
+        std::atomic_store(&current, std::shared_ptr<const RosterSnapshot>(std::move(next)));
+    }
+
+private:
+    std::shared_ptr<const RosterSnapshot> current = std::make_shared<RosterSnapshot>();
+    std::mutex writeMutex;
+};
+
+// 现在的做法: 读者在 RCU 读者区间内查找, 只做两次原子加减, 不持有任何锁
+class SnapshotRoster {
+public:
+    bool Find(const std::string &name, ClientRef &ref, int64_t &holdNs)
+    {
+        holdNs = 0;
+        return roster.Find(name, ref);
+    }
+    void Add(const ClientContext &client)
+    {
+        roster.Add(client);
+    }
+    void Remove(const std::string &name, uint64_t sessionId)
+    {
+        roster.Remove(name, sessionId);
+    }
+
+private:
+    Roster roster;
+};
+
+struct Samples {
+    std::vector<int64_t> lookupNs; // 单次查找耗时, 含等锁
+    int64_t holdNs = 0;            // 持锁时间之和
+    int64_t holdMaxNs = 0;
+    int64_t found = 0; // 查到的次数; 用到查找结果, 优化构建中查找不会被当作无用代码删掉
+};
+
+static int64_t Percentile(std::vector<int64_t> &values, double p)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    size_t at = std::min(values.size() - 1, (size_t)(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + at, values.end());
+    return values[at];
+}
+
+static ClientContext MakeClient(long index)
+{
+    return {{0, (int)index, (uint64_t)index + 1}, "user" + std::to_string(index)};
+}
+
+template <typename Table>
+static void Run(const char *label, long users, int readers, int seconds)
+{
+    Table table;
+    for (long i = 0; i < users; ++i) {
+        table.Add(MakeClient(i));
+    }
+
+    std::atomic<bool> stop(false);
+    std::vector<Samples> samples(readers);
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([&, r] {
+            std::mt19937 random(r);
+            std::vector<std::string> names;
+            for (long i = 0; i < users; ++i) {
+                names.push_back(MakeClient(i).name);
+            }
+            Samples &out = samples[r];
+            out.lookupNs.reserve(1 << 22);
+            ClientRef ref;
+            while (!stop.load(std::memory_order_relaxed)) {
+                const std::string &name = names[random() % users];
+                Clock::time_point begin = Clock::now();
+                int64_t holdNs;
+                out.found += table.Find(name, ref, holdNs) && ref.sessionId != 0;
+                out.lookupNs.push_back(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+                out.holdNs += holdNs;
+                out.holdMaxNs = std::max(out.holdMaxNs, holdNs);
+            }
+        });
+    }
+
+    // 写者: 前一半用户轮流退出再登录, 间隔 1 ms, 比查找少得多
+    std::vector<int64_t> writeNs;
+    Clock::time_point end = Clock::now() + std::chrono::seconds(seconds);
+    for (long i = 0; Clock::now() < end; i = (i + 1) % (users / 2 + 1)) {
+        ClientContext client = MakeClient(i);
+        Clock::time_point begin = Clock::now();
+        table.Remove(client.name, client.ref.sessionId);
+        table.Add(client);
+        writeNs.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count() / 2);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    stop = true;
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    std::vector<int64_t> lookups;
+    int64_t holdNs = 0;
+    int64_t holdMaxNs = 0;
+    int64_t found = 0;
+    for (Samples &s : samples) {
+        found += s.found;
+        lookups.insert(lookups.end(), s.lookupNs.begin(), s.lookupNs.end());
+        holdNs += s.holdNs;
+        holdMaxNs = std::max(holdMaxNs, s.holdMaxNs);
+    }
+    size_t count = lookups.size();
+    std::printf("%-8s 查找 %8.0f 次/秒, 耗时 p50 %6.2f us p99 %8.2f us 最大 %9.2f us; "
+                "读者持锁 平均 %6.2f us 最大 %8.2f us; 写者单次修改 p50 %6.2f us; 命中 %.1f%%\n",
+                label, count / (double)seconds, Percentile(lookups, 0.5) / 1e3, Percentile(lookups, 0.99) / 1e3,
+                *std::max_element(lookups.begin(), lookups.end()) / 1e3, count ? holdNs / 1e3 / count : 0.0,
+                holdMaxNs / 1e3, Percentile(writeNs, 0.5) / 1e3, count ? found * 100.0 / count : 0.0);
+}
+
+int main(int argc, char *argv[])
+{
+    long users = argc > 1 ? std::atol(argv[1]) : 1000;
+    int readers = argc > 2 ? std::atoi(argv[2]) : 4;
+    int seconds = argc > 3 ? std::atoi(argv[3]) : 3;
+    CHECK(users > 1 && readers > 0 && seconds > 0);
+
+    std::printf("%ld 个在线用户, %d 个读者线程, %d 秒\n", users, readers, seconds);
+    Run<LockedRoster>("锁+扫描", users, readers, seconds);
+    Run<SharedPtrRoster>("原子指针", users, readers, seconds);
+    Run<SnapshotRoster>("RCU", users, readers, seconds);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,374 @@
+/*
+ * Description: 测试与基准共用的服务端进程与客户端实现
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#include "TestSupport.h"
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+const size_t READ_CHUNK = 256 * 1024;
+
+int64_t NowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double CpuSeconds(pid_t pid)
+{
+    std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+    std::string stat((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::istringstream fields(stat.substr(stat.rfind(')') + 2));
+    std::string skip;
+    for (int i = 3; i < 14; ++i) {
+        fields >> skip;
+    }
+    long user = 0;
+    long system = 0;
+    fields >> user >> system;
+    return (double)(user + system) / sysconf(_SC_CLK_TCK);
+}
+
+// 让内核挑一个空闲端口; 关闭后到服务端绑定之间被别人占用的可能可以忽略
+static int FreePort()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    int port = 0;
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) == 0 && getsockname(fd, (sockaddr *)&addr, &len) == 0) {
+        port = ntohs(addr.sin_port);
+    }
+    close(fd);
+    return port;
+}
+
+static int ConnectLoopback(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+bool StartServer(ServerProcess &server, const std::string &path, const std::vector<std::string> &args,
+                 const std::string &preload)
+{
+    char dir[] = "/tmp/chat_test_XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        return false;
+    }
+    server.storeDir = dir;
+    server.port = FreePort();
+    int console[2];
+    int errPipe[2];
+    if (pipe2(console, O_CLOEXEC) == -1 || pipe2(errPipe, O_CLOEXEC) == -1) {
+        return false;
+    }
+    std::vector<std::string> argv = {path, std::to_string(server.port)};
+    argv.insert(argv.end(), args.begin(), args.end());
+    argv.push_back("--store=" + server.storeDir + "/store");
+
+    server.pid = fork();
+    if (server.pid == 0) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL); // 测试中途退出时服务端随之结束
+        dup2(console[0], STDIN_FILENO);
+        dup2(errPipe[1], STDERR_FILENO);
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        if (!preload.empty()) {
+            setenv("LD_PRELOAD", preload.c_str(), 1);
+        }
+        std::vector<char *> raw;
+        for (std::string &arg : argv) {
+            raw.push_back(&arg[0]);
+        }
+        raw.push_back(nullptr);
+        execv(path.c_str(), raw.data());
+        _exit(127);
+    }
+    close(console[0]);
+    close(errPipe[1]);
+    server.consoleFd = console[1];
+    server.stderrFd = errPipe[0];
+    if (server.pid == -1) {
+        return false;
+    }
+    for (int i = 0; i < 250; ++i) {
+        int fd = ConnectLoopback(server.port);
+        if (fd != -1) {
+            close(fd);
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    return false;
+}
+
+void StopServer(ServerProcess &server)
+{
+    if (server.pid > 0) {
+        kill(server.pid, SIGKILL);
+        waitpid(server.pid, nullptr, 0);
+        server.pid = -1;
+    }
+    if (server.consoleFd != -1) {
+        close(server.consoleFd);
+        server.consoleFd = -1;
+    }
+    if (server.stderrFd != -1) {
+        close(server.stderrFd);
+        server.stderrFd = -1;
+    }
+    if (!server.storeDir.empty()) {
+        std::error_code ignored;
+        std::filesystem::remove_all(server.storeDir, ignored);
+        server.storeDir.clear();
+    }
+}
+
+bool ReadServerLine(ServerProcess &server, const std::string &prefix, std::string &rest, int timeoutMs)
+{
+    int64_t deadline = NowUs() + (int64_t)timeoutMs * 1000;
+    std::string line;
+    while (NowUs() < deadline) {
+        pollfd pfd = {server.stderrFd, POLLIN, 0};
+        if (poll(&pfd, 1, (int)((deadline - NowUs()) / 1000) + 1) <= 0) {
+            continue;
+        }
+        char c;
+        if (read(server.stderrFd, &c, 1) != 1) {
+            return false;
+        }
+        if (c != '\n') {
+            line += c;
+            continue;
+        }
+        if (line.compare(0, prefix.size(), prefix) == 0) {
+            rest = line.substr(prefix.size());
+            return true;
+        }
+        line.clear();
+    }
+    return false;
+}
+
+TestClient::~TestClient()
+{
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+bool TestClient::Login(int port, const std::string &name, int protocol, int features, int maxChunk)
+{
+    fd = ConnectLoopback(port);
+    if (fd == -1) {
+        return false;
+    }
+    std::string body = name;
+    if (protocol == PROTOCOL_V2 || maxChunk > 0) {
+        body += "|" + std::to_string(maxChunk > 0 ? maxChunk : FILE_CHUNK_SIZE);
+    }
+    if (protocol == PROTOCOL_V2) {
+        body += "|2|" + std::to_string(features);
+    }
+    if (!Send(MSG_LOGIN, body)) {
+        return false;
+    }
+    // 服务端处理完登录才会读下一条, 不必等应答
+    wantV2 = protocol == PROTOCOL_V2;
+    if (wantV2 && !Send(MSG_PROTOCOL, "2")) {
+        return false;
+    }
+    sendProtocol = protocol;
+    return true;
+}
+
+bool TestClient::WaitLoggedIn(int timeoutMs)
+{
+    int64_t deadline = NowUs() + (int64_t)timeoutMs * 1000;
+    MsgHeader header;
+    std::string body;
+    while (NowUs() < deadline) {
+        if (!Receive(header, body, (int)((deadline - NowUs()) / 1000) + 1)) {
+            return false;
+        }
+        if (header.type == MSG_LOGIN) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TestClient::SendRaw(const void *data, size_t len)
+{
+    const char *bytes = static_cast<const char *>(data);
+    while (len > 0) {
+        ssize_t n = send(fd, bytes, len, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool TestClient::Send(int type, std::string_view body)
+{
+    MsgHeader header = {type, (int32_t)body.size(), 0};
+    char head[V2_HEADER_MAX];
+    size_t headLen = sizeof(header);
+    if (sendProtocol == PROTOCOL_V2) {
+        headLen = EncodeHeaderV2(header, head);
+    } else {
+        memcpy(head, &header, sizeof(header));
+    }
+    return SendRaw(head, headLen) && SendRaw(body.data(), body.size());
+}
+
+size_t TestClient::Discard()
+{
+    static thread_local char sink[READ_CHUNK];
+    size_t total = 0;
+    ssize_t n;
+    while ((n = recv(fd, sink, sizeof(sink), MSG_DONTWAIT)) > 0) {
+        total += n;
+    }
+    return total;
+}
+
+bool TestClient::Fill(int timeoutMs)
+{
+    if (pos > 0 && pos * 2 >= buffer.size()) {
+        buffer.erase(0, pos);
+        pos = 0;
+    }
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeoutMs) <= 0) {
+        return false;
+    }
+    // 先读进线程共享的缓冲区再追加: 成千上万个连接时, 每个连接只占着自己未解析的字节
+    static thread_local char chunk[READ_CHUNK];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+        return false;
+    }
+    buffer.append(chunk, n);
+    return true;
+}
+
+// 从缓冲区取一帧; 不完整时返回 false
+bool TestClient::Parse(MsgHeader &header, std::string &body)
+{
+    const char *data = buffer.data() + pos;
+    size_t len = buffer.size() - pos;
+    size_t headLen = sizeof(header);
+    if (recvProtocol == PROTOCOL_V2) {
+        int n = DecodeHeaderV2(data, len, header);
+        CHECK(n >= 0);
+        if (n == 0) {
+            return false;
+        }
+        headLen = (size_t)n;
+    } else if (len >= sizeof(header)) {
+        memcpy(&header, data, sizeof(header));
+    } else {
+        return false;
+    }
+    if (len - headLen < (size_t)header.bodyLen) {
+        return false;
+    }
+    body.assign(data + headLen, header.bodyLen);
+    pos += headLen + header.bodyLen;
+    if (header.type & COMPRESSED_FLAG) {
+        const char *raw;
+        size_t rawLen;
+        CHECK(inflater.Decompress(body.data(), body.size(), MAX_FILE_CHUNK_SIZE, raw, rawLen));
+        body.assign(raw, rawLen);
+        header.type &= ~COMPRESSED_FLAG;
+        header.bodyLen = (int32_t)rawLen;
+    }
+    // 同意 v2 的登录应答为 MaxChunk|2|UserId[|Features], 之后的消息都是 v2 格式
+    if (header.type == MSG_LOGIN && wantV2 && recvProtocol == PROTOCOL_V1) {
+        size_t mark = body.find("|2|");
+        if (mark != std::string::npos) {
+            recvProtocol = PROTOCOL_V2;
+            userId = std::strtoull(body.c_str() + mark + 3, nullptr, 10);
+        }
+    }
+    return true;
+}
+
+void TestClient::Unbundle(const std::string &body)
+{
+    size_t at = 0;
+    while (at < body.size()) {
+        MsgHeader sub;
+        int n = DecodeHeaderV2(body.data() + at, body.size() - at, sub);
+        CHECK(n > 0 && body.size() - at - n >= (size_t)sub.bodyLen);
+        if (!(sub.type == MSG_CHAT_TEXT && (uint64_t)sub.senderId == userId)) {
+            unbundled.emplace_back(sub, body.substr(at + n, sub.bodyLen));
+        }
+        at += n + sub.bodyLen;
+    }
+}
+
+bool TestClient::Receive(MsgHeader &header, std::string &body, int timeoutMs)
+{
+    int64_t deadline = NowUs() + (int64_t)timeoutMs * 1000;
+    bool filled = false;
+    while (true) {
+        if (!unbundled.empty()) {
+            header = unbundled.front().first;
+            body = std::move(unbundled.front().second);
+            unbundled.pop_front();
+            return true;
+        }
+        if (Parse(header, body)) {
+            if (header.type != MSG_BUNDLE) {
+                return true;
+            }
+            Unbundle(body);
+            continue;
+        }
+        int64_t left = deadline - NowUs();
+        if ((left <= 0 && filled) || !Fill(left > 0 ? (int)(left / 1000) + 1 : 0)) {
+            return false;
+        }
+        filled = true;
+    }
+}
@@ -0,0 +1,98 @@
+/*
+ * Description: 测试与基准共用: 在子进程中启动 chat_server, 以及按协议收发消息的阻塞式客户端
+ * Author: 夏凡
+ * Create: 2025-12-17
+ */
+
+#ifndef TEST_SUPPORT_H
+#define TEST_SUPPORT_H
+
+#include <sys/types.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../../common/Lz.h"
+#include "../../common/Protocol.h"
+
+#define CHECK(cond)                                                                    \
+    do {                                                                               \
+        if (!(cond)) {                                                                 \
+            std::fprintf(stderr, "%s:%d: 检查失败: %s\n", __FILE__, __LINE__, #cond); \
+            std::exit(EXIT_FAILURE);                                                   \
+        }                                                                              \
+    } while (0)
+
+// 单调时钟, 微秒
+int64_t NowUs();
+// 进程累计的用户态 + 内核态 CPU 时间 (秒)
+double CpuSeconds(pid_t pid);
+
+// 子进程中运行的服务端: 仓库放在临时目录, 标准输入接一个不写入的管道 (管理员控制台一直阻塞在读取上),
+// 标准输出丢弃, 标准错误可由 stderrFd 读取
+struct ServerProcess {
+    pid_t pid = -1;
+    int port = 0;
+    int consoleFd = -1;
+    int stderrFd = -1;
+    std::string storeDir;
+};
+
+// args 跟在端口之后; preload 不为空时经 LD_PRELOAD 注入; 端口可以连接后返回
+bool StartServer(ServerProcess &server, const std::string &path, const std::vector<std::string> &args,
+                 const std::string &preload = std::string());
+void StopServer(ServerProcess &server);
+
+// 读子进程标准错误中以 prefix 开头的下一行 (不含 prefix)
+bool ReadServerLine(ServerProcess &server, const std::string &prefix, std::string &rest, int timeoutMs);
+
+// 一个客户端连接: 登录应答同意 v2 后按 v2 收, 压缩的消息解开, MSG_BUNDLE 拆成单条 (跳过自己的群聊回显)
+class TestClient {
+public:
+    TestClient() = default;
+    TestClient(const TestClient &) = delete;
+    TestClient &operator=(const TestClient &) = delete;
+    ~TestClient();
+
+    // 发出登录; protocol 为 PROTOCOL_V2 时紧接着发 MSG_PROTOCOL, 之后按 v2 发送
+    // maxChunk 为 0 时不协商文件块大小 (v2 登录总要带上, 此时按 FILE_CHUNK_SIZE)
+    bool Login(int port, const std::string &name, int protocol = PROTOCOL_V1, int features = 0, int maxChunk = 0);
+    // 等到登录应答 (之前收到的其他消息丢弃)
+    bool WaitLoggedIn(int timeoutMs);
+
+    bool Send(int type, std::string_view body);
+    bool SendRaw(const void *data, size_t len);
+    // 下一条消息; 超时或连接断开时返回 false, timeoutMs 为 0 时只看已经到达的数据
+    bool Receive(MsgHeader &header, std::string &body, int timeoutMs);
+    // 不解码, 只读走 socket 中已有的字节, 返回读到的字节数
+    size_t Discard();
+
+    int Fd() const
+    {
+        return fd;
+    }
+    uint64_t UserId() const
+    {
+        return userId;
+    }
+
+private:
+    bool Fill(int timeoutMs);
+    bool Parse(MsgHeader &header, std::string &body);
+    void Unbundle(const std::string &body);
+
+    int fd = -1;
+    int sendProtocol = PROTOCOL_V1;
+    int recvProtocol = PROTOCOL_V1;
+    bool wantV2 = false;
+    uint64_t userId = 0;
+    std::string buffer;
+    size_t pos = 0;
+    std::deque<std::pair<MsgHeader, std::string>> unbundled;
+    LzDecoder inflater;
+};
+
+#endif
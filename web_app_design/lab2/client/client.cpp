@@ -17,8 +17,10 @@ bool g_running = true;
 void* recv_thread(void* arg) {
     (void)arg;
     ChatMessage msg{};
+    FrameReader reader;
+    frame_reader_init(reader, g_sock);
     while (g_running) {
-        if (!recv_all(g_sock, &msg, sizeof(msg))) {
+        if (!recv_message(reader, msg)) {
             std::cout << "[INFO] Disconnected from server." << std::endl;
             g_running = false;
             break;
@@ -89,7 +91,7 @@ int main(int argc, char* argv[]) {
     login.type = MSG_LOGIN;
     std::strncpy(login.from, username.c_str(), NAME_LEN - 1);
     std::snprintf(login.text, MSG_LEN, "%s joined", username.c_str());
-    if (!send_all(g_sock, &login, sizeof(login))) {
+    if (!send_message(g_sock, login)) {
         std::cerr << "Failed to send login message\n";
         close(g_sock);
         return 1;
@@ -113,7 +115,7 @@ int main(int argc, char* argv[]) {
             ChatMessage logout{};
             logout.type = MSG_LOGOUT;
             std::strncpy(logout.from, username.c_str(), NAME_LEN - 1);
-            send_all(g_sock, &logout, sizeof(logout));
+            send_message(g_sock, logout);
             g_running = false;
             break;
         }
@@ -140,7 +142,7 @@ int main(int argc, char* argv[]) {
             std::strncpy(msg.text, line.c_str(), MSG_LEN - 1);
         }
 
-        if (!send_all(g_sock, &msg, sizeof(msg))) {
+        if (!send_message(g_sock, msg)) {
             std::cout << "[ERROR] Failed to send. Maybe server is down.\n";
             g_running = false;
             break;
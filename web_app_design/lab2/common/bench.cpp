@@ -0,0 +1,186 @@
+// 消息编码对比：一个客户端连续发群聊，经一个转发线程发给多个接收方，统计每条消息的线上字节数与送达速度。
+// 转发线程照搬服务端 client_thread 的群聊转发，三种做法各跑一遍：
+//   fixed     旧的定长结构体（整个 ChatMessage 原样发送），每条消息逐个连接 send
+//   variable  变长帧，每条消息编码一次、逐个连接 send
+//   batched   变长帧，读缓冲区里接连到达的消息攒成一批再逐个连接 send（现在服务端的做法）
+// 与服务端一样不设 TCP_NODELAY。回环上 Nagle 会把定长的大消息攒成少数几个分段、接收方少醒几次，
+// 而变长小帧几乎每条都单独送达，所以逐条转发时变长反而更慢；按批转发后两端的系统调用与唤醒都按批计算。
+// 用法: codec_bench [接收方数, 默认 50] [每种消息条数, 默认 10000]
+
+#include "common.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum Mode { MODE_FIXED, MODE_VARIABLE, MODE_BATCHED };
+
+struct Result {
+    double seconds;
+    long   wire_bytes;   // 转发线程发出的总字节数
+    long   received;     // 接收方解出的消息总数
+};
+
+// 建立 n 对回环 TCP 连接，servers[i]（服务端 accept 得到的一端）与 clients[i] 相连
+static bool make_pairs(int n, std::vector<int>& servers, std::vector<int>& clients) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listener, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, n) < 0 ||
+        getsockname(listener, (sockaddr*)&addr, &len) < 0) {
+        close(listener);
+        return false;
+    }
+    for (int i = 0; i < n; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            close(listener);
+            return false;
+        }
+        clients.push_back(fd);
+        servers.push_back(accept(listener, nullptr, nullptr));
+    }
+    close(listener);
+    return true;
+}
+
+static void send_to_all(const std::vector<int>& fds, const void* data, std::size_t len, long& wire_bytes) {
+    for (std::size_t i = 0; i < fds.size(); ++i) {
+        send_all(fds[i], data, len);
+    }
+    wire_bytes += (long)(len * fds.size());
+}
+
+// 转发线程：从发送方连接读 count 条群聊，按 mode 转发给 downstream
+static void relay(Mode mode, int upstream, const std::vector<int>& downstream, int count, long& wire_bytes) {
+    ChatMessage msg;
+    if (mode == MODE_FIXED) {
+        for (int j = 0; j < count && recv_all(upstream, &msg, sizeof(msg)); ++j) {
+            send_to_all(downstream, &msg, sizeof(msg), wire_bytes);
+        }
+        return;
+    }
+
+    FrameReader* reader = new FrameReader;
+    frame_reader_init(*reader, upstream);
+    FrameBatch* batch = new FrameBatch;
+    frame_batch_init(*batch);
+    char frame[MAX_FRAME_LEN];
+    for (int j = 0; j < count && recv_message(*reader, msg); ++j) {
+        if (mode == MODE_VARIABLE) {
+            send_to_all(downstream, frame, encode_message(msg, frame), wire_bytes);
+            continue;
+        }
+        if (!frame_batch_add(*batch, msg)) {
+            send_to_all(downstream, batch->buf, batch->len, wire_bytes);
+            batch->len = 0;
+            frame_batch_add(*batch, msg);
+        }
+        if (!frame_reader_ready(*reader) || j == count - 1) {
+            send_to_all(downstream, batch->buf, batch->len, wire_bytes);
+            batch->len = 0;
+        }
+    }
+    delete batch;
+    delete reader;
+}
+
+static Result run(Mode mode, int n, int count, const std::string& text) {
+    std::vector<int> up_server;
+    std::vector<int> up_client;
+    std::vector<int> servers;
+    std::vector<int> receivers;
+    if (!make_pairs(1, up_server, up_client) || !make_pairs(n, servers, receivers)) {
+        std::perror("make_pairs");
+        std::exit(1);
+    }
+
+    std::vector<long> got(n, 0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < n; ++i) {
+        threads.push_back(std::thread([&, i]() {
+            ChatMessage msg;
+            FrameReader* reader = new FrameReader;
+            frame_reader_init(*reader, receivers[i]);
+            while (got[i] < count) {
+                bool ok = mode == MODE_FIXED ? recv_all(receivers[i], &msg, sizeof(msg))
+                                             : recv_message(*reader, msg);
+                if (!ok) {
+                    break;
+                }
+                ++got[i];
+            }
+            delete reader;
+        }));
+    }
+    long wire_bytes = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::thread relay_thread([&]() { relay(mode, up_server[0], servers, count, wire_bytes); });
+
+    // 发送方与客户端一样，每条消息单独发出
+    ChatMessage msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_BROADCAST;
+    std::strncpy(msg.from, "sender", NAME_LEN - 1);
+    for (int j = 0; j < count; ++j) {
+        std::snprintf(msg.text, MSG_LEN, "%s %d", text.c_str(), j);
+        if (mode == MODE_FIXED) {
+            send_all(up_client[0], &msg, sizeof(msg));
+        } else {
+            send_message(up_client[0], msg);
+        }
+    }
+    relay_thread.join();
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Result result = {seconds, wire_bytes, 0};
+    for (int i = 0; i < n; ++i) {
+        result.received += got[i];
+        close(servers[i]);
+        close(receivers[i]);
+    }
+    close(up_server[0]);
+    close(up_client[0]);
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    int n     = argc > 1 ? std::atoi(argv[1]) : 50;
+    int count = argc > 2 ? std::atoi(argv[2]) : 10000;
+    if (n <= 0 || count <= 0) {
+        std::fprintf(stderr, "usage: %s [receivers] [messages]\n", argv[0]);
+        return 1;
+    }
+
+    // 一句普通聊天，和接近上限的长消息
+    const std::string texts[] = {"hello", std::string(400, 'x')};
+    const char* text_names[] = {"short", "long"};
+    const char* names[] = {"fixed", "variable", "batched"};
+    bool ok = true;
+    std::printf("%d receivers x %d messages\n", n, count);
+    for (size_t t = 0; t < sizeof(texts) / sizeof(texts[0]); ++t) {
+        for (int mode = MODE_FIXED; mode <= MODE_BATCHED; ++mode) {
+            Result r = run((Mode)mode, n, count, texts[t]);
+            long delivered = (long)n * count;
+            std::printf("%-5s  %-8s  %6.1f B/msg  %8.1f MB  %9.0f msg/s  %.3f s\n", text_names[t], names[mode],
+                        (double)r.wire_bytes / delivered, r.wire_bytes / 1e6, r.received / r.seconds, r.seconds);
+            ok = ok && r.received == delivered;
+        }
+    }
+    return ok ? 0 : 1;
+}
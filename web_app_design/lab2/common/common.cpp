@@ -2,6 +2,9 @@
 
 #include <unistd.h>   // read, write
 #include <sys/socket.h>
+#include <arpa/inet.h>  // htonl, ntohl
+
+#include <cstring>
 
 bool send_all(int fd, const void* buffer, std::size_t len) {
     const char* buf = static_cast<const char*>(buffer);
@@ -27,4 +30,139 @@ bool recv_all(int fd, void* buffer, std::size_t len) {
         recvd += static_cast<std::size_t>(n);
     }
     return true;
-}
\ No newline at end of file
+}
+
+// ====================== 变长消息编码 ======================
+
+static void put_u16(char* p, uint16_t v) {
+    v = htons(v);
+    std::memcpy(p, &v, sizeof(v));
+}
+
+static void put_u32(char* p, uint32_t v) {
+    v = htonl(v);
+    std::memcpy(p, &v, sizeof(v));
+}
+
+static uint16_t get_u16(const char* p) {
+    uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return ntohs(v);
+}
+
+static uint32_t get_u32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return ntohl(v);
+}
+
+std::size_t encode_message(const ChatMessage& msg, char* out) {
+    // 字符串字段可能被 strncpy 写满，长度按上限截断
+    std::size_t from_len = strnlen(msg.from, NAME_LEN - 1);
+    std::size_t to_len   = strnlen(msg.to, NAME_LEN - 1);
+    std::size_t text_len = strnlen(msg.text, MSG_LEN - 1);
+    std::size_t body_len = BODY_FIXED_LEN + from_len + to_len + text_len;
+
+    char* p = out;
+    put_u32(p, (uint32_t)body_len);
+    p += FRAME_PREFIX_LEN;
+    *p++ = (char)msg.type;
+    put_u32(p, (uint32_t)msg.online_count);
+    p += 4;
+    *p++ = (char)from_len;
+    *p++ = (char)to_len;
+    put_u16(p, (uint16_t)text_len);
+    p += 2;
+    std::memcpy(p, msg.from, from_len);
+    p += from_len;
+    std::memcpy(p, msg.to, to_len);
+    p += to_len;
+    std::memcpy(p, msg.text, text_len);
+    p += text_len;
+    return (std::size_t)(p - out);
+}
+
+bool decode_message(const char* body, std::size_t len, ChatMessage& msg) {
+    if (len < BODY_FIXED_LEN) {
+        return false;
+    }
+    std::size_t from_len = (unsigned char)body[5];
+    std::size_t to_len   = (unsigned char)body[6];
+    std::size_t text_len = get_u16(body + 7);
+    if (from_len >= (std::size_t)NAME_LEN || to_len >= (std::size_t)NAME_LEN ||
+        text_len >= (std::size_t)MSG_LEN ||
+        len != BODY_FIXED_LEN + from_len + to_len + text_len) {
+        return false;
+    }
+    msg.type         = (unsigned char)body[0];
+    msg.online_count = (int)get_u32(body + 1);
+    const char* p = body + BODY_FIXED_LEN;
+    std::memcpy(msg.from, p, from_len);
+    msg.from[from_len] = '\0';
+    p += from_len;
+    std::memcpy(msg.to, p, to_len);
+    msg.to[to_len] = '\0';
+    p += to_len;
+    std::memcpy(msg.text, p, text_len);
+    msg.text[text_len] = '\0';
+    return true;
+}
+
+bool send_message(int fd, const ChatMessage& msg) {
+    char frame[MAX_FRAME_LEN];
+    return send_all(fd, frame, encode_message(msg, frame));
+}
+
+void frame_reader_init(FrameReader& reader, int fd) {
+    reader.fd    = fd;
+    reader.start = 0;
+    reader.end   = 0;
+}
+
+bool recv_message(FrameReader& reader, ChatMessage& msg) {
+    while (true) {
+        std::size_t avail = reader.end - reader.start;
+        if (avail >= FRAME_PREFIX_LEN) {
+            std::size_t body_len = get_u32(reader.buf + reader.start);
+            if (body_len > MAX_BODY_LEN) {
+                return false;
+            }
+            if (avail >= FRAME_PREFIX_LEN + body_len) {
+                const char* body = reader.buf + reader.start + FRAME_PREFIX_LEN;
+                reader.start += FRAME_PREFIX_LEN + body_len;
+                return decode_message(body, body_len, msg);
+            }
+        }
+        // 不足一帧：剩余部分移到缓冲区开头，再读
+        if (reader.start > 0) {
+            std::memmove(reader.buf, reader.buf + reader.start, avail);
+            reader.start = 0;
+            reader.end   = avail;
+        }
+        ssize_t n = ::recv(reader.fd, reader.buf + reader.end, READ_BUF_LEN - reader.end, 0);
+        if (n <= 0) {
+            return false;   // 断开或出错
+        }
+        reader.end += static_cast<std::size_t>(n);
+    }
+}
+
+bool frame_reader_ready(const FrameReader& reader) {
+    std::size_t avail = reader.end - reader.start;
+    return avail >= FRAME_PREFIX_LEN &&
+           avail >= FRAME_PREFIX_LEN + get_u32(reader.buf + reader.start);
+}
+
+// ====================== 批量转发 ======================
+
+void frame_batch_init(FrameBatch& batch) {
+    batch.len = 0;
+}
+
+bool frame_batch_add(FrameBatch& batch, const ChatMessage& msg) {
+    if (BATCH_BUF_LEN - batch.len < MAX_FRAME_LEN) {
+        return false;
+    }
+    batch.len += encode_message(msg, batch.buf + batch.len);
+    return true;
+}
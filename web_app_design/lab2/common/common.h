@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 
 const int NAME_LEN = 32;     // 用户名最大长度
 const int MSG_LEN  = 512;    // 消息最大长度
@@ -14,7 +15,7 @@ enum MsgType {
     MSG_SYSTEM   = 5    // 系统公告
 };
 
-// 固定长度的消息结构，用于 send/recv
+// 内存中的消息结构（字符串以 '\0' 结尾），线上按下面的变长格式收发
 struct ChatMessage {
     int  type;                         // MsgType
     char from[NAME_LEN];               // 发送方用户名
@@ -27,4 +28,55 @@ struct ChatMessage {
 bool send_all(int fd, const void* buffer, std::size_t len);
 
 // 接收 len 字节，直到收完或出错
-bool recv_all(int fd, void* buffer, std::size_t len);
\ No newline at end of file
+bool recv_all(int fd, void* buffer, std::size_t len);
+
+// ====================== 变长消息编码 ======================
+// 每条消息一帧: 4 字节包体长度（网络字节序）+ 包体
+// 包体: type(1) online_count(4, 网络字节序) from 长度(1) to 长度(1) text 长度(2, 网络字节序)
+//       之后依次是 from、to、text 实际用到的字节（不带 '\0'，也不补齐到定长）
+const std::size_t FRAME_PREFIX_LEN = 4;
+const std::size_t BODY_FIXED_LEN   = 9;
+const std::size_t MAX_BODY_LEN     = BODY_FIXED_LEN + 2 * (NAME_LEN - 1) + (MSG_LEN - 1);
+const std::size_t MAX_FRAME_LEN    = FRAME_PREFIX_LEN + MAX_BODY_LEN;
+const std::size_t READ_BUF_LEN     = 8192;   // 带缓冲读取时一次 recv 的上限
+
+// 把 msg 编码为一帧写入 out（至少 MAX_FRAME_LEN 字节），返回帧长度
+std::size_t encode_message(const ChatMessage& msg, char* out);
+
+// 解码一个包体，长度字段与包体不符或超出上限时返回 false
+bool decode_message(const char* body, std::size_t len, ChatMessage& msg);
+
+// 编码并发送一条消息
+bool send_message(int fd, const ChatMessage& msg);
+
+// 带缓冲的分帧读取：一次 recv 尽量多读，之后从缓冲区逐帧取出，
+// 短消息连续到达时多条只需一次系统调用
+struct FrameReader {
+    int         fd;
+    char        buf[READ_BUF_LEN];
+    std::size_t start;   // 尚未取出的数据起点
+    std::size_t end;     // 已读入数据的终点
+};
+
+void frame_reader_init(FrameReader& reader, int fd);
+
+// 读出下一条消息；断开、出错或格式错误时返回 false
+bool recv_message(FrameReader& reader, ChatMessage& msg);
+
+// 缓冲区中是否已有一整帧（下一次 recv_message 不需要再 recv）
+bool frame_reader_ready(const FrameReader& reader);
+
+// ====================== 批量转发 ======================
+// 同一连接上接连到达的多条消息编码进同一个缓冲区，之后一次 send 发给每个接收方，
+// 接收方一次 recv 就能取出多条；群聊刷屏时两端的系统调用与线程唤醒都按批而不是按条计算
+const std::size_t BATCH_BUF_LEN = READ_BUF_LEN + MAX_FRAME_LEN;
+
+struct FrameBatch {
+    char        buf[BATCH_BUF_LEN];
+    std::size_t len;
+};
+
+void frame_batch_init(FrameBatch& batch);
+
+// 编码 msg 追加到批次末尾；剩余空间放不下一帧时返回 false，调用方先发出批次再追加
+bool frame_batch_add(FrameBatch& batch, const ChatMessage& msg);
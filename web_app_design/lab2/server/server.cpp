@@ -7,6 +7,7 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include <mutex>
 #include <cstring>  // memset, strncpy
 #include <cstdint>  // intptr_t
@@ -19,30 +20,80 @@ struct ClientInfo {
     std::string name;
 };
 
-std::vector<ClientInfo> g_clients;
-std::mutex               g_clients_mutex;
+// 在线列表: g_clients 紧凑存放 (删除时与末尾交换), 另建两个索引
+//   g_name_index: 用户名 -> g_clients 下标 (哈希)
+//   g_fd_index  : fd -> g_clients 下标 (以 fd 为下标的数组, -1 表示空)
+std::vector<ClientInfo>                 g_clients;
+std::unordered_map<std::string, size_t> g_name_index;
+std::vector<int>                        g_fd_index;
+std::mutex                              g_clients_mutex;
 
 // ====================== 工具函数：发送 / 广播 ======================
 
 bool send_to_client(int fd, const ChatMessage& msg) {
-    return send_all(fd, &msg, sizeof(msg));
+    return send_message(fd, msg);
 }
 
-void broadcast_message(const ChatMessage& msg) {
+// 已编码好的若干帧原样发给所有在线用户
+void broadcast_frames(const char* frames, std::size_t len) {
     std::lock_guard<std::mutex> lock(g_clients_mutex);
     for (auto& c : g_clients) {
-        send_to_client(c.fd, msg);
+        send_all(c.fd, frames, len);
+    }
+}
+
+// 只编码一次，同一帧发给所有在线用户
+void broadcast_message(const ChatMessage& msg) {
+    char frame[MAX_FRAME_LEN];
+    std::size_t len = encode_message(msg, frame);
+    broadcast_frames(frame, len);
+}
+
+// 发出攒下的群聊消息并清空批次
+void flush_batch(FrameBatch& batch) {
+    if (batch.len > 0) {
+        broadcast_frames(batch.buf, batch.len);
+        batch.len = 0;
     }
 }
 
+// 加入在线列表；用户名已被占用时返回 false。调用方需持有 g_clients_mutex
+bool add_client_locked(int fd, const std::string& name) {
+    if (g_name_index.count(name) != 0) {
+        return false;
+    }
+    if (fd >= (int)g_fd_index.size()) {
+        g_fd_index.resize(fd + 1, -1);
+    }
+    g_fd_index[fd] = (int)g_clients.size();
+    g_name_index[name] = g_clients.size();
+    g_clients.push_back(ClientInfo{fd, name});
+    return true;
+}
+
+// 按用户名查找 fd，不在线返回 -1。调用方需持有 g_clients_mutex
+int find_fd_by_name_locked(const std::string& name) {
+    auto it = g_name_index.find(name);
+    return it == g_name_index.end() ? -1 : g_clients[it->second].fd;
+}
+
 void remove_client_by_fd(int fd) {
     std::lock_guard<std::mutex> lock(g_clients_mutex);
-    for (auto it = g_clients.begin(); it != g_clients.end(); ++it) {
-        if (it->fd == fd) {
-            g_clients.erase(it);
-            break;
-        }
+    if (fd < 0 || fd >= (int)g_fd_index.size() || g_fd_index[fd] < 0) {
+        return;
+    }
+    size_t idx = (size_t)g_fd_index[fd];
+    g_name_index.erase(g_clients[idx].name);
+    g_fd_index[fd] = -1;
+
+    // 末尾元素移到空位，更新它的两个索引
+    size_t last = g_clients.size() - 1;
+    if (idx != last) {
+        g_clients[idx] = std::move(g_clients[last]);
+        g_fd_index[g_clients[idx].fd] = (int)idx;
+        g_name_index[g_clients[idx].name] = idx;
     }
+    g_clients.pop_back();
 }
 
 // ====================== 控制台线程：系统公告 / 关闭服务器 ======================
@@ -91,22 +142,37 @@ void* console_thread(void* arg) {
 void* client_thread(void* arg) {
     int client_fd = (int)(intptr_t)arg;
     ChatMessage msg{};
+    FrameReader reader;
+    frame_reader_init(reader, client_fd);
 
     // 第一次收到的应为登录消息
-    if (!recv_all(client_fd, &msg, sizeof(msg)) || msg.type != MSG_LOGIN) {
+    if (!recv_message(reader, msg) || msg.type != MSG_LOGIN) {
         close(client_fd);
         return nullptr;
     }
 
     std::string username = msg.from;
 
-    // 添加到在线列表
+    // 添加到在线列表（重名则拒绝登录）
     int online_count = 0;
+    bool accepted = false;
     {
         std::lock_guard<std::mutex> lock(g_clients_mutex);
-        g_clients.push_back(ClientInfo{client_fd, username});
+        accepted = add_client_locked(client_fd, username);
         online_count = (int)g_clients.size();
     }
+    if (!accepted) {
+        ChatMessage sys{};
+        sys.type = MSG_SYSTEM;
+        std::strncpy(sys.from, "SERVER", NAME_LEN - 1);
+        std::snprintf(sys.text, MSG_LEN,
+                      "Name '%s' is already in use.", username.c_str());
+        send_to_client(client_fd, sys);
+        std::cout << "[INFO] duplicate login rejected: '" << username
+                  << "', fd=" << client_fd << std::endl;
+        close(client_fd);
+        return nullptr;
+    }
 
     // 广播上线消息
     ChatMessage login_msg{};
@@ -121,17 +187,32 @@ void* client_thread(void* arg) {
               << "' connected, fd=" << client_fd
               << ", online=" << online_count << std::endl;
 
-    // 循环接收该客户端的后续消息
+    // 循环接收该客户端的后续消息。
+    // 群聊消息先攒进批次，读缓冲区里紧接着还有整帧就继续攒，读空后一次发给每个人：
+    // 刷屏时一次 send 带出几十条小帧，不再每条消息每个接收方各一次 send / 唤醒。
+    // 其他消息处理前先把批次发出，保证每个接收方看到的顺序与发送方一致
+    FrameBatch batch;
+    frame_batch_init(batch);
     while (true) {
         ChatMessage incoming{};
-        if (!recv_all(client_fd, &incoming, sizeof(incoming))) {
+        if (!recv_message(reader, incoming)) {
             // 客户端断开或错误
             break;
         }
 
+        if (incoming.type != MSG_BROADCAST) {
+            flush_batch(batch);
+        }
+
         if (incoming.type == MSG_BROADCAST) {
             // 群聊
-            broadcast_message(incoming);
+            if (!frame_batch_add(batch, incoming)) {
+                flush_batch(batch);
+                frame_batch_add(batch, incoming);
+            }
+            if (!frame_reader_ready(reader)) {
+                flush_batch(batch);
+            }
             std::cout << "[BROADCAST] from " << incoming.from
                       << ": " << incoming.text << std::endl;
         } else if (incoming.type == MSG_PRIVATE) {
@@ -141,12 +222,10 @@ void* client_thread(void* arg) {
 
             {
                 std::lock_guard<std::mutex> lock(g_clients_mutex);
-                for (auto& c : g_clients) {
-                    if (c.name == target) {
-                        send_to_client(c.fd, incoming);
-                        found = true;
-                        break;
-                    }
+                int target_fd = find_fd_by_name_locked(target);
+                if (target_fd >= 0) {
+                    send_to_client(target_fd, incoming);
+                    found = true;
                 }
             }
 
@@ -167,6 +246,8 @@ void* client_thread(void* arg) {
         }
     }
 
+    flush_batch(batch);
+
     // 处理退出
     remove_client_by_fd(client_fd);
 